@@ -0,0 +1,1309 @@
+-- -------------- --
+-- Kmer data type --
+-- -------------- --
+CREATE OR REPLACE FUNCTION kmer_in(cstring)
+RETURNS kmer
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_out(kmer)
+RETURNS cstring
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_recv(internal)
+RETURNS kmer
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_send(kmer)
+RETURNS bytea
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- A kmer (of at most 31 nucleotides) is passed by value: its 2-bit packed value, with a
+-- sentinel bit above it giving its length
+CREATE TYPE kmer (
+	INPUT = kmer_in,
+	OUTPUT = kmer_out,
+	RECEIVE = kmer_recv,
+	SEND = kmer_send,
+	INTERNALLENGTH = 8,
+	PASSEDBYVALUE,
+	ALIGNMENT = double
+);
+
+CREATE OR REPLACE FUNCTION kmer(text)
+RETURNS kmer
+AS '$libdir/kmea', 'kmer_cast_from_text'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION text(kmer)
+RETURNS text
+AS '$libdir/kmea', 'kmer_cast_to_text'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE CAST (text as kmer) WITH FUNCTION kmer(text) AS IMPLICIT;
+CREATE CAST (kmer as text) WITH FUNCTION text(kmer);
+
+CREATE OR REPLACE FUNCTION length(kmer)
+RETURNS integer
+AS '$libdir/kmea', 'kmer_length'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION canonical(kmer)
+RETURNS kmer
+AS '$libdir/kmea', 'kmer_canonical'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- OPERATORS
+CREATE OR REPLACE FUNCTION equals(kmer, kmer)
+RETURNS boolean
+AS '$libdir/kmea', 'kmer_eq'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR = (
+	PROCEDURE = equals,
+	LEFTARG = kmer,
+	RIGHTARG = kmer,
+	COMMUTATOR = =,
+	RESTRICT = eqsel,
+	JOIN = eqjoinsel,
+	HASHES,
+	MERGES
+);
+
+-- Lexicographic order of the nucleotides, a kmer coming after its prefixes
+CREATE OR REPLACE FUNCTION kmer_lt(kmer, kmer)
+RETURNS boolean
+AS '$libdir/kmea', 'kmer_lt'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_le(kmer, kmer)
+RETURNS boolean
+AS '$libdir/kmea', 'kmer_le'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_gt(kmer, kmer)
+RETURNS boolean
+AS '$libdir/kmea', 'kmer_gt'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_ge(kmer, kmer)
+RETURNS boolean
+AS '$libdir/kmea', 'kmer_ge'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR < (
+	PROCEDURE = kmer_lt,
+	LEFTARG = kmer,
+	RIGHTARG = kmer,
+	COMMUTATOR = >,
+	NEGATOR = >=,
+	RESTRICT = scalarltsel,
+	JOIN = scalarltjoinsel
+);
+
+CREATE OPERATOR <= (
+	PROCEDURE = kmer_le,
+	LEFTARG = kmer,
+	RIGHTARG = kmer,
+	COMMUTATOR = >=,
+	NEGATOR = >,
+	RESTRICT = scalarlesel,
+	JOIN = scalarlejoinsel
+);
+
+CREATE OPERATOR > (
+	PROCEDURE = kmer_gt,
+	LEFTARG = kmer,
+	RIGHTARG = kmer,
+	COMMUTATOR = <,
+	NEGATOR = <=,
+	RESTRICT = scalargtsel,
+	JOIN = scalargtjoinsel
+);
+
+CREATE OPERATOR >= (
+	PROCEDURE = kmer_ge,
+	LEFTARG = kmer,
+	RIGHTARG = kmer,
+	COMMUTATOR = <=,
+	NEGATOR = <,
+	RESTRICT = scalargesel,
+	JOIN = scalargejoinsel
+);
+
+CREATE OR REPLACE FUNCTION startswith(prefix kmer, kmer kmer)
+RETURNS boolean
+AS '$libdir/kmea', 'kmer_startswith'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- Turns kmer ^@ prefix into kmer >= prefix AND kmer < (next prefix) on B-tree and BRIN indexes
+CREATE OR REPLACE FUNCTION kmer_startswith_support(internal)
+RETURNS internal
+AS '$libdir/kmea', 'kmer_startswith_support'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION startswith_inv(kmer kmer, prefix kmer)
+RETURNS boolean
+AS '$libdir/kmea', 'kmer_startswith_inv'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE
+SUPPORT kmer_startswith_support;
+
+CREATE OPERATOR ^@ (
+	PROCEDURE = startswith_inv,
+	LEFTARG = kmer,
+	RIGHTARG = kmer
+);
+
+-- Hamming distance, the extra nucleotides of the longer kmer counting as mismatches
+CREATE OR REPLACE FUNCTION hamming_distance(kmer, kmer)
+RETURNS integer
+AS '$libdir/kmea', 'kmer_distance'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR <-> (
+	PROCEDURE = hamming_distance,
+	LEFTARG = kmer,
+	RIGHTARG = kmer,
+	COMMUTATOR = <->
+);
+
+CREATE OR REPLACE FUNCTION kmer_ball_in(cstring)
+RETURNS kmer_ball
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_ball_out(kmer_ball)
+RETURNS cstring
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_ball_recv(internal)
+RETURNS kmer_ball
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_ball_send(kmer_ball)
+RETURNS bytea
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- The kmers within a Hamming distance of a kmer, e.g. 'ACGTACGT/2'
+CREATE TYPE kmer_ball (
+	INPUT = kmer_ball_in,
+	OUTPUT = kmer_ball_out,
+	RECEIVE = kmer_ball_recv,
+	SEND = kmer_ball_send,
+	INTERNALLENGTH = 16,
+	ALIGNMENT = double
+);
+
+CREATE OR REPLACE FUNCTION ball(kmer, radius integer)
+RETURNS kmer_ball
+AS '$libdir/kmea', 'kmer_ball'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION within(kmer, kmer_ball)
+RETURNS boolean
+AS '$libdir/kmea', 'kmer_in_ball'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR <@ (
+	PROCEDURE = within,
+	LEFTARG = kmer,
+	RIGHTARG = kmer_ball
+);
+
+-- Inlined by the planner, so that the SP-GiST index is used
+CREATE OR REPLACE FUNCTION kmer_within(kmer, kmer, integer)
+RETURNS boolean
+AS 'SELECT $1 <@ ball($2, $3)'
+LANGUAGE SQL IMMUTABLE STRICT PARALLEL SAFE;
+	
+
+
+
+-- -------------- --
+-- DNA data type  --
+-- -------------- --
+CREATE OR REPLACE FUNCTION dna_in(cstring)
+RETURNS DNA
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION dna_out(DNA)
+RETURNS cstring
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION dna_recv(internal)
+RETURNS DNA
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION dna_send(DNA)
+RETURNS bytea
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE DNA (
+    INPUT = dna_in,
+    OUTPUT = dna_out,
+    RECEIVE = dna_recv,
+    SEND = dna_send,
+    STORAGE = external      -- 2-bit data does not compress, and uncompressed values can be sliced
+);
+
+CREATE OR REPLACE FUNCTION DNA(text)
+RETURNS DNA
+AS '$libdir/kmea', 'DNA_cast_from_text'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION text(DNA)
+RETURNS text
+AS '$libdir/kmea', 'DNA_cast_to_text'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE CAST (text as DNA) WITH FUNCTION DNA(text) AS IMPLICIT;
+CREATE CAST (DNA as text) WITH FUNCTION text(DNA);
+
+
+-- Equality of the sequences (IUPAC codes included), with hash joins
+CREATE OR REPLACE FUNCTION equals(DNA, DNA)
+RETURNS boolean
+AS '$libdir/kmea', 'dna_eq'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR = (
+	PROCEDURE = equals,
+	LEFTARG = DNA,
+	RIGHTARG = DNA,
+	COMMUTATOR = =,
+	RESTRICT = eqsel,
+	JOIN = eqjoinsel,
+	HASHES
+);
+
+CREATE OR REPLACE FUNCTION length(DNA)
+RETURNS integer
+AS '$libdir/kmea', 'dna_length'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION substring(DNA, integer, integer)
+RETURNS DNA
+AS '$libdir/kmea', 'dna_substring'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION substring(DNA, integer)
+RETURNS DNA
+AS '$libdir/kmea', 'dna_substring'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION base_at(DNA, integer)
+RETURNS text
+AS '$libdir/kmea', 'dna_base_at'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_at(DNA, integer, integer)
+RETURNS kmer
+AS '$libdir/kmea', 'dna_kmer_at'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION contains(DNA, kmer)
+RETURNS boolean
+AS '$libdir/kmea', 'dna_contains_kmer'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR @> (
+    PROCEDURE = contains,
+    LEFTARG = DNA,
+    RIGHTARG = kmer,
+    RESTRICT = contsel,
+    JOIN = contjoinsel
+);
+
+CREATE OR REPLACE FUNCTION contains(DNA, DNA)
+RETURNS boolean
+AS '$libdir/kmea', 'dna_contains_dna'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR @> (
+    PROCEDURE = contains,
+    LEFTARG = DNA,
+    RIGHTARG = DNA,
+    RESTRICT = contsel,
+    JOIN = contjoinsel
+);
+
+CREATE OR REPLACE FUNCTION strpos(DNA, kmer)
+RETURNS bigint
+AS '$libdir/kmea', 'dna_strpos'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- Edit distance (substitutions, insertions and deletions), an IUPAC code only matching itself.
+-- With max_edits, max_edits + 1 is returned as soon as the distance is known to exceed it.
+CREATE OR REPLACE FUNCTION edit_distance(DNA, DNA)
+RETURNS integer
+AS '$libdir/kmea', 'dna_edit_distance'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION edit_distance(DNA, DNA, max_edits integer)
+RETURNS integer
+AS '$libdir/kmea', 'dna_edit_distance'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- Approximate occurrences of a pattern: the end positions of the substrings within max_edits of it
+CREATE OR REPLACE FUNCTION dna_approx_find(DNA, pattern DNA, max_edits integer,
+	OUT end_pos bigint, OUT edits integer)
+RETURNS SETOF record
+AS '$libdir/kmea', 'dna_approx_find'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+
+CREATE OR REPLACE FUNCTION generate_kmers(DNA, integer)
+RETURNS SETOF kmer
+AS '$libdir/kmea', 'dna_generate_kmers'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION generate_canonical_kmers(DNA, integer)
+RETURNS SETOF kmer
+AS '$libdir/kmea', 'dna_generate_canonical_kmers'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- K-mer sampling: minimizers of windows of w K-mers, and closed syncmers with S-mers of length s
+CREATE OR REPLACE FUNCTION generate_minimizers(DNA, k integer, w integer)
+RETURNS SETOF kmer
+AS '$libdir/kmea', 'dna_generate_minimizers'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION generate_minimizer_positions(DNA, k integer, w integer,
+	OUT pos bigint, OUT kmer kmer)
+RETURNS SETOF record
+AS '$libdir/kmea', 'dna_generate_minimizer_positions'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION generate_syncmers(DNA, k integer, s integer)
+RETURNS SETOF kmer
+AS '$libdir/kmea', 'dna_generate_syncmers'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION generate_syncmer_positions(DNA, k integer, s integer,
+	OUT pos bigint, OUT kmer kmer)
+RETURNS SETOF record
+AS '$libdir/kmea', 'dna_generate_syncmer_positions'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- Server-side FASTA/FASTQ readers (need the privileges of pg_read_server_files).
+-- With chunk_size > 0, long records are split in rows of at most chunk_size nucleotides,
+-- pos giving the position of the first nucleotide of each row in its record.
+CREATE OR REPLACE FUNCTION read_fasta(path text, chunk_size integer DEFAULT 0,
+	OUT header text, OUT seq DNA, OUT pos bigint)
+RETURNS SETOF record
+AS '$libdir/kmea', 'read_fasta'
+LANGUAGE C VOLATILE STRICT;
+
+CREATE OR REPLACE FUNCTION read_fastq(path text, chunk_size integer DEFAULT 0,
+	OUT header text, OUT seq DNA, OUT pos bigint)
+RETURNS SETOF record
+AS '$libdir/kmea', 'read_fastq'
+LANGUAGE C VOLATILE STRICT;
+
+-- -------------- --
+-- qkmer data type  --
+-- -------------- --
+
+CREATE OR REPLACE FUNCTION qkmer_in(cstring)
+RETURNS qkmer
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION qkmer_out(qkmer)
+RETURNS cstring
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION qkmer_recv(internal)
+RETURNS qkmer
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION qkmer_send(qkmer)
+RETURNS bytea
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE qkmer (
+	INPUT = qkmer_in,
+	OUTPUT = qkmer_out,
+	RECEIVE = qkmer_recv,
+	SEND = qkmer_send,
+	INTERNALLENGTH = 17
+);
+
+CREATE OR REPLACE FUNCTION qkmer(text)
+RETURNS qkmer
+AS '$libdir/kmea', 'qkmer_cast_from_text'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION text(qkmer)
+RETURNS text
+AS '$libdir/kmea', 'qkmer_cast_to_text'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE CAST (text as qkmer) WITH FUNCTION qkmer(text) AS IMPLICIT;
+CREATE CAST (qkmer as text) WITH FUNCTION text(qkmer);
+
+CREATE OR REPLACE FUNCTION contains(qkmer, kmer)
+RETURNS boolean
+AS '$libdir/kmea', 'qkmer_contains'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR @> (
+	PROCEDURE = contains,
+	LEFTARG = qkmer,
+	RIGHTARG = kmer
+);
+
+CREATE OR REPLACE FUNCTION contains(DNA, qkmer)
+RETURNS boolean
+AS '$libdir/kmea', 'dna_contains_qkmer'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR @> (
+    PROCEDURE = contains,
+    LEFTARG = DNA,
+    RIGHTARG = qkmer,
+    RESTRICT = contsel,
+    JOIN = contjoinsel
+);
+
+CREATE OR REPLACE FUNCTION qkmer_positions(DNA, qkmer)
+RETURNS SETOF bigint
+AS '$libdir/kmea', 'dna_qkmer_positions'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION length(qkmer)
+RETURNS integer
+AS '$libdir/kmea', 'qkmer_length'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- Equality of the patterns (the same nucleotides allowed at each position), with hash joins
+CREATE OR REPLACE FUNCTION equals(qkmer, qkmer)
+RETURNS boolean
+AS '$libdir/kmea', 'qkmer_eq'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR = (
+	PROCEDURE = equals,
+	LEFTARG = qkmer,
+	RIGHTARG = qkmer,
+	COMMUTATOR = =,
+	RESTRICT = eqsel,
+	JOIN = eqjoinsel,
+	HASHES
+);
+
+
+-- ------------------------- --
+-- Kmer spectrum data type   --
+-- ------------------------- --
+CREATE OR REPLACE FUNCTION spectrum_in(cstring)
+RETURNS kmer_spectrum
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION spectrum_out(kmer_spectrum)
+RETURNS cstring
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION spectrum_recv(internal)
+RETURNS kmer_spectrum
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION spectrum_send(kmer_spectrum)
+RETURNS bytea
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE kmer_spectrum (
+    INPUT = spectrum_in,
+    OUTPUT = spectrum_out,
+    RECEIVE = spectrum_recv,
+    SEND = spectrum_send,
+    STORAGE = extended
+);
+
+CREATE OR REPLACE FUNCTION spectrum(DNA, integer)
+RETURNS kmer_spectrum
+AS '$libdir/kmea', 'dna_spectrum'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION spectrum(DNA, integer, canonical boolean)
+RETURNS kmer_spectrum
+AS '$libdir/kmea', 'dna_spectrum'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION cardinality(kmer_spectrum)
+RETURNS bigint
+AS '$libdir/kmea', 'spectrum_cardinality'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmers(kmer_spectrum)
+RETURNS SETOF kmer
+AS '$libdir/kmea', 'spectrum_kmers'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION jaccard(kmer_spectrum, kmer_spectrum)
+RETURNS double precision
+AS '$libdir/kmea', 'spectrum_jaccard'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- Fraction of the kmers of the first spectrum which are in the second one
+CREATE OR REPLACE FUNCTION containment(kmer_spectrum, kmer_spectrum)
+RETURNS double precision
+AS '$libdir/kmea', 'spectrum_containment'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION spectrum_union(kmer_spectrum, kmer_spectrum)
+RETURNS kmer_spectrum
+AS '$libdir/kmea', 'spectrum_union'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION spectrum_intersection(kmer_spectrum, kmer_spectrum)
+RETURNS kmer_spectrum
+AS '$libdir/kmea', 'spectrum_intersection'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION spectrum_difference(kmer_spectrum, kmer_spectrum)
+RETURNS kmer_spectrum
+AS '$libdir/kmea', 'spectrum_difference'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION equals(kmer_spectrum, kmer_spectrum)
+RETURNS boolean
+AS '$libdir/kmea', 'spectrum_eq'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION contains(kmer_spectrum, kmer_spectrum)
+RETURNS boolean
+AS '$libdir/kmea', 'spectrum_contains'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION contained(kmer_spectrum, kmer_spectrum)
+RETURNS boolean
+AS '$libdir/kmea', 'spectrum_contained'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION contains(kmer_spectrum, kmer)
+RETURNS boolean
+AS '$libdir/kmea', 'spectrum_contains_kmer'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR | (
+    PROCEDURE = spectrum_union,
+    LEFTARG = kmer_spectrum,
+    RIGHTARG = kmer_spectrum,
+    COMMUTATOR = |
+);
+
+CREATE OPERATOR & (
+    PROCEDURE = spectrum_intersection,
+    LEFTARG = kmer_spectrum,
+    RIGHTARG = kmer_spectrum,
+    COMMUTATOR = &
+);
+
+CREATE OPERATOR - (
+    PROCEDURE = spectrum_difference,
+    LEFTARG = kmer_spectrum,
+    RIGHTARG = kmer_spectrum
+);
+
+CREATE OPERATOR = (
+    PROCEDURE = equals,
+    LEFTARG = kmer_spectrum,
+    RIGHTARG = kmer_spectrum,
+    COMMUTATOR = =
+);
+
+CREATE OPERATOR @> (
+    PROCEDURE = contains,
+    LEFTARG = kmer_spectrum,
+    RIGHTARG = kmer_spectrum,
+    COMMUTATOR = <@
+);
+
+CREATE OPERATOR <@ (
+    PROCEDURE = contained,
+    LEFTARG = kmer_spectrum,
+    RIGHTARG = kmer_spectrum,
+    COMMUTATOR = @>
+);
+
+CREATE OPERATOR @> (
+    PROCEDURE = contains,
+    LEFTARG = kmer_spectrum,
+    RIGHTARG = kmer
+);
+
+
+-- ------------------------- --
+-- Kmer sketch data type     --
+-- ------------------------- --
+CREATE OR REPLACE FUNCTION sketch_in(cstring)
+RETURNS kmer_sketch
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION sketch_out(kmer_sketch)
+RETURNS cstring
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION sketch_recv(internal)
+RETURNS kmer_sketch
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION sketch_send(kmer_sketch)
+RETURNS bytea
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE kmer_sketch (
+    INPUT = sketch_in,
+    OUTPUT = sketch_out,
+    RECEIVE = sketch_recv,
+    SEND = sketch_send,
+    ALIGNMENT = double,
+    STORAGE = extended
+);
+
+-- Bottom-s MinHash sketch of the (canonical by default) kmers of a sequence
+CREATE OR REPLACE FUNCTION sketch(DNA, k integer, s integer DEFAULT 1000, canonical boolean DEFAULT true)
+RETURNS kmer_sketch
+AS '$libdir/kmea', 'dna_sketch'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION jaccard(kmer_sketch, kmer_sketch)
+RETURNS double precision
+AS '$libdir/kmea', 'sketch_jaccard'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION mash_distance(kmer_sketch, kmer_sketch)
+RETURNS double precision
+AS '$libdir/kmea', 'sketch_distance'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR <-> (
+    PROCEDURE = mash_distance,
+    LEFTARG = kmer_sketch,
+    RIGHTARG = kmer_sketch,
+    COMMUTATOR = <->
+);
+
+CREATE OR REPLACE FUNCTION sketch_agg_transfn(internal, DNA, integer, integer)
+RETURNS internal
+AS '$libdir/kmea', 'sketch_agg_transfn'
+LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION sketch_agg_transfn(internal, DNA, integer, integer, boolean)
+RETURNS internal
+AS '$libdir/kmea', 'sketch_agg_transfn'
+LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION sketch_agg_combinefn(internal, internal)
+RETURNS internal
+AS '$libdir/kmea', 'sketch_agg_combinefn'
+LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION sketch_agg_finalfn(internal)
+RETURNS kmer_sketch
+AS '$libdir/kmea', 'sketch_agg_serialfn'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION sketch_agg_serialfn(internal)
+RETURNS bytea
+AS '$libdir/kmea', 'sketch_agg_serialfn'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION sketch_agg_deserialfn(bytea, internal)
+RETURNS internal
+AS '$libdir/kmea', 'sketch_agg_deserialfn'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE AGGREGATE sketch_agg(DNA, integer, integer) (
+    SFUNC = sketch_agg_transfn,
+    STYPE = internal,
+    FINALFUNC = sketch_agg_finalfn,
+    COMBINEFUNC = sketch_agg_combinefn,
+    SERIALFUNC = sketch_agg_serialfn,
+    DESERIALFUNC = sketch_agg_deserialfn,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE sketch_agg(DNA, integer, integer, boolean) (
+    SFUNC = sketch_agg_transfn,
+    STYPE = internal,
+    FINALFUNC = sketch_agg_finalfn,
+    COMBINEFUNC = sketch_agg_combinefn,
+    SERIALFUNC = sketch_agg_serialfn,
+    DESERIALFUNC = sketch_agg_deserialfn,
+    PARALLEL = SAFE
+);
+
+
+-- ---------------------------- --
+-- Kmer HyperLogLog data type   --
+-- ---------------------------- --
+CREATE OR REPLACE FUNCTION hll_in(cstring)
+RETURNS kmer_hll
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION hll_out(kmer_hll)
+RETURNS cstring
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION hll_recv(internal)
+RETURNS kmer_hll
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION hll_send(kmer_hll)
+RETURNS bytea
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE kmer_hll (
+    INPUT = hll_in,
+    OUTPUT = hll_out,
+    RECEIVE = hll_recv,
+    SEND = hll_send,
+    STORAGE = extended      -- the registers of small sets are mostly zeros
+);
+
+CREATE OR REPLACE FUNCTION cardinality(kmer_hll)
+RETURNS bigint
+AS '$libdir/kmea', 'hll_cardinality'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION hll_union(kmer_hll, kmer_hll)
+RETURNS kmer_hll
+AS '$libdir/kmea', 'hll_union'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR || (
+    PROCEDURE = hll_union,
+    LEFTARG = kmer_hll,
+    RIGHTARG = kmer_hll,
+    COMMUTATOR = ||
+);
+
+CREATE OR REPLACE FUNCTION hll_add_kmer_transfn(internal, kmer)
+RETURNS internal
+AS '$libdir/kmea', 'hll_add_kmer_transfn'
+LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION hll_add_dna_transfn(internal, DNA, integer)
+RETURNS internal
+AS '$libdir/kmea', 'hll_add_dna_transfn'
+LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION hll_union_transfn(internal, kmer_hll)
+RETURNS internal
+AS '$libdir/kmea', 'hll_union_transfn'
+LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION hll_combinefn(internal, internal)
+RETURNS internal
+AS '$libdir/kmea', 'hll_combinefn'
+LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION hll_serialfn(internal)
+RETURNS bytea
+AS '$libdir/kmea', 'hll_serialfn'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION hll_deserialfn(bytea, internal)
+RETURNS internal
+AS '$libdir/kmea', 'hll_deserialfn'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION hll_finalfn(internal)
+RETURNS kmer_hll
+AS '$libdir/kmea', 'hll_serialfn'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION hll_cardinality_finalfn(internal)
+RETURNS bigint
+AS '$libdir/kmea', 'hll_cardinality_finalfn'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- HyperLogLog sketch of a set of kmers, to be stored and merged later (with || or hll_union_agg)
+CREATE AGGREGATE kmer_hll(kmer) (
+    SFUNC = hll_add_kmer_transfn,
+    STYPE = internal,
+    FINALFUNC = hll_finalfn,
+    COMBINEFUNC = hll_combinefn,
+    SERIALFUNC = hll_serialfn,
+    DESERIALFUNC = hll_deserialfn,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE kmer_hll(DNA, integer) (
+    SFUNC = hll_add_dna_transfn,
+    STYPE = internal,
+    FINALFUNC = hll_finalfn,
+    COMBINEFUNC = hll_combinefn,
+    SERIALFUNC = hll_serialfn,
+    DESERIALFUNC = hll_deserialfn,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE hll_union_agg(kmer_hll) (
+    SFUNC = hll_union_transfn,
+    STYPE = internal,
+    FINALFUNC = hll_finalfn,
+    COMBINEFUNC = hll_combinefn,
+    SERIALFUNC = hll_serialfn,
+    DESERIALFUNC = hll_deserialfn,
+    PARALLEL = SAFE
+);
+
+-- Approximate number of distinct kmers (relative standard error of about 0.8%)
+CREATE AGGREGATE approx_distinct_kmers(DNA, integer) (
+    SFUNC = hll_add_dna_transfn,
+    STYPE = internal,
+    FINALFUNC = hll_cardinality_finalfn,
+    COMBINEFUNC = hll_combinefn,
+    SERIALFUNC = hll_serialfn,
+    DESERIALFUNC = hll_deserialfn,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE approx_distinct_kmers(kmer) (
+    SFUNC = hll_add_kmer_transfn,
+    STYPE = internal,
+    FINALFUNC = hll_cardinality_finalfn,
+    COMBINEFUNC = hll_combinefn,
+    SERIALFUNC = hll_serialfn,
+    DESERIALFUNC = hll_deserialfn,
+    PARALLEL = SAFE
+);
+
+
+-- ------------------------- --
+-- Kmer Bloom filter type    --
+-- ------------------------- --
+CREATE OR REPLACE FUNCTION bloom_in(cstring)
+RETURNS kmer_bloom
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION bloom_out(kmer_bloom)
+RETURNS cstring
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION bloom_recv(internal)
+RETURNS kmer_bloom
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION bloom_send(kmer_bloom)
+RETURNS bytea
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE kmer_bloom (
+    INPUT = bloom_in,
+    OUTPUT = bloom_out,
+    RECEIVE = bloom_recv,
+    SEND = bloom_send,
+    STORAGE = extended
+);
+
+CREATE OR REPLACE FUNCTION bloom(DNA, k integer, bits integer)
+RETURNS kmer_bloom
+AS '$libdir/kmea', 'dna_bloom'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION contains(kmer_bloom, kmer)
+RETURNS boolean
+AS '$libdir/kmea', 'bloom_contains'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION contains_any(kmer_bloom, kmer[])
+RETURNS boolean
+AS '$libdir/kmea', 'bloom_contains_any'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION contains_all(kmer_bloom, kmer[])
+RETURNS boolean
+AS '$libdir/kmea', 'bloom_contains_all'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR @> (
+    PROCEDURE = contains,
+    LEFTARG = kmer_bloom,
+    RIGHTARG = kmer
+);
+
+CREATE OPERATOR @> (
+    PROCEDURE = contains_all,
+    LEFTARG = kmer_bloom,
+    RIGHTARG = kmer[]
+);
+
+CREATE OPERATOR && (
+    PROCEDURE = contains_any,
+    LEFTARG = kmer_bloom,
+    RIGHTARG = kmer[]
+);
+
+
+-- ------------------- --
+-- Kmer counting       --
+-- ------------------- --
+
+-- kmer_count(dna, k [, canonical]) counts the K-mers of a column in a single pass, in a hash table
+-- merged across parallel workers; kmer_counts() unnests its kmer_count_table result into (kmer, count)
+-- rows. A kmer_count_table holds 16 bytes per distinct K-mer, up to 1 GB (about 67 million K-mers).
+CREATE OR REPLACE FUNCTION kmer_count_table_in(cstring)
+RETURNS kmer_count_table
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_count_table_out(kmer_count_table)
+RETURNS cstring
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_count_table_recv(internal)
+RETURNS kmer_count_table
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_count_table_send(kmer_count_table)
+RETURNS bytea
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE kmer_count_table (
+    INPUT = kmer_count_table_in,
+    OUTPUT = kmer_count_table_out,
+    RECEIVE = kmer_count_table_recv,
+    SEND = kmer_count_table_send,
+    STORAGE = extended
+);
+
+CREATE OR REPLACE FUNCTION kmer_count_transfn(internal, DNA, integer)
+RETURNS internal
+AS '$libdir/kmea', 'kmer_count_transfn'
+LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_count_transfn(internal, DNA, integer, boolean)
+RETURNS internal
+AS '$libdir/kmea', 'kmer_count_transfn'
+LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_count_combinefn(internal, internal)
+RETURNS internal
+AS '$libdir/kmea', 'kmer_count_combinefn'
+LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_count_finalfn(internal)
+RETURNS kmer_count_table
+AS '$libdir/kmea', 'kmer_count_serialfn'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_count_serialfn(internal)
+RETURNS bytea
+AS '$libdir/kmea', 'kmer_count_serialfn'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_count_deserialfn(bytea, internal)
+RETURNS internal
+AS '$libdir/kmea', 'kmer_count_deserialfn'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE AGGREGATE kmer_count(DNA, integer) (
+	SFUNC = kmer_count_transfn,
+	STYPE = internal,
+	FINALFUNC = kmer_count_finalfn,
+	COMBINEFUNC = kmer_count_combinefn,
+	SERIALFUNC = kmer_count_serialfn,
+	DESERIALFUNC = kmer_count_deserialfn,
+	PARALLEL = SAFE
+);
+
+CREATE AGGREGATE kmer_count(DNA, integer, boolean) (
+	SFUNC = kmer_count_transfn,
+	STYPE = internal,
+	FINALFUNC = kmer_count_finalfn,
+	COMBINEFUNC = kmer_count_combinefn,
+	SERIALFUNC = kmer_count_serialfn,
+	DESERIALFUNC = kmer_count_deserialfn,
+	PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION kmer_counts(kmer_count_table, OUT kmer kmer, OUT count bigint)
+RETURNS SETOF record
+AS '$libdir/kmea', 'kmer_count_unnest'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+
+-- ------------------ --
+-- Hash opclasses     --
+-- ------------------ --
+-- Hash joins, hash aggregates and hash partitioning (PARTITION BY HASH) on kmers, qkmers and DNA.
+-- Function 2 is the seeded 64-bit hash used by hash partitioning.
+
+CREATE OR REPLACE FUNCTION kmer_hash(kmer)
+RETURNS integer
+AS '$libdir/kmea', 'kmer_hash'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_hash_extended(kmer, bigint)
+RETURNS bigint
+AS '$libdir/kmea', 'kmer_hash_extended'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR CLASS hash_kmer_ops
+DEFAULT FOR TYPE kmer USING hash
+AS
+        OPERATOR        1       =  ,
+        FUNCTION        1       kmer_hash(kmer),
+        FUNCTION        2       kmer_hash_extended(kmer, bigint);
+
+CREATE OR REPLACE FUNCTION qkmer_hash(qkmer)
+RETURNS integer
+AS '$libdir/kmea', 'qkmer_hash'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION qkmer_hash_extended(qkmer, bigint)
+RETURNS bigint
+AS '$libdir/kmea', 'qkmer_hash_extended'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR CLASS hash_qkmer_ops
+DEFAULT FOR TYPE qkmer USING hash
+AS
+        OPERATOR        1       =  ,
+        FUNCTION        1       qkmer_hash(qkmer),
+        FUNCTION        2       qkmer_hash_extended(qkmer, bigint);
+
+CREATE OR REPLACE FUNCTION dna_hash(DNA)
+RETURNS integer
+AS '$libdir/kmea', 'dna_hash'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION dna_hash_extended(DNA, bigint)
+RETURNS bigint
+AS '$libdir/kmea', 'dna_hash_extended'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR CLASS hash_dna_ops
+DEFAULT FOR TYPE DNA USING hash
+AS
+        OPERATOR        1       =  ,
+        FUNCTION        1       dna_hash(DNA),
+        FUNCTION        2       dna_hash_extended(DNA, bigint);
+
+-- -------------------- --
+-- Kmer B-tree opclass  --
+-- -------------------- --
+-- ORDER BY, merge joins, sorted GROUP BY / DISTINCT and range scans on kmers. The sort support
+-- function sorts on 64-bit abbreviated keys (the kmers aligned on their first nucleotide).
+
+CREATE OR REPLACE FUNCTION kmer_cmp(kmer, kmer)
+RETURNS integer
+AS '$libdir/kmea', 'kmer_cmp'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_sortsupport(internal)
+RETURNS void
+AS '$libdir/kmea', 'kmer_sortsupport'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR CLASS btree_kmer_ops
+DEFAULT FOR TYPE kmer USING btree
+AS
+        OPERATOR        1       <  ,
+        OPERATOR        2       <= ,
+        OPERATOR        3       =  ,
+        OPERATOR        4       >= ,
+        OPERATOR        5       >  ,
+        FUNCTION        1       kmer_cmp(kmer, kmer),
+        FUNCTION        2       kmer_sortsupport(internal);
+
+-- ------------------ --
+-- Kmer BRIN index    --
+-- ------------------ --
+-- Min/max summaries of the kmers of each block range, in lexicographic order: a tiny index for
+-- tables loaded in (roughly) kmer order, used by =, <, <=, >, >= and ^@ (a prefix range).
+
+CREATE OPERATOR CLASS brin_kmer_minmax_ops
+DEFAULT FOR TYPE kmer USING brin
+AS
+        OPERATOR        1       <  ,
+        OPERATOR        2       <= ,
+        OPERATOR        3       =  ,
+        OPERATOR        4       >= ,
+        OPERATOR        5       >  ,
+        FUNCTION        1       brin_minmax_opcinfo(internal),
+        FUNCTION        2       brin_minmax_add_value(internal, internal, internal, internal),
+        FUNCTION        3       brin_minmax_consistent(internal, internal, internal),
+        FUNCTION        4       brin_minmax_union(internal, internal, internal);
+
+-- ------------------- --
+-- Kmer SP-GiST index  --
+-- ------------------- --
+
+
+CREATE OR REPLACE FUNCTION kmer_spgist_config(internal, internal)
+RETURNS void
+AS '$libdir/kmea', 'kmer_spgist_config'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_spgist_choose(internal, internal)
+RETURNS void
+AS '$libdir/kmea', 'kmer_spgist_choose'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_spgist_picksplit(internal, internal)
+RETURNS void
+AS '$libdir/kmea', 'kmer_spgist_picksplit'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_spgist_inner_consistent(internal, internal)
+RETURNS void
+AS '$libdir/kmea', 'kmer_spgist_inner_consistent'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION kmer_spgist_leaf_consistent(internal, internal)
+RETURNS boolean
+AS '$libdir/kmea', 'kmer_spgist_leaf_consistent'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- Option stride (1 to 3, 1 by default): nucleotides per level of the trie, for a fan-out of 4^stride,
+-- e.g. CREATE INDEX ON kmers USING spgist (kmer spgist_kmer_ops (stride = 2))
+CREATE OR REPLACE FUNCTION kmer_spgist_options(internal)
+RETURNS void
+AS '$libdir/kmea', 'kmer_spgist_options'
+LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+
+
+CREATE OPERATOR CLASS spgist_kmer_ops
+DEFAULT FOR TYPE kmer USING spgist
+AS
+    OPERATOR    1   = (kmer, kmer) ,
+    OPERATOR    2   ^@(kmer, kmer) ,
+    OPERATOR    3   @>(qkmer, kmer) ,
+    OPERATOR    4   <@(kmer, kmer_ball) ,
+    OPERATOR    5   <->(kmer, kmer) FOR ORDER BY integer_ops ,
+    FUNCTION    1   kmer_spgist_config(internal, internal),
+    FUNCTION    2   kmer_spgist_choose(internal, internal),
+    FUNCTION    3   kmer_spgist_picksplit(internal, internal),
+    FUNCTION    4   kmer_spgist_inner_consistent(internal, internal),
+    FUNCTION    5   kmer_spgist_leaf_consistent(internal, internal),
+    FUNCTION    7   kmer_spgist_options(internal);
+
+
+-- ----------------------- --
+-- Kmer sketch GiST index  --
+-- ----------------------- --
+
+CREATE OR REPLACE FUNCTION sketch_gist_consistent(internal, kmer_sketch, smallint, oid, internal)
+RETURNS boolean
+AS '$libdir/kmea', 'sketch_gist_consistent'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION sketch_gist_union(internal, internal)
+RETURNS bytea
+AS '$libdir/kmea', 'sketch_gist_union'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION sketch_gist_compress(internal)
+RETURNS internal
+AS '$libdir/kmea', 'sketch_gist_compress'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION sketch_gist_penalty(internal, internal, internal)
+RETURNS internal
+AS '$libdir/kmea', 'sketch_gist_penalty'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION sketch_gist_picksplit(internal, internal)
+RETURNS internal
+AS '$libdir/kmea', 'sketch_gist_picksplit'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION sketch_gist_same(bytea, bytea, internal)
+RETURNS internal
+AS '$libdir/kmea', 'sketch_gist_same'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION sketch_gist_distance(internal, kmer_sketch, smallint, oid, internal)
+RETURNS double precision
+AS '$libdir/kmea', 'sketch_gist_distance'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- Lossy signatures: ORDER BY sketch <-> query returns the nearest sketches first, the exact
+-- distances being rechecked on the heap tuples.
+CREATE OPERATOR CLASS gist_sketch_ops
+DEFAULT FOR TYPE kmer_sketch USING gist
+AS
+    OPERATOR    15  <-> (kmer_sketch, kmer_sketch) FOR ORDER BY float_ops,
+    FUNCTION    1   sketch_gist_consistent(internal, kmer_sketch, smallint, oid, internal),
+    FUNCTION    2   sketch_gist_union(internal, internal),
+    FUNCTION    3   sketch_gist_compress(internal),
+    FUNCTION    5   sketch_gist_penalty(internal, internal, internal),
+    FUNCTION    6   sketch_gist_picksplit(internal, internal),
+    FUNCTION    7   sketch_gist_same(bytea, bytea, internal),
+    FUNCTION    8   sketch_gist_distance(internal, kmer_sketch, smallint, oid, internal),
+    STORAGE     bytea;
+
+
+-- ------------------------- --
+-- DNA GIN index             --
+-- ------------------------- --
+CREATE OR REPLACE FUNCTION gin_dna_extract_value(DNA, internal)
+RETURNS internal
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION gin_dna_extract_query(DNA, internal, int2, internal, internal, internal, internal)
+RETURNS internal
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION gin_dna_consistent(internal, int2, DNA, int4, internal, internal, internal, internal)
+RETURNS boolean
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION gin_dna_options(internal)
+RETURNS void
+AS '$libdir/kmea'
+LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+-- Options: k (length of the indexed kmers, 12 by default), canonical, w (minimizer window, 1 by default)
+CREATE OPERATOR CLASS gin_dna_ops
+DEFAULT FOR TYPE DNA USING gin AS
+    OPERATOR    1   @>(DNA, kmer),
+    OPERATOR    2   @>(DNA, DNA),
+    OPERATOR    3   @>(DNA, qkmer),
+    FUNCTION    1   btint8cmp(int8, int8),
+    FUNCTION    2   gin_dna_extract_value(DNA, internal),
+    FUNCTION    3   gin_dna_extract_query(DNA, internal, int2, internal, internal, internal, internal),
+    FUNCTION    4   gin_dna_consistent(internal, int2, DNA, int4, internal, internal, internal, internal),
+    FUNCTION    7   gin_dna_options(internal),
+    STORAGE     int8;
@@ -0,0 +1,104 @@
+\set db_name 'kmea_bench'
+
+-- Compares the strides of the SP-GiST index on kmers (1, 2 and 3 nucleotides per level of the trie):
+-- build time, index size, pages visited and latency of point, prefix and qkmer queries.
+-- Run with: psql -d postgres -f kmea_spgist_bench.sql
+
+DROP DATABASE IF EXISTS :db_name;
+CREATE DATABASE :db_name;
+\c :db_name;
+
+CREATE EXTENSION kmea;
+CREATE TABLE dnas(id serial primary key, dna DNA);
+CREATE TABLE kmers(id serial primary key, kmer kmer);
+
+-- Random sequences of 1000 nucleotides, about 20M kmers
+\set nb_sequences 20000
+\set sequence_length 1000
+\set kmer_length 21
+
+INSERT INTO dnas(dna)
+SELECT string_agg(substr('ACGT', 1 + floor(random() * 4)::integer, 1), '')::DNA
+FROM generate_series(1, :nb_sequences) AS s(id), generate_series(1, :sequence_length) AS p(pos)
+GROUP BY s.id;
+
+INSERT INTO kmers(kmer)
+SELECT k.kmer
+FROM dnas, LATERAL generate_kmers(dna, :kmer_length) AS k(kmer);
+
+-- A few short kmers, so that some kmers end inside the trie
+INSERT INTO kmers(kmer)
+SELECT k.kmer
+FROM dnas, LATERAL generate_kmers(dna, 7) AS k(kmer)
+WHERE dnas.id <= :nb_sequences / 100;
+
+-- The queries: an indexed kmer, its first 8 nucleotides, and a pattern with two ambiguous nucleotides
+SELECT kmer::text AS point, left(kmer::text, 8) AS prefix, overlay(kmer::text PLACING 'NN' FROM 5) AS pattern
+FROM kmers
+WHERE id = :nb_sequences
+\gset
+
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+
+-- ---------- stride = 1 ---------- --
+\set stride 1
+DROP INDEX IF EXISTS kmer_spgist_idx;
+\timing on
+CREATE INDEX kmer_spgist_idx ON kmers USING spgist (kmer spgist_kmer_ops (stride = :stride));
+\timing off
+SELECT :stride AS "Stride", pg_size_pretty(pg_relation_size('kmer_spgist_idx')) AS "Index size";
+ANALYZE kmers;
+
+-- Point, prefix and qkmer queries (the shared buffers hit by the point query are the pages of its path)
+EXPLAIN (ANALYZE, BUFFERS, COSTS OFF) SELECT count(*) FROM kmers WHERE kmer = :'point';
+EXPLAIN (ANALYZE, BUFFERS, COSTS OFF) SELECT count(*) FROM kmers WHERE kmer ^@ :'prefix';
+EXPLAIN (ANALYZE, BUFFERS, COSTS OFF) SELECT count(*) FROM kmers WHERE :'pattern'::qkmer @> kmer;
+
+\timing on
+SELECT count(*) AS "Point matches" FROM kmers WHERE kmer = :'point';
+SELECT count(*) AS "Prefix matches" FROM kmers WHERE kmer ^@ :'prefix';
+SELECT count(*) AS "Qkmer matches" FROM kmers WHERE :'pattern'::qkmer @> kmer;
+\timing off
+
+-- ---------- stride = 2 ---------- --
+\set stride 2
+DROP INDEX IF EXISTS kmer_spgist_idx;
+\timing on
+CREATE INDEX kmer_spgist_idx ON kmers USING spgist (kmer spgist_kmer_ops (stride = :stride));
+\timing off
+SELECT :stride AS "Stride", pg_size_pretty(pg_relation_size('kmer_spgist_idx')) AS "Index size";
+ANALYZE kmers;
+
+-- Point, prefix and qkmer queries (the shared buffers hit by the point query are the pages of its path)
+EXPLAIN (ANALYZE, BUFFERS, COSTS OFF) SELECT count(*) FROM kmers WHERE kmer = :'point';
+EXPLAIN (ANALYZE, BUFFERS, COSTS OFF) SELECT count(*) FROM kmers WHERE kmer ^@ :'prefix';
+EXPLAIN (ANALYZE, BUFFERS, COSTS OFF) SELECT count(*) FROM kmers WHERE :'pattern'::qkmer @> kmer;
+
+\timing on
+SELECT count(*) AS "Point matches" FROM kmers WHERE kmer = :'point';
+SELECT count(*) AS "Prefix matches" FROM kmers WHERE kmer ^@ :'prefix';
+SELECT count(*) AS "Qkmer matches" FROM kmers WHERE :'pattern'::qkmer @> kmer;
+\timing off
+
+-- ---------- stride = 3 ---------- --
+\set stride 3
+DROP INDEX IF EXISTS kmer_spgist_idx;
+\timing on
+CREATE INDEX kmer_spgist_idx ON kmers USING spgist (kmer spgist_kmer_ops (stride = :stride));
+\timing off
+SELECT :stride AS "Stride", pg_size_pretty(pg_relation_size('kmer_spgist_idx')) AS "Index size";
+ANALYZE kmers;
+
+-- Point, prefix and qkmer queries (the shared buffers hit by the point query are the pages of its path)
+EXPLAIN (ANALYZE, BUFFERS, COSTS OFF) SELECT count(*) FROM kmers WHERE kmer = :'point';
+EXPLAIN (ANALYZE, BUFFERS, COSTS OFF) SELECT count(*) FROM kmers WHERE kmer ^@ :'prefix';
+EXPLAIN (ANALYZE, BUFFERS, COSTS OFF) SELECT count(*) FROM kmers WHERE :'pattern'::qkmer @> kmer;
+
+\timing on
+SELECT count(*) AS "Point matches" FROM kmers WHERE kmer = :'point';
+SELECT count(*) AS "Prefix matches" FROM kmers WHERE kmer ^@ :'prefix';
+SELECT count(*) AS "Qkmer matches" FROM kmers WHERE :'pattern'::qkmer @> kmer;
+\timing off
+
+DROP INDEX kmer_spgist_idx;
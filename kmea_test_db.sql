@@ -72,6 +72,14 @@ SELECT count(*) AS "Amount that matches HAWKNNSAYBBDHVDDNNNNDRVWMDDHDS"
 FROM kmers WHERE 'HAWKNNSAYBBDHVDDNNNNDRVWMDDHDS' @> kmer;
 
 
+-- Test the Hamming distance: kmers within 1 mismatch, and the nearest kmers
+SELECT count(*) AS "Amount within 1 mismatch of ACTGC"
+FROM kmers WHERE kmer_within(kmer, 'ACTGC', 1);
+
+SELECT kmer, kmer <-> 'ACTGCA' AS "Mismatches with ACTGCA"
+FROM kmers ORDER BY kmer <-> 'ACTGCA' LIMIT 5;
+
+
 -- Test the counting support
 SELECT kmer, count(*) AS "Amount of occurrences of the k-mers"
 FROM kmers
@@ -89,6 +97,10 @@ count(*) AS "Distinct count",
 count(*) FILTER (WHERE count = 1) AS "Unique count"
 FROM counted;
 
+-- Approximate distinct count (HyperLogLog), without the exact GROUP BY
+SELECT approx_distinct_kmers(kmer) AS "Approximate distinct count"
+FROM kmers;
+
 
 -- Test the index scan vs seq scan
 SET enable_seqscan = on;
@@ -100,4 +112,95 @@ SET enable_seqscan = off;
 EXPLAIN ANALYZE SELECT count(*) FROM kmers WHERE kmer ^@ 'ACTGCA';
 SELECT count(*) as "Amount that starts with ACTGCA using INDEX SCAN"
 FROM kmers
-WHERE kmer ^@ 'ACTGCA';
\ No newline at end of file
+WHERE kmer ^@ 'ACTGCA';
+
+
+-- Test the GIN index on the DNA sequences: index scan vs seq scan for the three @> operators,
+-- with the default options and then with canonical minimizers
+SELECT substring(dna, 11, 16)::text AS gin_kmer, substring(dna, 101, 40)::text AS gin_dna
+FROM DNAS
+WHERE length(dna) >= 200
+ORDER BY id
+LIMIT 1 \gset
+\set gin_qkmer 'ACGTNRACGTACGT'
+
+CREATE INDEX dna_idx ON DNAS USING gin(dna gin_dna_ops);
+
+SET enable_seqscan = on;
+SELECT count(*) AS "Amount that contains the kmer using SEQ SCAN"
+FROM DNAS WHERE dna @> :'gin_kmer'::kmer;
+SELECT count(*) AS "Amount that contains the DNA using SEQ SCAN"
+FROM DNAS WHERE dna @> :'gin_dna'::DNA;
+SELECT count(*) AS "Amount that contains the qkmer using SEQ SCAN"
+FROM DNAS WHERE dna @> :'gin_qkmer'::qkmer;
+SET enable_seqscan = off;
+EXPLAIN ANALYZE SELECT count(*) FROM DNAS WHERE dna @> :'gin_kmer'::kmer;
+SELECT count(*) AS "Amount that contains the kmer using INDEX SCAN"
+FROM DNAS WHERE dna @> :'gin_kmer'::kmer;
+SELECT count(*) AS "Amount that contains the DNA using INDEX SCAN"
+FROM DNAS WHERE dna @> :'gin_dna'::DNA;
+SELECT count(*) AS "Amount that contains the qkmer using INDEX SCAN"
+FROM DNAS WHERE dna @> :'gin_qkmer'::qkmer;
+
+DROP INDEX dna_idx;
+CREATE INDEX dna_idx ON DNAS USING gin(dna gin_dna_ops (k = 8, canonical = true, w = 4));
+
+SET enable_seqscan = off;
+EXPLAIN ANALYZE SELECT count(*) FROM DNAS WHERE dna @> :'gin_dna'::DNA;
+SELECT count(*) AS "Amount that contains the kmer using INDEX SCAN (k = 8, canonical, w = 4)"
+FROM DNAS WHERE dna @> :'gin_kmer'::kmer;
+SELECT count(*) AS "Amount that contains the DNA using INDEX SCAN (k = 8, canonical, w = 4)"
+FROM DNAS WHERE dna @> :'gin_dna'::DNA;
+SELECT count(*) AS "Amount that contains the qkmer using INDEX SCAN (k = 8, canonical, w = 4)"
+FROM DNAS WHERE dna @> :'gin_qkmer'::qkmer;
+SET enable_seqscan = on;
+
+
+-- Test the edit distance and the approximate search (expected results in the column names)
+SELECT edit_distance('ACGTACGT', 'ACGTACGT') AS "Identical sequences (0)",
+       edit_distance('ACGTACGT', 'ACGACGT') AS "One deletion (1)",
+       edit_distance('ACGTACGT', 'ACGTTACGT') AS "One insertion (1)",
+       edit_distance('AAAAAAAA', 'CCCCCCCC', 3) AS "Bounded by 3 edits (3 + 1 = 4)";
+
+-- Patterns longer than 64 nucleotides span several bit-parallel blocks
+SELECT edit_distance(repeat('ACGT', 20)::DNA, (repeat('ACGT', 10) || 'T' || repeat('ACGT', 10))::DNA)
+    AS "80 nucleotides, one insertion (1)";
+
+SELECT end_pos AS "End position (12)", edits AS "Edits (0)"
+FROM dna_approx_find('TTTTACGTACGTTTTT', 'ACGTACGT', 0);
+
+SELECT end_pos AS "End position (82)", edits AS "Edits (1)"
+FROM dna_approx_find(('TT' || repeat('ACGT', 10) || 'ACGA' || repeat('ACGT', 9) || 'TT')::DNA,
+                     repeat('ACGT', 20)::DNA, 1);
+
+
+-- Test the kmer spectra (expected results in the column names), the results going through text
+SELECT jaccard('{AC,CG}'::kmer_spectrum, '{CG,GT}') AS "Jaccard (0.333...)",
+       ('{AC,CG}'::kmer_spectrum | '{CG,GT}')::text::kmer_spectrum::text AS "Union ({AC,CG,GT})",
+       ('{AC,CG}'::kmer_spectrum & '{CG,GT}')::text::kmer_spectrum::text AS "Intersection ({CG})",
+       ('{AC,CG}'::kmer_spectrum - '{CG,GT}')::text::kmer_spectrum::text AS "Difference ({AC})";
+
+-- Test the Bloom filters: the first kmer of a sequence is always found (no false negatives)
+SELECT bool_and(bloom(dna, 21, 8 * length(dna)) @> kmer_at(dna, 1, 21)) AS "First kmer found in the Bloom filter (t)"
+FROM DNAS
+WHERE id <= 1000 AND length(dna) >= 21;
+
+-- Test the sketches: the aggregate over one row is the sketch of that row
+SELECT (SELECT sketch_agg(dna, 21, 1000) FROM DNAS WHERE id = 1)::text
+     = (SELECT sketch(dna, 21, 1000) FROM DNAS WHERE id = 1)::text AS "sketch_agg of one row equals sketch (t)";
+
+-- Test the GiST index on the sketches: nearest sketches using index scan vs seq scan
+CREATE TABLE samples AS SELECT id AS sample, sketch(dna, 21, 100) AS sk FROM DNAS WHERE id <= 2000;
+SELECT sk AS gist_query FROM samples WHERE sample = 1 \gset
+
+SET enable_seqscan = on;
+SELECT array_agg(distance)::text AS seq_distances
+FROM (SELECT sk <-> :'gist_query' AS distance FROM samples ORDER BY sk <-> :'gist_query' LIMIT 10) AS nearest \gset
+
+CREATE INDEX samples_idx ON samples USING gist(sk);
+
+SET enable_seqscan = off;
+EXPLAIN (ANALYZE, BUFFERS) SELECT sample FROM samples ORDER BY sk <-> :'gist_query' LIMIT 10;
+SELECT array_agg(distance)::text = :'seq_distances' AS "Same nearest distances using INDEX SCAN and SEQ SCAN (t)"
+FROM (SELECT sk <-> :'gist_query' AS distance FROM samples ORDER BY sk <-> :'gist_query' LIMIT 10) AS nearest;
+SET enable_seqscan = on;
@@ -0,0 +1,272 @@
+#include "bloom.h"
+
+/**
+ * @brief Creates an empty Bloom filter.
+ *
+ * @param k The length of the K-mers.
+ * @param nb_hashes The number of bits set per K-mer.
+ * @param nb_bytes The number of bytes of the filter.
+ * @return The Bloom filter.
+ */
+static KmerBloom* make_bloom(uint8_t k, uint8_t nb_hashes, Size nb_bytes) {
+    KmerBloom* bloom = palloc0(BLOOM_HEADER_SIZE + nb_bytes);
+    SET_VARSIZE(bloom, BLOOM_HEADER_SIZE + nb_bytes);
+    bloom->k = k;
+    bloom->nb_hashes = nb_hashes;
+    return bloom;
+}
+
+/**
+ * @brief Checks if a Bloom filter may contain a K-mer.
+ *
+ * @param bloom The Bloom filter.
+ * @param nb_bits The number of bits of the filter.
+ * @param hash The hash of the K-mer.
+ * @return False if the K-mer is not in the filter, true if it may be.
+ */
+static inline bool probe_bloom(const KmerBloom* bloom, uint64_t nb_bits, uint64_t hash) {
+    for (uint8_t i = 0; i < bloom->nb_hashes; i++) {
+        uint64_t bit = get_bloom_bit(hash, i, nb_bits);
+        if (!(bloom->bits[bit / 8] & (1 << (bit % 8)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Checks the parameters of a Bloom filter read by the input and receive functions.
+ *
+ * @param k The length of the K-mers.
+ * @param nb_hashes The number of bits set per K-mer.
+ * @param nb_bits The number of bits of the filter.
+ * @param sqlerrcode The error code to report.
+ */
+static void check_bloom_parameters(uint32_t k, uint32_t nb_hashes, uint64_t nb_bits, int sqlerrcode) {
+    if (k < 1 || k > KMER_MAX_LENGTH || nb_hashes < 1 || nb_hashes > BLOOM_MAX_HASHES
+        || nb_bits < 8 || nb_bits > BLOOM_MAX_BITS || nb_bits % 8 != 0) {
+        ereport(ERROR, (errcode(sqlerrcode),
+            errmsg("invalid kmer_bloom parameters")));
+    }
+}
+
+/**
+ * @brief Checks the K-mers of an array against a Bloom filter.
+ *
+ * @param bloom The Bloom filter.
+ * @param array The array of K-mers (NULL elements are ignored).
+ * @param all Whether all the K-mers must be in the filter, rather than any of them.
+ * @return Whether all (or any of) the K-mers may be in the filter.
+ */
+static bool probe_bloom_array(const KmerBloom* bloom, ArrayType* array, bool all) {
+    uint64_t nb_bits = get_bloom_nb_bits(bloom);
+    int16 typlen;
+    bool typbyval;
+    char typalign;
+    Datum* elements;
+    bool* nulls;
+    int nb_elements;
+
+    get_typlenbyvalalign(ARR_ELEMTYPE(array), &typlen, &typbyval, &typalign);
+    deconstruct_array(array, ARR_ELEMTYPE(array), typlen, typbyval, typalign, &elements, &nulls, &nb_elements);
+    for (int i = 0; i < nb_elements; i++) {
+        if (nulls[i]) {
+            continue;
+        }
+        Kmer kmer = DatumGetKmer(elements[i]);
+        bool found = kmer.k == bloom->k && probe_bloom(bloom, nb_bits, murmurhash64(kmer.value));
+        if (found != all) {
+            return found;
+        }
+    }
+    return all;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Postgres input function for Bloom filter.
+ *
+ * @param str The input string, e.g. 'k=21 h=3 \x0f00...' (the bits in hexadecimal).
+ * @return The Bloom filter created from the input string.
+ */
+PG_FUNCTION_INFO_V1(bloom_in);
+Datum bloom_in(PG_FUNCTION_ARGS) {
+    char* str = PG_GETARG_CSTRING(0);
+    unsigned int k, nb_hashes;
+    int offset = 0;
+    if (sscanf(str, "k=%u h=%u \\x%n", &k, &nb_hashes, &offset) != 2 || offset == 0) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+            errmsg("invalid input syntax for type kmer_bloom: \"%s\"", str)));
+    }
+    size_t nb_digits = strlen(str + offset);
+    check_bloom_parameters(k, nb_hashes, (uint64_t) nb_digits * 4, ERRCODE_INVALID_TEXT_REPRESENTATION);
+    KmerBloom* bloom = make_bloom(k, nb_hashes, nb_digits / 2);
+    hex_decode(str + offset, nb_digits, (char*) bloom->bits);
+    PG_RETURN_POINTER(bloom);
+}
+
+/**
+ * @brief Postgres output function for Bloom filter.
+ *
+ * @param bloom The Bloom filter.
+ * @return The string representation of the Bloom filter.
+ */
+PG_FUNCTION_INFO_V1(bloom_out);
+Datum bloom_out(PG_FUNCTION_ARGS) {
+    KmerBloom* bloom = PG_GETARG_KMER_BLOOM_P(0);
+    Size nb_bytes = VARSIZE(bloom) - BLOOM_HEADER_SIZE;
+    StringInfoData str;
+    initStringInfo(&str);
+    appendStringInfo(&str, "k=%u h=%u \\x", bloom->k, bloom->nb_hashes);
+    enlargeStringInfo(&str, nb_bytes * 2);
+    str.len += hex_encode((const char*) bloom->bits, nb_bytes, str.data + str.len);
+    str.data[str.len] = '\0';
+    PG_FREE_IF_COPY(bloom, 0);
+    PG_RETURN_CSTRING(str.data);
+}
+
+/*
+ * Binary format of Bloom filter (used by bloom_send and bloom_recv):
+ *   int8    length k of the K-mers (1-31)
+ *   int8    number of bits set per K-mer (1-BLOOM_MAX_HASHES)
+ *   int32   number of bytes n of the filter
+ *   n bytes the bits of the filter
+ */
+
+/**
+ * @brief Postgres receive function for Bloom filter.
+ *
+ * @param buf The binary representation of the Bloom filter.
+ * @return The Bloom filter created from the binary representation.
+ */
+PG_FUNCTION_INFO_V1(bloom_recv);
+Datum bloom_recv(PG_FUNCTION_ARGS) {
+    StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
+    uint8_t k = pq_getmsgbyte(buf);
+    uint8_t nb_hashes = pq_getmsgbyte(buf);
+    uint32_t nb_bytes = pq_getmsgint(buf, 4);
+    check_bloom_parameters(k, nb_hashes, (uint64_t) nb_bytes * 8, ERRCODE_INVALID_BINARY_REPRESENTATION);
+    if (nb_bytes > (uint32_t) (buf->len - buf->cursor)) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+            errmsg("insufficient data left in message")));
+    }
+    KmerBloom* bloom = make_bloom(k, nb_hashes, nb_bytes);
+    pq_copymsgbytes(buf, (char*) bloom->bits, nb_bytes);
+    PG_RETURN_POINTER(bloom);
+}
+
+/**
+ * @brief Postgres send function for Bloom filter.
+ *
+ * @param bloom The Bloom filter.
+ * @return The binary representation of the Bloom filter.
+ */
+PG_FUNCTION_INFO_V1(bloom_send);
+Datum bloom_send(PG_FUNCTION_ARGS) {
+    KmerBloom* bloom = PG_GETARG_KMER_BLOOM_P(0);
+    Size nb_bytes = VARSIZE(bloom) - BLOOM_HEADER_SIZE;
+    StringInfoData buf;
+    pq_begintypsend(&buf);
+    pq_sendint8(&buf, bloom->k);
+    pq_sendint8(&buf, bloom->nb_hashes);
+    pq_sendint32(&buf, nb_bytes);
+    pq_sendbytes(&buf, (const char*) bloom->bits, nb_bytes);
+    PG_FREE_IF_COPY(bloom, 0);
+    PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+/**
+ * @brief Builds the Bloom filter of the K-mers of a DNA sequence.
+ * The K-mers overlapping an IUPAC ambiguity code are skipped.
+ *
+ * The number of bits set per K-mer is the one minimizing the false positive rate, (bits / n) * ln 2,
+ * n being the number of K-mers of the sequence.
+ *
+ * @param dna The DNA object.
+ * @param kmer_length The length of the K-mers.
+ * @param nb_bits The number of bits of the filter, rounded up to a multiple of 8.
+ * @return The Bloom filter.
+ */
+PG_FUNCTION_INFO_V1(dna_bloom);
+Datum dna_bloom(PG_FUNCTION_ARGS) {
+    DNA* dna = PG_GETARG_BYTEA_P(0);
+    uint8_t kmer_length = check_kmer_length(PG_GETARG_INT32(1));
+    int32 requested_bits = PG_GETARG_INT32(2);
+    KmerGeneratorState generator;
+    uint64_t value;
+
+    if (requested_bits < 1) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("the number of bits of a kmer_bloom must be positive")));
+    }
+    Size nb_bytes = ((Size) requested_bits + 7) / 8;
+    uint64_t nb_bits = (uint64_t) nb_bytes * 8;
+
+    init_kmer_generator_state(&generator, dna, kmer_length, false);
+    double nb_kmers = generator.length >= kmer_length ? generator.length - kmer_length + 1 : 1;
+    double optimal_hashes = round((double) nb_bits / nb_kmers * M_LN2);
+    uint8_t nb_hashes = (uint8_t) Max(1, Min(optimal_hashes, BLOOM_MAX_HASHES));
+
+    KmerBloom* bloom = make_bloom(kmer_length, nb_hashes, nb_bytes);
+    while (next_kmer_value(&generator, &value)) {
+        uint64_t hash = murmurhash64(value);
+        for (uint8_t i = 0; i < nb_hashes; i++) {
+            uint64_t bit = get_bloom_bit(hash, i, nb_bits);
+            bloom->bits[bit / 8] |= 1 << (bit % 8);
+        }
+    }
+    PG_FREE_IF_COPY(dna, 0);
+    PG_RETURN_POINTER(bloom);
+}
+
+/**
+ * @brief Checks if a Bloom filter may contain a K-mer.
+ *
+ * @param bloom The Bloom filter.
+ * @param kmer The K-mer.
+ * @return False if the K-mer is not in the filter, true if it may be.
+ */
+PG_FUNCTION_INFO_V1(bloom_contains);
+Datum bloom_contains(PG_FUNCTION_ARGS) {
+    KmerBloom* bloom = PG_GETARG_KMER_BLOOM_P(0);
+    Kmer kmer = PG_GETARG_KMER(1);
+    bool result = kmer.k == bloom->k
+        && probe_bloom(bloom, get_bloom_nb_bits(bloom), murmurhash64(kmer.value));
+    PG_FREE_IF_COPY(bloom, 0);
+    PG_RETURN_BOOL(result);
+}
+
+/**
+ * @brief Checks if a Bloom filter may contain any of the K-mers of an array.
+ *
+ * @param bloom The Bloom filter.
+ * @param kmers The array of K-mers.
+ * @return False if none of the K-mers is in the filter, true if any of them may be.
+ */
+PG_FUNCTION_INFO_V1(bloom_contains_any);
+Datum bloom_contains_any(PG_FUNCTION_ARGS) {
+    KmerBloom* bloom = PG_GETARG_KMER_BLOOM_P(0);
+    ArrayType* kmers = PG_GETARG_ARRAYTYPE_P(1);
+    bool result = probe_bloom_array(bloom, kmers, false);
+    PG_FREE_IF_COPY(bloom, 0);
+    PG_FREE_IF_COPY(kmers, 1);
+    PG_RETURN_BOOL(result);
+}
+
+/**
+ * @brief Checks if a Bloom filter may contain all the K-mers of an array.
+ *
+ * @param bloom The Bloom filter.
+ * @param kmers The array of K-mers.
+ * @return False if any of the K-mers is not in the filter, true if all of them may be.
+ */
+PG_FUNCTION_INFO_V1(bloom_contains_all);
+Datum bloom_contains_all(PG_FUNCTION_ARGS) {
+    KmerBloom* bloom = PG_GETARG_KMER_BLOOM_P(0);
+    ArrayType* kmers = PG_GETARG_ARRAYTYPE_P(1);
+    bool result = probe_bloom_array(bloom, kmers, true);
+    PG_FREE_IF_COPY(bloom, 0);
+    PG_FREE_IF_COPY(kmers, 1);
+    PG_RETURN_BOOL(result);
+}
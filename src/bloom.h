@@ -0,0 +1,58 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include "dna.h"
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "lib/stringinfo.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+
+#define BLOOM_MAX_HASHES 16
+#define BLOOM_MAX_BITS ((int64) 1 << 32)
+
+/**
+ * @typedef KmerBloom
+ * @brief Bloom filter of the K-mers of a DNA sequence.
+ *
+ * A K-mer sets nb_hashes bits, derived from the murmurhash64 of its value by double hashing.
+ * Membership tests have no false negatives, and false positives with a rate depending on the
+ * number of bits per K-mer.
+ */
+typedef struct KmerBloom {
+    int32 vl_len_;          /**< Varlena header (do not touch directly) */
+    uint8_t k;              /**< Length of the K-mers */
+    uint8_t nb_hashes;      /**< Number of bits set per K-mer */
+    uint8_t bits[FLEXIBLE_ARRAY_MEMBER];    /**< The bits of the filter */
+} KmerBloom;
+
+#define BLOOM_HEADER_SIZE offsetof(KmerBloom, bits)
+#define DatumGetKmerBloomP(X) ((KmerBloom*) PG_DETOAST_DATUM(X))
+#define PG_GETARG_KMER_BLOOM_P(n) DatumGetKmerBloomP(PG_GETARG_DATUM(n))
+
+/**
+ * @brief Gets the number of bits of a Bloom filter.
+ *
+ * @param bloom The Bloom filter.
+ * @return The number of bits.
+ */
+static inline uint64_t get_bloom_nb_bits(const KmerBloom* bloom) {
+    return (uint64_t) (VARSIZE(bloom) - BLOOM_HEADER_SIZE) * 8;
+}
+
+/**
+ * @brief Gets the i-th bit of a K-mer in a Bloom filter, from the hash of the K-mer.
+ *
+ * @param hash The hash of the K-mer.
+ * @param i The index of the bit.
+ * @param nb_bits The number of bits of the filter.
+ * @return The position of the bit.
+ */
+static inline uint64_t get_bloom_bit(uint64_t hash, uint8_t i, uint64_t nb_bits) {
+    uint32_t h = (uint32_t) hash + i * ((uint32_t) (hash >> 32) | 1);
+    return ((uint64_t) h * nb_bits) >> 32;                     // maps h to [0, nb_bits) without a division
+}
+
+#endif
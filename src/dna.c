@@ -1,56 +1,219 @@
 #include "dna.h"
+#include "qkmer.h"
+
+
 
 /**
- * @brief Structure used to store the state of the K-mer generator.
+ * @brief Writes the header of a DNA object: the length of the last byte of the DNA sequence (which
+ * might not hold 4 nucleotides) and the exception runs.
+ * 
+ * @param header The data of the DNA object (after the varlena header).
+ * @param length The amount of nucleotides of the DNA sequence.
+ * @param exceptions The exception runs of the DNA sequence.
+ * @param nb_exceptions The number of exception runs.
  */
-typedef struct KmerGeneratorState {
-    uint8_t kmer_length;       /**< Length of the K-mer(s) to generate */
-    uint32_t length;           /**< Total length of the DNA sequence */
-    uint8_t* byte_ptr;         /**< Pointer to a byte in the byte array representing the DNA sequence */
-    uint8_t nucleotide_ctr;    /**< Counter for nucleotides in the current byte (0-3) */
-} KmerGeneratorState;
+static void store_dna_header(uint8_t* header, uint32_t length, const DnaException* exceptions, uint32_t nb_exceptions) {
+    *header = length % 4 == 0 ? 0b00000100 : length % 4;
+    if (nb_exceptions == 0) {
+        return;
+    }
+    *header |= DNA_HAS_EXCEPTIONS;
+    memcpy(header + 1, &nb_exceptions, sizeof(nb_exceptions));
+    uint8_t* run = header + DNA_EXCEPTIONS_OFFSET;
+    for (uint32_t i = 0; i < nb_exceptions; i++, run += DNA_EXCEPTION_SIZE) {
+        memcpy(run, &exceptions[i].start, sizeof(uint32_t));
+        memcpy(run + sizeof(uint32_t), &exceptions[i].length, sizeof(uint32_t));
+        run[2 * sizeof(uint32_t)] = (uint8_t) exceptions[i].code;
+    }
+}
 
+/**
+ * @brief Creates a DNA object from packed nucleotides.
+ * The nucleotides covered by the exception runs are reset to A.
+ * 
+ * @param src The packed nucleotides, whose first byte holds the first nucleotide of the sequence.
+ * @param offset The position of the first nucleotide in the first byte of src (0-3).
+ * @param length The length of the DNA sequence.
+ * @param exceptions The exception runs of the DNA sequence, relative to its first nucleotide.
+ * @param nb_exceptions The number of exception runs.
+ * @return A pointer to the created DNA object.
+ */
+static DNA* make_dna_from_packed(const uint8_t* src, uint8_t offset, uint32_t length,
+                                 const DnaException* exceptions, uint32_t nb_exceptions) {
+    Size header_size = get_dna_header_size(nb_exceptions);
+    Size size = VARHDRSZ + header_size + ((Size) length + 3) / 4;
+    if (size > MaxAllocSize) {
+        ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+            errmsg("DNA sequence of %u nucleotides is too long", length)));
+    }
+    DNA* dna = palloc(size);
+    SET_VARSIZE(dna, size);
+    uint8_t* header = (uint8_t*) VARDATA(dna);
+    uint8_t* nucleotides = header + header_size;
+
+    store_dna_header(header, length, exceptions, nb_exceptions);
+    copy_nucleotides(src, offset, length, nucleotides);
+    for (uint32_t i = 0; i < nb_exceptions; i++) {
+        for (uint32_t j = exceptions[i].start; j < exceptions[i].start + exceptions[i].length; j++) {
+            nucleotides[j / 4] &= ~(0b11 << (6 - (j % 4) * 2));
+        }
+    }
+    return dna;
+}
 
 /**
- * @brief Adds the length of the last byte of the DNA sequence to the beginning of the DNA object.
- * This is necessary because the last byte might not hold 4 nucleotides. 
+ * @brief Adds an exception run at the end of a DNA builder, merging it with the previous run when
+ * they are adjacent and hold the same code.
  * 
- * @param dna The DNA object.
- * @param length The amount of nucleotides of the DNA sequence.
+ * @param builder The DNA builder.
+ * @param start The position of the first nucleotide of the run.
+ * @param length The number of nucleotides of the run.
+ * @param code The upper case IUPAC ambiguity code.
  */
-static void store_last_byte_length(DNA* dna, uint32_t length) {
-    uint8_t* data_ptr = (uint8_t*) VARDATA(dna); 
-    *data_ptr = length % 4 == 0 ? 0b00000100 : length % 4;
+static void add_dna_builder_exception(DnaBuilder* builder, uint32_t start, uint32_t length, char code) {
+    if (builder->nb_exceptions > 0) {
+        DnaException* last = &builder->exceptions[builder->nb_exceptions - 1];
+        if (last->start + last->length == start && last->code == code) {
+            last->length += length;
+            return;
+        }
+    }
+    if (builder->nb_exceptions == builder->max_exceptions) {
+        builder->max_exceptions *= 2;
+        builder->exceptions = repalloc(builder->exceptions, builder->max_exceptions * sizeof(DnaException));
+    }
+    DnaException* exception = &builder->exceptions[builder->nb_exceptions++];
+    exception->start = start;
+    exception->length = length;
+    exception->code = code;
+}
+
+/**
+ * @brief Initializes a DNA builder, in the current memory context.
+ * 
+ * @param builder The DNA builder.
+ */
+void init_dna_builder(DnaBuilder* builder) {
+    builder->max_bytes = 64;
+    builder->packed = palloc0(builder->max_bytes);
+    builder->length = 0;
+    builder->max_exceptions = 8;
+    builder->exceptions = palloc(builder->max_exceptions * sizeof(DnaException));
+    builder->nb_exceptions = 0;
+}
+
+/**
+ * @brief Appends nucleotides to a DNA builder. Runs of IUPAC ambiguity codes become exception runs.
+ * 
+ * @param builder The DNA builder.
+ * @param str The nucleotides to append.
+ * @param length The number of nucleotides to append.
+ */
+void append_to_dna_builder(DnaBuilder* builder, const char* str, uint32_t length) {
+    if ((uint64_t) builder->length + length > DNA_MAX_LENGTH) {
+        ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+            errmsg("DNA sequence is too long"),
+            errdetail("DNA sequences are limited to %u nucleotides.", (uint32_t) DNA_MAX_LENGTH)));
+    }
+    Size needed = ((Size) builder->length + length + 3) / 4;
+    if (needed > builder->max_bytes) {
+        Size max_bytes = Min(Max(needed, builder->max_bytes * 2), MaxAllocSize);
+        builder->packed = repalloc(builder->packed, max_bytes);
+        memset(builder->packed + builder->max_bytes, 0, max_bytes - builder->max_bytes);
+        builder->max_bytes = max_bytes;
+    }
+
+    uint32_t done = 0;
+    for (;;) {
+        done += pack_nucleotides(str + done, length - done, builder->packed, builder->length + done);
+        if (done == length) {
+            break;
+        }
+        char code = fold_ambiguity_code(str[done]);
+        if (code == 0) {
+            ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+                errmsg("invalid nucleotide at position %u", builder->length + done + 1)));
+        }
+        uint32_t start = done;
+        while (done < length && fold_ambiguity_code(str[done]) == code) {
+            done++;
+        }
+        add_dna_builder_exception(builder, builder->length + start, done - start, code);
+    }
+    builder->length += length;
+}
+
+/**
+ * @brief Creates a DNA object from the nucleotides appended to a DNA builder.
+ * 
+ * @param builder The DNA builder, holding at least one nucleotide.
+ * @return A pointer to the created DNA object.
+ */
+DNA* build_dna(const DnaBuilder* builder) {
+    return make_dna_from_packed(builder->packed, 0, builder->length, builder->exceptions, builder->nb_exceptions);
+}
+
+/**
+ * @brief Creates a DNA object holding the nucleotides of a K-mer.
+ * 
+ * @param kmer The K-mer.
+ * @return A pointer to the created DNA object.
+ */
+DNA* make_dna_from_kmer(const Kmer* kmer) {
+    uint8_t packed[sizeof(uint64_t)];
+    uint64_t value = kmer->value << (64 - 2 * kmer->k);               // first nucleotide in the most significant bits
+    for (uint8_t i = 0; i < sizeof(packed); i++) {
+        packed[i] = (uint8_t) (value >> (56 - 8 * i));
+    }
+    return make_dna_from_packed(packed, 0, kmer->k, NULL, 0);
+}
+
+/**
+ * @brief Empties a DNA builder, keeping its buffers.
+ * 
+ * @param builder The DNA builder.
+ */
+void reset_dna_builder(DnaBuilder* builder) {
+    memset(builder->packed, 0, ((Size) builder->length + 3) / 4);
+    builder->length = 0;
+    builder->nb_exceptions = 0;
+}
+
+/**
+ * @brief Releases the buffers of a DNA builder.
+ * 
+ * @param builder The DNA builder.
+ */
+void free_dna_builder(DnaBuilder* builder) {
+    pfree(builder->packed);
+    pfree(builder->exceptions);
 }
 
 /**
  * @brief Creates a DNA object from a string.
+ * Sequences made only of ACGT are packed in a single pass, the others are handed over to
+ * a DNA builder at their first ambiguity code.
  * 
  * @param str The string representing the DNA sequence.
  * @param length The length of the DNA sequence.
  * @return A pointer to the created DNA object.
  */
 static DNA* make_dna(const char* str, uint32_t length) {
-    DNA* dna = palloc0(VARHDRSZ + ceil((double) length / 4) + 1);     // + 1 for last byte length
-    SET_VARSIZE(dna, VARHDRSZ + ceil((double) length / 4) + 1);
+    uint32_t size = VARHDRSZ + (length + 3) / 4 + 1;                 // + 1 for last byte length
+    DNA* dna = palloc0(size);
+    SET_VARSIZE(dna, size);
     uint8_t* data_ptr = (uint8_t*) VARDATA(dna);
 
-    store_last_byte_length(dna, length);
+    store_dna_header(data_ptr, length, NULL, 0);
     data_ptr++;                                                       // skip first byte for last byte length
 
-    for (uint32_t i = 0; i < length; i += 4) {
-        uint8_t current_byte = 0b00000000;                            // initialize byte with 0
-
-        for (char j = 0; j < 4; j++) {                                // read 4 nucleotides at a time
-            char c = str[i + j];
-            if (i + j >= length) {                                    // shift byte to the left by 2 bits for each missing nucleotide
-                current_byte <<= 2;                                   // This is necessary because the last byte might not hold 4 nucleotides  
-                continue;
-            }
-            add_nucleotide_to_uint(current_byte, c);
-        }
-        *data_ptr = current_byte;
-        data_ptr++;
+    if (pack_nucleotides(str, length, data_ptr, 0) < length) {
+        DnaBuilder builder;
+        init_dna_builder(&builder);
+        append_to_dna_builder(&builder, str, length);
+        pfree(dna);
+        dna = build_dna(&builder);
+        free_dna_builder(&builder);
     }
     return dna; 
 }
@@ -70,6 +233,26 @@ static DNA* dna_parse(const char* str) {
     return make_dna(str, length);
 }
 
+/**
+ * @brief Decodes a DNA sequence into characters, including its ambiguity codes.
+ * No terminating null character is written.
+ * 
+ * @param dna The DNA object.
+ * @param length The length of the DNA sequence.
+ * @param out The output buffer, which must hold length characters.
+ */
+static void decode_dna(DNA* dna, uint32_t length, char* out) {
+    const uint8_t* header = (uint8_t*) VARDATA(dna);
+    uint32_t nb_exceptions = get_dna_nb_exceptions(header);
+    DnaException exception;
+
+    unpack_nucleotides(get_dna_nucleotides(dna), length, out);
+    for (uint32_t i = 0; i < nb_exceptions; i++) {
+        get_dna_exception(header, i, &exception);
+        memset(out + exception.start, exception.code, exception.length);
+    }
+}
+
 /**
  * @brief Converts a DNA object to a string representation.
  * 
@@ -77,87 +260,651 @@ static DNA* dna_parse(const char* str) {
  * @return A string representation of the DNA sequence.
  */
 static char* dna_to_string(DNA* dna) {
-    // length represents the max amount of nucleotides in the DNA sequence, but the last byte might not be full
-    uint32_t length = (VARSIZE(dna) - VARHDRSZ - 1) * 4;                               // - 1 for last byte length
+    uint32_t length = get_dna_sequence_length(dna);
+    char* str = palloc(length + 1);
+    decode_dna(dna, length, str);
+    str[length] = '\0';
+    return str;
+}
 
-    uint8_t* data_ptr = (uint8_t*) VARDATA(dna);
-    uint8_t last_byte_length = *data_ptr++;
-    char* str = palloc0(length + 1 - (4 - last_byte_length));
-
-    for (uint32_t i = 0; i < length; i += 4) {
-        uint8_t current_byte = *data_ptr;
-        data_ptr++;
-        uint8_t number_of_nucleotides_to_read = i + 4 == length ? last_byte_length : 4; // read less nucleotides for the last byte
-
-        for (char j = 0; j < number_of_nucleotides_to_read; j++) {
-            uint8_t nucleotide = (current_byte >> (6 - j * 2)) & 0b11;                  // shift to the right by 6 bits for the first nucleotide, 4 bits for the second, etc.
-            if (i + j >= length) {                                                      // stop reading nucleotides if we reached the end of the DNA sequence
-                break;
+/**
+ * @brief Gets the length of a DNA sequence from its datum.
+ * Only the first bytes of the value are detoasted, the rest of the length comes from the raw size.
+ * 
+ * @param datum The DNA datum, possibly toasted.
+ * @return The length of the DNA sequence.
+ */
+static uint32_t get_dna_datum_sequence_length(Datum datum) {
+    DNA* header = (DNA*) PG_DETOAST_DATUM_SLICE(datum, 0, DNA_EXCEPTIONS_OFFSET);   // flags + number of runs
+    const uint8_t* data = (uint8_t*) VARDATA(header);
+    Size header_size = get_dna_header_size(get_dna_nb_exceptions(data));
+    uint32_t length = compute_dna_sequence_length(data, toast_raw_datum_size(datum) - VARHDRSZ - header_size);
+    pfree(header);
+    return length;
+}
+
+/**
+ * @brief Gets the header of a DNA sequence (flags and exception runs) from its datum.
+ * Only the header is detoasted.
+ * 
+ * @param datum The DNA datum, possibly toasted.
+ * @param length The length of the DNA sequence.
+ * @return A DNA object holding at least the header.
+ */
+static DNA* get_dna_datum_header(Datum datum, uint32_t* length) {
+    DNA* header = (DNA*) PG_DETOAST_DATUM_SLICE(datum, 0, DNA_EXCEPTIONS_OFFSET);
+    uint32_t nb_exceptions = get_dna_nb_exceptions((uint8_t*) VARDATA(header));
+    Size header_size = get_dna_header_size(nb_exceptions);
+    if (nb_exceptions > 0) {
+        pfree(header);
+        header = (DNA*) PG_DETOAST_DATUM_SLICE(datum, 0, header_size);
+    }
+    *length = compute_dna_sequence_length((uint8_t*) VARDATA(header), toast_raw_datum_size(datum) - VARHDRSZ - header_size);
+    return header;
+}
+
+/**
+ * @brief Gets the exception runs of a DNA sequence overlapping a range, clipped to the range and
+ * relative to its first nucleotide.
+ * 
+ * @param header The data of the DNA object (after the varlena header).
+ * @param first The (0-based) position of the first nucleotide of the range.
+ * @param count The number of nucleotides of the range.
+ * @param nb_found The number of runs found.
+ * @return The runs found (palloc'd), NULL if there is none.
+ */
+static DnaException* get_dna_exceptions_in_range(const uint8_t* header, uint32_t first, uint32_t count, uint32_t* nb_found) {
+    uint32_t nb_exceptions = get_dna_nb_exceptions(header);
+    uint32_t low = 0;
+    uint32_t high = nb_exceptions;
+    DnaException exception;
+
+    while (low < high) {                                            // first run ending after first
+        uint32_t middle = low + (high - low) / 2;
+        get_dna_exception(header, middle, &exception);
+        if (exception.start + exception.length <= first) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    DnaException* found = NULL;
+    *nb_found = 0;
+    for (uint32_t i = low; i < nb_exceptions; i++) {
+        get_dna_exception(header, i, &exception);
+        if (exception.start >= first + count) {
+            break;
+        }
+        if (found == NULL) {
+            found = palloc((nb_exceptions - low) * sizeof(DnaException));
+        }
+        uint32_t start = Max(exception.start, first);
+        uint32_t end = Min(exception.start + exception.length, first + count);
+        found[*nb_found].start = start - first;
+        found[*nb_found].length = end - start;
+        found[*nb_found].code = exception.code;
+        (*nb_found)++;
+    }
+    return found;
+}
+
+/**
+ * @brief Checks that a range of nucleotides lies within a DNA sequence.
+ * 
+ * @param position The (1-based) position of the first nucleotide of the range.
+ * @param count The number of nucleotides of the range.
+ * @param length The length of the DNA sequence.
+ */
+static void check_dna_range(int64 position, int64 count, uint32_t length) {
+    if (position < 1 || position + count - 1 > length) {
+        ereport(ERROR, (errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+            errmsg("position %lld is out of range for a DNA sequence of length %u", (long long) position, length)));
+    }
+}
+
+/**
+ * @brief Checks that a K-mer length is valid and converts it.
+ * 
+ * @param kmer_length The requested K-mer length.
+ * @return The K-mer length.
+ */
+uint8_t check_kmer_length(int32 kmer_length) {
+    if (kmer_length < 1 || kmer_length > KMER_MAX_LENGTH) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("kmer length should be between 1 and %d nucleotides", KMER_MAX_LENGTH)));
+    }
+    return (uint8_t) kmer_length;
+}
+
+/**
+ * @brief Reads nucleotides of a DNA sequence from its packed bytes.
+ *
+ * @param nucleotides The packed nucleotides of the DNA sequence.
+ * @param position The (0-based) position of the first nucleotide to read.
+ * @param count The number of nucleotides to read (at most 28, so that they fit in 64 bits with the
+ * nucleotides preceding them in their first byte).
+ * @return The nucleotides read, 2 bits each, the last one in the least significant bits.
+ */
+static inline uint64_t read_packed_nucleotides(const uint8_t* nucleotides, uint32_t position, uint8_t count) {
+    uint8_t offset = (position % 4) * 2;
+    uint8_t nb_bytes = (offset + 2 * count + 7) / 8;
+    uint64_t bits = 0;
+    for (uint8_t i = 0; i < nb_bytes; i++) {
+        bits = (bits << 8) | nucleotides[position / 4 + i];
+    }
+    return (bits >> (nb_bytes * 8 - offset - 2 * count)) & ((1ULL << (2 * count)) - 1);
+}
+
+/**
+ * @brief Checks that the exception runs of a DNA sequence over a range are those of a query.
+ * As the runs are maximal, the nucleotides of the range and of the query hold the same IUPAC
+ * ambiguity codes at the same positions exactly when the clipped runs equal the runs of the query.
+ *
+ * @param header The data of the DNA object (after the varlena header).
+ * @param next_exception The index of the first run of the DNA sequence ending after the range start.
+ * @param start The (0-based) position of the first nucleotide of the range.
+ * @param query_header The data of the query DNA object, NULL for a K-mer (which has no runs).
+ * @param query_length The length of the query, which is the length of the range.
+ * @return True if the runs match.
+ */
+static bool match_dna_exceptions(const uint8_t* header, uint32_t next_exception, uint32_t start,
+                                 const uint8_t* query_header, uint32_t query_length) {
+    uint32_t nb_exceptions = get_dna_nb_exceptions(header);
+    uint32_t nb_query_exceptions = query_header == NULL ? 0 : get_dna_nb_exceptions(query_header);
+    DnaException exception;
+    DnaException query_exception;
+
+    for (uint32_t j = 0; next_exception + j < nb_exceptions; j++) {
+        get_dna_exception(header, next_exception + j, &exception);
+        if (exception.start >= start + query_length) {
+            return j == nb_query_exceptions;
+        }
+        if (j == nb_query_exceptions) {
+            return false;
+        }
+        get_dna_exception(query_header, j, &query_exception);
+        uint32_t run_start = Max(exception.start, start);
+        uint32_t run_end = Min(exception.start + exception.length, start + query_length);
+        if (run_start - start != query_exception.start || run_end - run_start != query_exception.length
+            || exception.code != query_exception.code) {
+            return false;
+        }
+    }
+    return nb_exceptions - next_exception == nb_query_exceptions;
+}
+
+/**
+ * @brief Finds the first occurrence of a K-mer, or of a DNA sequence, in a DNA sequence, directly
+ * on the packed nucleotides.
+ *
+ * The packed bytes are shifted into a 64-bit window, one byte (4 nucleotides) at a time, and the
+ * K-mer is compared with the window at the 4 sub-byte alignments with a mask. The byte shifted
+ * out of the window supplies the nucleotides missing for long K-mers at the first alignments.
+ * The exception runs are stored as A: an occurrence of a K-mer must not overlap any of them, and
+ * an occurrence of a DNA sequence must overlap the same runs as the sequence holds.
+ * For a DNA sequence, the K-mer holds its first nucleotides, and the rest of the packed nucleotides
+ * is compared 28 at a time at each occurrence of the K-mer.
+ *
+ * @param dna The DNA object.
+ * @param value The value of the K-mer.
+ * @param kmer_length The length of the K-mer.
+ * @param query The DNA sequence starting with the K-mer, NULL to search the K-mer alone.
+ * @return The (0-based) position of the first occurrence, -1 if there is none.
+ */
+static int64 find_in_dna(DNA* dna, uint64_t value, uint8_t kmer_length, DNA* query) {
+    const uint8_t* header = (uint8_t*) VARDATA(dna);
+    uint32_t nb_exceptions = get_dna_nb_exceptions(header);
+    const uint8_t* nucleotides = header + get_dna_header_size(nb_exceptions);
+    uint32_t length = get_dna_sequence_length(dna);
+    const uint8_t* query_header = query == NULL ? NULL : (uint8_t*) VARDATA(query);
+    const uint8_t* query_nucleotides = query == NULL ? NULL : get_dna_nucleotides(query);
+    uint32_t query_length = query == NULL ? kmer_length : get_dna_sequence_length(query);
+    uint64_t mask = (1ULL << (2 * kmer_length)) - 1;
+    uint64_t window = 0;
+    uint32_t next_exception = 0;
+    DnaException exception;
+
+    if (query_length > length) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < (length + 3) / 4; i++) {
+        uint64_t previous = window >> 56;
+        window = (window << 8) | nucleotides[i];
+        for (int shift = 6; shift >= 0; shift -= 2) {                  // the K-mer ends at nucleotide 4 * i + 3 - shift / 2
+            uint64_t candidate = shift == 0 ? window : (window >> shift) | (previous << (64 - shift));
+            if (likely(((candidate ^ value) & mask) != 0)) {
+                continue;
+            }
+            uint32_t end = 4 * i + 4 - shift / 2;
+            if (end < kmer_length) {
+                continue;                                               // window not full yet
+            }
+            uint32_t start = end - kmer_length;
+            if (start + query_length > length) {
+                return -1;                                              // the next occurrences end even later
+            }
+            while (next_exception < nb_exceptions) {
+                get_dna_exception(header, next_exception, &exception);
+                if (exception.start + exception.length > start) {
+                    break;
+                }
+                next_exception++;
+            }
+            if (!match_dna_exceptions(header, next_exception, start, query_header, query_length)) {
+                continue;
+            }
+            bool matches = true;
+            for (uint32_t position = kmer_length; matches && position < query_length; position += 28) {
+                uint8_t count = Min(28, query_length - position);
+                matches = read_packed_nucleotides(nucleotides, start + position, count)
+                    == read_packed_nucleotides(query_nucleotides, position, count);
+            }
+            if (matches) {
+                return start;
             }
-            str[i + j] = BINARY_TO_NUCLEOTIDE[nucleotide];
         }
     }
-    str[length] = '\0';
-    return str;
+    return -1;
 }
 
+/**
+ * @brief Structure used to store the state of a Shift-And scan of a DNA sequence for a Q-kmer.
+ *
+ * Bit i of matches is set when the last i + 1 nucleotides read match the first i + 1 positions of
+ * the Q-kmer, so a single shift and mask per nucleotide advances all the partial matches at once.
+ */
+typedef struct QkmerScanState {
+    uint64_t masks[4];         /**< For each nucleotide, bit i is set when position i of the Q-kmer allows it */
+    uint64_t matches;          /**< Partial matches ending at the last nucleotide read */
+    uint64_t match_bit;        /**< Bit of the complete matches */
+    uint8_t qkmer_length;      /**< Length of the Q-kmer */
+    uint32_t length;           /**< Total length of the DNA sequence */
+    uint32_t position;         /**< Position of the next nucleotide to read */
+    const uint8_t* nucleotides;/**< Packed nucleotides of the DNA sequence */
+    const uint8_t* header;     /**< Data of the DNA object, holding the exception runs */
+    uint32_t nb_exceptions;    /**< Number of exception runs of the DNA sequence */
+    uint32_t next_exception;   /**< Index of the next exception run */
+    uint32_t exception_start;  /**< Start of the next exception run, UINT32_MAX if there is none */
+} QkmerScanState;
+
+/**
+ * @brief Moves a Q-kmer scan to the next exception run, if any.
+ *
+ * @param state The Q-kmer scan state.
+ */
+static inline void load_next_scan_exception(QkmerScanState* state) {
+    DnaException exception;
+    if (state->next_exception < state->nb_exceptions) {
+        get_dna_exception(state->header, state->next_exception, &exception);
+        state->exception_start = exception.start;
+    } else {
+        state->exception_start = UINT32_MAX;
+    }
+}
 
 /**
- * @brief Gets the length of the DNA sequence.
+ * @brief Initializes the state for a Shift-And scan, precomputing the masks from the Q-kmer.
+ *
+ * @param state The QkmerScanState object to initialize.
+ * @param dna The DNA object.
+ * @param qkmer The Q-kmer.
+ */
+static void init_qkmer_scan_state(QkmerScanState* state, DNA* dna, const Qkmer* qkmer) {
+    memset(state->masks, 0, sizeof(state->masks));
+    for (uint8_t i = 0; i < qkmer->k; i++) {
+        uint8_t nucleotides = get_qkmer_nucleotides(qkmer, i);
+        for (uint8_t nucleotide = 0; nucleotide < 4; nucleotide++) {
+            if (nucleotides & (1 << nucleotide)) {
+                state->masks[nucleotide] |= 1ULL << i;
+            }
+        }
+    }
+    state->matches = 0;
+    state->match_bit = 1ULL << (qkmer->k - 1);
+    state->qkmer_length = qkmer->k;
+    state->length = get_dna_sequence_length(dna);
+    state->position = 0;
+    state->nucleotides = get_dna_nucleotides(dna);
+    state->header = (uint8_t*) VARDATA(dna);
+    state->nb_exceptions = get_dna_nb_exceptions(state->header);
+    state->next_exception = 0;
+    load_next_scan_exception(state);
+}
+
+/**
+ * @brief Scans the DNA sequence until the next occurrence of the Q-kmer.
+ * The occurrences overlapping an IUPAC ambiguity code of the sequence are skipped.
+ *
+ * @param state The Q-kmer scan state.
+ * @param start The (0-based) position of the first nucleotide of the occurrence.
+ * @return Whether an occurrence was found, false at the end of the DNA sequence.
+ */
+static bool next_qkmer_match(QkmerScanState* state, uint32_t* start) {
+    while (state->position < state->length) {
+        uint32_t end = Min(state->length, state->exception_start);
+        uint64_t matches = state->matches;
+        for (uint32_t position = state->position; position < end; position++) {
+            uint8_t nucleotide = (state->nucleotides[position / 4] >> (6 - (position % 4) * 2)) & 0b11;
+            matches = ((matches << 1) | 1) & state->masks[nucleotide];
+            if (unlikely(matches & state->match_bit)) {
+                state->matches = matches;
+                state->position = position + 1;
+                *start = position + 1 - state->qkmer_length;
+                return true;
+            }
+        }
+        state->position = end;
+        state->matches = 0;
+        if (end == state->exception_start) {
+            DnaException exception;
+            get_dna_exception(state->header, state->next_exception++, &exception);
+            state->position = exception.start + exception.length;
+            load_next_scan_exception(state);
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Generates all the K-mers of a DNA sequence in a single pass and stores them in the
+ * tuplestore of a materialized set-returning function.
  * 
+ * @param fcinfo The function call information.
  * @param dna The DNA object.
- * @return The length of the DNA sequence.
+ * @param kmer_length The length of the K-mers to generate.
+ * @param canonical Whether the canonical K-mers are generated.
  */
-static uint32_t get_dna_sequence_length(DNA* dna) {
-    uint32_t length_in_bytes = (VARSIZE(dna) - VARHDRSZ - 1) * 4;
-    uint8_t* data_ptr = (uint8_t*) VARDATA(dna);
-    uint8_t last_byte_length = *data_ptr;
-    return length_in_bytes - (4 - last_byte_length);
+static void materialize_kmers(FunctionCallInfo fcinfo, DNA *dna, uint8_t kmer_length, bool canonical) {
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+    KmerGeneratorState state;
+    Kmer kmer;
+    Datum value;
+    bool isnull = false;
+
+    InitMaterializedSRF(fcinfo, MAT_SRF_USE_EXPECTED_DESC);
+
+    init_kmer_generator_state(&state, dna, kmer_length, canonical);
+    kmer.k = kmer_length;
+    while (next_kmer_value(&state, &kmer.value)) {
+        value = KmerGetDatum(kmer);
+        tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, &value, &isnull);
+    }
+}
+/**
+ * @brief K-mer held by the monotone deque of a sampler.
+ */
+typedef struct SampledKmer {
+    uint64_t order;            /**< Order of the K-mer (hash of its value) */
+    uint64_t value;            /**< Value of the K-mer */
+    uint32_t position;         /**< (0-based) position of the first nucleotide of the K-mer */
+} SampledKmer;
+
+/**
+ * @brief Deque of K-mers with increasing orders, giving the minimum of a sliding window in amortized O(1).
+ * The K-mers are stored in a ring buffer holding one window, plus the K-mer pushed before the window slides.
+ */
+typedef struct MonotoneDeque {
+    SampledKmer* items;        /**< Ring buffer of K-mers */
+    uint32_t capacity;         /**< Size of the ring buffer (size of the window + 1) */
+    uint32_t head;             /**< Index of the first K-mer (the minimum of the window) */
+    uint32_t size;             /**< Number of K-mers in the deque */
+} MonotoneDeque;
+
+/**
+ * @brief Gets the order of a K-mer for sampling. A hash is used rather than the value itself, so that
+ * low-complexity K-mers (like poly-A) are not sampled more often than the others.
+ * 
+ * @param value The value of the K-mer.
+ * @return The order of the K-mer.
+ */
+static inline uint64_t get_kmer_order(uint64_t value) {
+    return murmurhash64(value);
+}
+
+/**
+ * @brief Adds a K-mer at the back of a monotone deque, dropping the K-mers with greater orders.
+ * For equal orders, the leftmost K-mer stays the minimum.
+ * 
+ * @param deque The monotone deque.
+ * @param value The value of the K-mer.
+ * @param position The position of the K-mer.
+ */
+static inline void push_monotone_deque(MonotoneDeque* deque, uint64_t value, uint32_t position) {
+    uint64_t order = get_kmer_order(value);
+    while (deque->size > 0 && deque->items[(deque->head + deque->size - 1) % deque->capacity].order > order) {
+        deque->size--;
+    }
+    SampledKmer* item = &deque->items[(deque->head + deque->size) % deque->capacity];
+    item->order = order;
+    item->value = value;
+    item->position = position;
+    deque->size++;
 }
 
 /**
- * @brief Generates a K-mer from a subsequence of the DNA sequence.
+ * @brief Drops the K-mers at the front of a monotone deque that left the window, and gets the minimum.
  * 
- * @param byte_ptr Pointer to the byte in the DNA sequence where the subsequence starts.
- * @param nucleotide_ctr Counter for nucleotides in the current byte (0-3) where the subsequence starts.
- * @param kmer_length The length of the K-mer to generate.
- * @return A pointer to the generated K-mer. 
+ * @param deque The monotone deque.
+ * @param first The position of the first K-mer of the window.
+ * @return The K-mer with the smallest order in the window.
  */
-static Kmer* generate_kmer_subsequence(uint8_t* byte_ptr, uint8_t nucleotide_ctr, uint8_t kmer_length) {
-    Kmer* kmer = palloc0(sizeof(Kmer));
-    kmer->value = 0;
-    kmer->k = kmer_length;
+static inline SampledKmer* get_window_minimum(MonotoneDeque* deque, uint32_t first) {
+    while (deque->items[deque->head].position < first) {
+        deque->head = (deque->head + 1) % deque->capacity;
+        deque->size--;
+    }
+    return &deque->items[deque->head];
+}
 
-    for (int i = 0; i < kmer_length; i++) {
-        if (nucleotide_ctr == 4) {
-            nucleotide_ctr = 0;
-            (byte_ptr)++;
+/**
+ * @brief Adds a sampled K-mer to the tuplestore of a materialized set-returning function.
+ * 
+ * @param rsinfo The result set information.
+ * @param kmer The K-mer.
+ * @param position The (0-based) position of the K-mer.
+ * @param with_positions Whether the rows hold the (1-based) position before the K-mer.
+ */
+static void put_sampled_kmer(ReturnSetInfo *rsinfo, Kmer *kmer, uint32_t position, bool with_positions) {
+    Datum values[2];
+    bool nulls[2] = {false, false};
+    if (with_positions) {
+        values[0] = Int64GetDatum((int64) position + 1);
+        values[1] = KmerGetDatum(*kmer);
+    } else {
+        values[0] = KmerGetDatum(*kmer);
+    }
+    tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+}
+
+/**
+ * @brief Structure used to store the state of the minimizer generator.
+ */
+typedef struct MinimizerGeneratorState {
+    KmerGeneratorState kmers;  /**< Generator of the K-mers of the DNA sequence */
+    MonotoneDeque deque;       /**< K-mers of the current window, by increasing orders */
+    uint32_t window_size;      /**< Number of consecutive K-mers of a window */
+    uint32_t run;              /**< Number of consecutive K-mers generated */
+    uint32_t previous;         /**< Position of the last K-mer generated */
+    int64 last_output;         /**< Position of the last minimizer output, -1 if there is none */
+} MinimizerGeneratorState;
+
+/**
+ * @brief Initializes the state for minimizer generation.
+ * 
+ * @param state The MinimizerGeneratorState object to initialize.
+ * @param dna The DNA object.
+ * @param kmer_length The length of the K-mers.
+ * @param window_size The number of consecutive K-mers of a window (at least 1).
+ * @param canonical Whether the minimizers are taken among the canonical K-mers.
+ */
+static void init_minimizer_generator_state(MinimizerGeneratorState* state, DNA* dna, uint8_t kmer_length,
+                                           uint32_t window_size, bool canonical) {
+    init_kmer_generator_state(&state->kmers, dna, kmer_length, canonical);
+    state->deque.items = palloc(((Size) window_size + 1) * sizeof(SampledKmer));
+    state->deque.capacity = window_size + 1;
+    state->deque.head = 0;
+    state->deque.size = 0;
+    state->window_size = window_size;
+    state->run = 0;
+    state->previous = 0;
+    state->last_output = -1;
+}
+
+/**
+ * @brief Generates the next minimizer: for every window of window_size consecutive K-mers, the K-mer
+ * with the smallest order. A K-mer is output once for all the consecutive windows it minimizes,
+ * and windows never span an IUPAC ambiguity code.
+ * 
+ * @param state The minimizer generator state.
+ * @param value The value of the next minimizer.
+ * @param position The (0-based) position of the next minimizer.
+ * @return Whether a minimizer was generated, false at the end of the DNA sequence.
+ */
+static bool next_minimizer(MinimizerGeneratorState* state, uint64_t* value, uint32_t* position) {
+    uint64_t kmer_value;
+    while (next_kmer_value(&state->kmers, &kmer_value)) {
+        uint32_t kmer_position = state->kmers.position - state->kmers.kmer_length;
+        if (state->run > 0 && kmer_position != state->previous + 1) {   // an exception run was skipped
+            state->deque.size = 0;
+            state->run = 0;
+        }
+        state->previous = kmer_position;
+        state->run++;
+        push_monotone_deque(&state->deque, kmer_value, kmer_position);
+        if (state->run >= state->window_size) {
+            SampledKmer* minimum = get_window_minimum(&state->deque, kmer_position + 1 - state->window_size);
+            if (minimum->position != state->last_output) {
+                *value = minimum->value;
+                *position = minimum->position;
+                state->last_output = minimum->position;
+                return true;
+            }
         }
-        uint8_t current_byte = *byte_ptr;
-        uint8_t nucleotide = current_byte >> (6 - nucleotide_ctr * 2) & 0b11;   // shift to the right by 6 bits for the first nucleotide, 4 bits for the second, etc.
-        kmer->value = kmer->value << 2 | nucleotide;                            // shift to the left by 2 bits for each nucleotide
-        nucleotide_ctr++;
     }
-    return kmer;
+    return false;
 }
 
 /**
- * @brief Initializes the state for K-mer generation.
+ * @brief Generates the minimizers of a DNA sequence and stores them in the tuplestore of a materialized
+ * set-returning function.
+ * 
+ * @param fcinfo The function call information (DNA object, K-mer length, window size).
+ * @param with_positions Whether the rows hold the position of the K-mers.
+ */
+static void materialize_minimizers(FunctionCallInfo fcinfo, bool with_positions) {
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+    DNA* dna = PG_GETARG_BYTEA_P(0);
+    uint8_t kmer_length = check_kmer_length(PG_GETARG_INT32(1));
+    int32 window_size = PG_GETARG_INT32(2);
+    if (window_size < 1) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("window size should be at least 1")));
+    }
+
+    InitMaterializedSRF(fcinfo, MAT_SRF_USE_EXPECTED_DESC);
+
+    MinimizerGeneratorState state;
+    Kmer kmer;
+    uint32_t position;
+
+    init_minimizer_generator_state(&state, dna, kmer_length, window_size, false);
+    kmer.k = kmer_length;
+    while (next_minimizer(&state, &kmer.value, &position)) {
+        put_sampled_kmer(rsinfo, &kmer, position, with_positions);
+    }
+    pfree(state.deque.items);
+    PG_FREE_IF_COPY(dna, 0);
+}
+
+/**
+ * @brief Collects the K-mers of a DNA sequence, or only its minimizers, e.g. as the keys of an index.
+ * The K-mers overlapping an IUPAC ambiguity code are skipped, and duplicates are kept.
  * 
- * @param state The KmerGeneratorState object to initialize.
  * @param dna The DNA object.
- * @param funcctx The function call context.
+ * @param kmer_length The length of the K-mers.
+ * @param window_size The number of consecutive K-mers of a minimizer window, 1 to collect all the K-mers.
+ * @param canonical Whether the canonical K-mers are collected.
+ * @param nb_values The number of K-mers collected.
+ * @return The values of the K-mers collected (palloc'd).
  */
-static void init_kmer_generator_state(KmerGeneratorState *state, DNA *dna, FuncCallContext *funcctx) {
-    if (state->kmer_length > 32) {
-        errmsg("You cannot generate a kmer that is longer than 32 nucleotides.");
+uint64_t* collect_kmer_values(DNA* dna, uint8_t kmer_length, uint32_t window_size, bool canonical, int32* nb_values) {
+    uint32_t length = get_dna_sequence_length(dna);
+    uint32_t nb_kmers = length >= kmer_length ? length - kmer_length + 1 : 0;
+    uint64_t* values = palloc(Max(nb_kmers, 1) * sizeof(uint64_t));
+    int32 count = 0;
+
+    if (window_size <= 1) {
+        KmerGeneratorState state;
+        init_kmer_generator_state(&state, dna, kmer_length, canonical);
+        while (next_kmer_value(&state, &values[count])) {
+            count++;
+        }
+    } else {
+        MinimizerGeneratorState state;
+        uint32_t position;
+        init_minimizer_generator_state(&state, dna, kmer_length, window_size, canonical);
+        while (next_minimizer(&state, &values[count], &position)) {
+            count++;
+        }
+        pfree(state.deque.items);
     }
-    state->length = get_dna_sequence_length(dna);
-    state->byte_ptr = (uint8_t *)VARDATA(dna);
-    state->nucleotide_ctr = 0;
-    state->byte_ptr++; // skip first byte for last byte length
+    *nb_values = count;
+    return values;
+}
 
-    funcctx->max_calls = state->length - state->kmer_length + 1; // number of kmers to generate
+/**
+ * @brief Generates the (closed) syncmers of a DNA sequence: the K-mers whose smallest S-mer (by order,
+ * leftmost for equal orders) is their first or last one. Whether a K-mer is a syncmer only depends on
+ * the K-mer itself, so matching K-mers are always sampled in both sequences.
+ * 
+ * @param fcinfo The function call information (DNA object, K-mer length, S-mer length).
+ * @param with_positions Whether the rows hold the position of the K-mers.
+ */
+static void materialize_syncmers(FunctionCallInfo fcinfo, bool with_positions) {
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+    DNA* dna = PG_GETARG_BYTEA_P(0);
+    uint8_t kmer_length = check_kmer_length(PG_GETARG_INT32(1));
+    int32 smer_length = PG_GETARG_INT32(2);
+    if (smer_length < 1 || smer_length > kmer_length) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("s-mer length should be between 1 and the kmer length")));
+    }
+
+    InitMaterializedSRF(fcinfo, MAT_SRF_USE_EXPECTED_DESC);
+
+    uint32_t nb_smers = kmer_length - smer_length + 1;                // S-mers per K-mer
+    KmerGeneratorState state;
+    MonotoneDeque deque = { palloc((nb_smers + 1) * sizeof(SampledKmer)), nb_smers + 1, 0, 0 };
+    uint64_t kmer_mask = (1ULL << (2 * kmer_length)) - 1;
+    Kmer kmer;
+    uint64_t smer;
+    uint32_t run = 0;                                                 // number of consecutive S-mers
+    uint32_t previous = 0;
+
+    init_kmer_generator_state(&state, dna, smer_length, false);
+    kmer.k = kmer_length;
+    kmer.value = 0;
+    while (next_kmer_value(&state, &smer)) {
+        uint32_t position = state.position - smer_length;
+        if (run > 0 && position != previous + 1) {                  // an exception run was skipped
+            deque.size = 0;
+            run = 0;
+        }
+        kmer.value = run == 0 ? smer : ((kmer.value << 2) | (smer & 0b11)) & kmer_mask;   // the K-mer ends with the S-mer
+        previous = position;
+        run++;
+        push_monotone_deque(&deque, smer, position);
+        if (run >= nb_smers) {
+            uint32_t start = position + 1 - nb_smers;
+            SampledKmer* minimum = get_window_minimum(&deque, start);
+            if (minimum->position == start || minimum->position == position) {
+                put_sampled_kmer(rsinfo, &kmer, start, with_positions);
+            }
+        }
+    }
+    pfree(deque.items);
+    PG_FREE_IF_COPY(dna, 0);
 }
 /* ------------------------------------------------------------------------- */
 
@@ -190,34 +937,99 @@ Datum dna_out(PG_FUNCTION_ARGS) {
     PG_RETURN_CSTRING(str);
 }
 
+/*
+ * Binary format of DNA (used by dna_send, dna_recv and COPY ... BINARY):
+ *   int32   number of nucleotides n (> 0, at most MaxAllocSize - 1 so that the sequence can be printed)
+ *   bytes   (n + 3) / 4 packed bytes, 4 nucleotides per byte, first nucleotide in the most significant
+ *           bits (A = 00, C = 01, G = 10, T = 11); the unused bits of the last byte must be 0.
+ * optionally followed, when the sequence holds IUPAC ambiguity codes, by:
+ *   int32   number of exception runs r (> 0)
+ *   r times int32 start (0-based), int32 length (> 0), int8 upper case ambiguity code; the runs are
+ *           sorted, do not overlap, and adjacent runs have different codes
+ * The packed nucleotides covered by the runs are ignored. All the integers are in network byte order.
+ */
+
 /**
- * @brief Postgres send function for DNA.
+ * @brief Postgres receive function for DNA.
  * 
- * @param dna The DNA object.
- * @return The bytea representation of the DNA object.
+ * @param buf The binary representation of the DNA object.
+ * @return The DNA object.
  */
 PG_FUNCTION_INFO_V1(dna_recv);
 Datum dna_recv(PG_FUNCTION_ARGS) {
     StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
-    int32 len = pq_getmsgint(buf, 4);
-    bytea* result = (bytea*) palloc(len + VARHDRSZ);
-    SET_VARSIZE(result, len + VARHDRSZ);
-    memcpy(VARDATA(result), pq_getmsgbytes(buf, len), len);
-    PG_RETURN_BYTEA_P(result);
+    int32 length = (int32) pq_getmsgint(buf, 4);
+    if (length <= 0) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+            errmsg("invalid DNA length in external value: %d", length)));
+    }
+    if ((uint32_t) length > DNA_MAX_LENGTH) {
+        ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+            errmsg("DNA sequence of %d nucleotides is too long", length),
+            errdetail("DNA sequences are limited to %u nucleotides.", (uint32_t) DNA_MAX_LENGTH)));
+    }
+    uint32_t nb_bytes = ((uint32_t) length + 3) / 4;
+    const uint8_t* data = (const uint8_t*) pq_getmsgbytes(buf, nb_bytes);
+    if (length % 4 != 0 && (data[nb_bytes - 1] & (0xFF >> (2 * (length % 4)))) != 0) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+            errmsg("invalid DNA padding bits in external value")));
+    }
+
+    int32 nb_exceptions = 0;
+    DnaException* exceptions = NULL;
+    if (buf->cursor < buf->len) {
+        nb_exceptions = (int32) pq_getmsgint(buf, 4);
+        if (nb_exceptions <= 0 || nb_exceptions > length) {
+            ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+                errmsg("invalid number of DNA exception runs in external value: %d", nb_exceptions)));
+        }
+        exceptions = palloc(nb_exceptions * sizeof(DnaException));
+        for (int32 i = 0; i < nb_exceptions; i++) {
+            int64 start = (int32) pq_getmsgint(buf, 4);
+            int64 run_length = (int32) pq_getmsgint(buf, 4);
+            char code = (char) pq_getmsgbyte(buf);
+            int64 previous_end = i > 0 ? exceptions[i - 1].start + exceptions[i - 1].length : 0;
+            if (start < previous_end || run_length <= 0 || start + run_length > length
+                || fold_ambiguity_code(code) != code
+                || (i > 0 && start == previous_end && exceptions[i - 1].code == code)) {
+                ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+                    errmsg("invalid DNA exception run in external value")));
+            }
+            exceptions[i].start = start;
+            exceptions[i].length = run_length;
+            exceptions[i].code = code;
+        }
+    }
+    PG_RETURN_BYTEA_P(make_dna_from_packed(data, 0, length, exceptions, nb_exceptions));
 }
 
 /**
- * @brief Postgres receive function for DNA.
+ * @brief Postgres send function for DNA.
  * 
  * @param dna The DNA object.
- * @return The bytea representation of the DNA object.
+ * @return The binary representation of the DNA object.
  */
 PG_FUNCTION_INFO_V1(dna_send);
 Datum dna_send(PG_FUNCTION_ARGS) {
-    bytea* dna = PG_GETARG_BYTEA_P(0);
+    DNA* dna = PG_GETARG_BYTEA_P(0);
+    const uint8_t* header = (uint8_t*) VARDATA(dna);
+    uint32_t nb_exceptions = get_dna_nb_exceptions(header);
+    uint8_t* nucleotides = get_dna_nucleotides(dna);
+    DnaException exception;
     StringInfoData buf;
+
     pq_begintypsend(&buf);
-    pq_sendbytes(&buf, VARDATA(dna), VARSIZE_ANY_EXHDR(dna));
+    pq_sendint32(&buf, get_dna_sequence_length(dna));
+    pq_sendbytes(&buf, (char*) nucleotides, (char*) dna + VARSIZE(dna) - (char*) nucleotides);
+    if (nb_exceptions > 0) {
+        pq_sendint32(&buf, nb_exceptions);
+        for (uint32_t i = 0; i < nb_exceptions; i++) {
+            get_dna_exception(header, i, &exception);
+            pq_sendint32(&buf, exception.start);
+            pq_sendint32(&buf, exception.length);
+            pq_sendint8(&buf, (uint8_t) exception.code);
+        }
+    }
     PG_FREE_IF_COPY(dna, 0);
     PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
 }
@@ -247,8 +1059,10 @@ Datum DNA_cast_from_text(PG_FUNCTION_ARGS) {
 PG_FUNCTION_INFO_V1(DNA_cast_to_text);
 Datum DNA_cast_to_text(PG_FUNCTION_ARGS) {
     DNA* dna = PG_GETARG_BYTEA_P(0);
-    text* out = (text *)DirectFunctionCall1(textin,
-              PointerGetDatum(dna_to_string(dna)));
+    uint32_t length = get_dna_sequence_length(dna);
+    text* out = (text *) palloc(VARHDRSZ + length);
+    SET_VARSIZE(out, VARHDRSZ + length);
+    decode_dna(dna, length, VARDATA(out));                                            // decode straight into the text
     PG_FREE_IF_COPY(dna, 0);
     PG_RETURN_TEXT_P(out);
 }
@@ -262,22 +1076,257 @@ Datum DNA_cast_to_text(PG_FUNCTION_ARGS) {
  */
 PG_FUNCTION_INFO_V1(dna_length);
 Datum dna_length(PG_FUNCTION_ARGS) {
+    PG_RETURN_INT32((int32) get_dna_datum_sequence_length(PG_GETARG_DATUM(0)));
+}
+
+/**
+ * @brief Postgres function to extract a subsequence of a DNA sequence.
+ * Only the bytes holding the subsequence are fetched from a toasted value.
+ * Like substring(text), the range is clamped to the sequence, and NULL is returned when it is empty.
+ * 
+ * @param dna The DNA object.
+ * @param start The (1-based) position of the first nucleotide.
+ * @param length The number of nucleotides to extract (optional, until the end of the sequence by default).
+ * @return The subsequence.
+ */
+PG_FUNCTION_INFO_V1(dna_substring);
+Datum dna_substring(PG_FUNCTION_ARGS) {
+    uint32_t length;
+    DNA* header = get_dna_datum_header(PG_GETARG_DATUM(0), &length);
+    int64 start = PG_GETARG_INT32(1);
+    int64 end = (int64) length + 1;
+
+    if (PG_NARGS() > 2) {
+        int32 count = PG_GETARG_INT32(2);
+        if (count < 0) {
+            ereport(ERROR, (errcode(ERRCODE_SUBSTRING_ERROR),
+                errmsg("negative substring length not allowed")));
+        }
+        end = Min(end, start + count);
+    }
+    start = Max(start, 1);
+    if (start >= end) {
+        PG_RETURN_NULL();                                               // a DNA sequence cannot be empty
+    }
+
+    uint32_t first = start - 1;
+    uint32_t count = end - start;
+    const uint8_t* header_data = (uint8_t*) VARDATA(header);
+    Size header_size = get_dna_header_size(get_dna_nb_exceptions(header_data));
+    uint32_t nb_exceptions;
+    DnaException* exceptions = get_dna_exceptions_in_range(header_data, first, count, &nb_exceptions);
+
+    DNA* slice = PG_GETARG_BYTEA_P_SLICE(0, header_size + first / 4, (first % 4 + count + 3) / 4);
+    DNA* result = make_dna_from_packed((uint8_t*) VARDATA(slice), first % 4, count, exceptions, nb_exceptions);
+    pfree(slice);
+    pfree(header);
+    PG_RETURN_BYTEA_P(result);
+}
+
+/**
+ * @brief Postgres function to get the nucleotide at a position of a DNA sequence.
+ * Only the header and the byte holding the nucleotide are fetched from a toasted value.
+ * 
+ * @param dna The DNA object.
+ * @param position The (1-based) position of the nucleotide.
+ * @return The nucleotide, or its IUPAC ambiguity code.
+ */
+PG_FUNCTION_INFO_V1(dna_base_at);
+Datum dna_base_at(PG_FUNCTION_ARGS) {
+    uint32_t length;
+    DNA* header = get_dna_datum_header(PG_GETARG_DATUM(0), &length);
+    int32 position = PG_GETARG_INT32(1);
+    check_dna_range(position, 1, length);
+
+    uint32_t index = position - 1;
+    const uint8_t* header_data = (uint8_t*) VARDATA(header);
+    uint32_t nb_exceptions;
+    DnaException* exceptions = get_dna_exceptions_in_range(header_data, index, 1, &nb_exceptions);
+    if (nb_exceptions > 0) {
+        char code = exceptions[0].code;
+        pfree(exceptions);
+        pfree(header);
+        PG_RETURN_TEXT_P(cstring_to_text_with_len(&code, 1));
+    }
+
+    DNA* slice = PG_GETARG_BYTEA_P_SLICE(0, get_dna_header_size(get_dna_nb_exceptions(header_data)) + index / 4, 1);
+    uint8_t nucleotide = (*(uint8_t*) VARDATA(slice) >> (6 - (index % 4) * 2)) & 0b11;
+    pfree(slice);
+    pfree(header);
+    PG_RETURN_TEXT_P(cstring_to_text_with_len(&BINARY_TO_NUCLEOTIDE[nucleotide], 1));
+}
+
+/**
+ * @brief Postgres function to get the K-mer starting at a position of a DNA sequence.
+ * Only the header and the bytes holding the K-mer are fetched from a toasted value.
+ * 
+ * @param dna The DNA object.
+ * @param position The (1-based) position of the first nucleotide of the K-mer.
+ * @param kmer_length The length of the K-mer.
+ * @return The K-mer, or NULL if it overlaps an IUPAC ambiguity code.
+ */
+PG_FUNCTION_INFO_V1(dna_kmer_at);
+Datum dna_kmer_at(PG_FUNCTION_ARGS) {
+    uint32_t length;
+    DNA* header = get_dna_datum_header(PG_GETARG_DATUM(0), &length);
+    int32 position = PG_GETARG_INT32(1);
+    uint8_t kmer_length = check_kmer_length(PG_GETARG_INT32(2));
+    check_dna_range(position, kmer_length, length);
+
+    uint32_t first = position - 1;
+    const uint8_t* header_data = (uint8_t*) VARDATA(header);
+    uint32_t nb_exceptions;
+    DnaException* exceptions = get_dna_exceptions_in_range(header_data, first, kmer_length, &nb_exceptions);
+    if (nb_exceptions > 0) {
+        pfree(exceptions);
+        pfree(header);
+        PG_RETURN_NULL();
+    }
+
+    Size header_size = get_dna_header_size(get_dna_nb_exceptions(header_data));
+    pfree(header);
+    DNA* slice = PG_GETARG_BYTEA_P_SLICE(0, header_size + first / 4, (first % 4 + kmer_length + 3) / 4);
+    uint8_t* data_ptr = (uint8_t*) VARDATA(slice);
+
+    Kmer kmer;
+    kmer.k = kmer_length;
+    kmer.value = 0;
+    for (uint32_t i = first % 4; i < first % 4 + kmer_length; i++) {
+        kmer.value = (kmer.value << 2) | ((data_ptr[i / 4] >> (6 - (i % 4) * 2)) & 0b11);
+    }
+    pfree(slice);
+    PG_RETURN_KMER(kmer);
+}
+
+/**
+ * @brief Postgres function to check if a DNA sequence contains a K-mer.
+ *
+ * @param dna The DNA object.
+ * @param kmer The K-mer.
+ * @return True if the K-mer occurs in the DNA sequence (outside of the IUPAC ambiguity codes).
+ */
+PG_FUNCTION_INFO_V1(dna_contains_kmer);
+Datum dna_contains_kmer(PG_FUNCTION_ARGS) {
     DNA* dna = PG_GETARG_BYTEA_P(0);
-    uint32_t length = get_dna_sequence_length(dna);
+    Kmer kmer = PG_GETARG_KMER(1);
+    bool result = find_in_dna(dna, kmer.value, kmer.k, NULL) >= 0;
     PG_FREE_IF_COPY(dna, 0);
-    PG_RETURN_UINT32(length);
+    PG_RETURN_BOOL(result);
 }
 
 /**
- * @brief Postgres function to generate K-mers from a DNA sequence.
- * 
+ * @brief Postgres function to find the first occurrence of a K-mer in a DNA sequence.
+ *
  * @param dna The DNA object.
- * @param kmer_length The length of the K-mers to generate.
- * @return A set of K-mers.
+ * @param kmer The K-mer.
+ * @return The (1-based) position of the first occurrence, 0 if there is none (like strpos(text, text)),
+ * as a bigint since a DNA sequence can be longer than the int4 range.
  */
-PG_FUNCTION_INFO_V1(dna_generate_kmers);
-Datum dna_generate_kmers(PG_FUNCTION_ARGS) {
+PG_FUNCTION_INFO_V1(dna_strpos);
+Datum dna_strpos(PG_FUNCTION_ARGS) {
+    DNA* dna = PG_GETARG_BYTEA_P(0);
+    Kmer kmer = PG_GETARG_KMER(1);
+    int64 position = find_in_dna(dna, kmer.value, kmer.k, NULL);
+    PG_FREE_IF_COPY(dna, 0);
+    PG_RETURN_INT64(position + 1);
+}
+
+/**
+ * @brief Postgres function to check if a DNA sequence contains another one, on the packed
+ * nucleotides: the occurrences of the first nucleotides of the query (at most a K-mer) are checked
+ * against the rest of the query, and IUPAC ambiguity codes only match the same codes.
+ *
+ * @param dna The DNA object.
+ * @param query The DNA sequence to search.
+ * @return True if the query occurs in the DNA sequence.
+ */
+PG_FUNCTION_INFO_V1(dna_contains_dna);
+Datum dna_contains_dna(PG_FUNCTION_ARGS) {
+    DNA* dna = PG_GETARG_BYTEA_P(0);
+    DNA* query = PG_GETARG_BYTEA_P(1);
+    uint32_t query_length = get_dna_sequence_length(query);
+    uint8_t kmer_length = Min(query_length, KMER_MAX_LENGTH);
+    const uint8_t* nucleotides = get_dna_nucleotides(query);
+    uint64_t value = 0;
+    bool result;
+
+    for (uint32_t i = 0; i < kmer_length; i++) {
+        value = (value << 2) | ((nucleotides[i / 4] >> (6 - (i % 4) * 2)) & 0b11);
+    }
+    result = query_length == 0 || find_in_dna(dna, value, kmer_length, query) >= 0;
+    PG_FREE_IF_COPY(dna, 0);
+    PG_FREE_IF_COPY(query, 1);
+    PG_RETURN_BOOL(result);
+}
+
+/**
+ * @brief Postgres function to check if a DNA sequence contains a K-mer matching a Q-kmer, with a
+ * bit-parallel Shift-And scan of the packed nucleotides.
+ *
+ * @param dna The DNA object.
+ * @param qkmer The Q-kmer.
+ * @return True if a K-mer of the DNA sequence (outside of the IUPAC ambiguity codes) matches the Q-kmer.
+ */
+PG_FUNCTION_INFO_V1(dna_contains_qkmer);
+Datum dna_contains_qkmer(PG_FUNCTION_ARGS) {
+    DNA* dna = PG_GETARG_BYTEA_P(0);
+    Qkmer* qkmer = PG_GETARG_QKMER_P(1);
+    QkmerScanState state;
+    uint32_t start;
+
+    init_qkmer_scan_state(&state, dna, qkmer);
+    bool result = next_qkmer_match(&state, &start);
+    PG_FREE_IF_COPY(dna, 0);
+    PG_RETURN_BOOL(result);
+}
+
+/**
+ * @brief Postgres function to find all the occurrences of a Q-kmer in a DNA sequence, overlapping
+ * occurrences included.
+ *
+ * @param dna The DNA object.
+ * @param qkmer The Q-kmer.
+ * @return A set of (1-based) positions of the occurrences.
+ */
+PG_FUNCTION_INFO_V1(dna_qkmer_positions);
+Datum dna_qkmer_positions(PG_FUNCTION_ARGS) {
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+    DNA* dna = PG_GETARG_BYTEA_P(0);
+    Qkmer* qkmer = PG_GETARG_QKMER_P(1);
+    QkmerScanState state;
+    uint32_t start;
+    bool isnull = false;
+
+    InitMaterializedSRF(fcinfo, MAT_SRF_USE_EXPECTED_DESC);
+
+    init_qkmer_scan_state(&state, dna, qkmer);
+    while (next_qkmer_match(&state, &start)) {
+        Datum value = Int64GetDatum((int64) start + 1);
+        tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, &value, &isnull);
+    }
+    PG_FREE_IF_COPY(dna, 0);
+    return (Datum) 0;
+}
+
+/**
+ * @brief Generates K-mers from a DNA sequence, for the set-returning functions.
+ * When the caller accepts it, the K-mers are materialized in one pass, otherwise they are
+ * returned one per call. The K-mers overlapping an IUPAC ambiguity code are skipped.
+ * 
+ * @param fcinfo The function call information (DNA object, K-mer length).
+ * @param canonical Whether the canonical K-mers are generated.
+ * @return The next K-mer.
+ */
+static Datum generate_kmers(FunctionCallInfo fcinfo, bool canonical) {
     FuncCallContext *funcctx;
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+
+    if (rsinfo && IsA(rsinfo, ReturnSetInfo) && (rsinfo->allowedModes & SFRM_Materialize)) {
+        DNA* dna = PG_GETARG_BYTEA_P(0);
+        materialize_kmers(fcinfo, dna, check_kmer_length(PG_GETARG_INT32(1)), canonical);
+        PG_FREE_IF_COPY(dna, 0);
+        return (Datum) 0;
+    }
 
     if (SRF_IS_FIRSTCALL()) {
         MemoryContext oldcontext;
@@ -289,13 +1338,8 @@ Datum dna_generate_kmers(PG_FUNCTION_ARGS) {
         KmerGeneratorState *state = (KmerGeneratorState *) funcctx->user_fctx;
 
         DNA* dna = PG_GETARG_BYTEA_P(0);
-        // elog(INFO, "dna %s", dna_to_string(dna));
-        state->kmer_length = (uint8_t) PG_GETARG_UINT16(1);
-        if (get_dna_sequence_length(dna) < state->kmer_length) {
-            // Return an empty set if the kmer length is greater than the DNA sequence length
-            SRF_RETURN_DONE(funcctx);
-        }
-        init_kmer_generator_state(state, dna, funcctx);
+        uint8_t kmer_length = check_kmer_length(PG_GETARG_INT32(1));
+        init_kmer_generator_state(state, dna, kmer_length, canonical);
 
         MemoryContextSwitchTo(oldcontext);
     }
@@ -303,20 +1347,145 @@ Datum dna_generate_kmers(PG_FUNCTION_ARGS) {
     funcctx = SRF_PERCALL_SETUP();
     KmerGeneratorState *state = (KmerGeneratorState *) funcctx->user_fctx;
 
-   
-    if (funcctx->call_cntr < funcctx->max_calls) {
-        Kmer* kmer = generate_kmer_subsequence(state->byte_ptr, state->nucleotide_ctr, state->kmer_length);
-        
-        if (++state->nucleotide_ctr == 4) {
-            state->nucleotide_ctr = 0;
-            state->byte_ptr++;
-        }
-        
-        // Convert kmer to text for return
-        SRF_RETURN_NEXT(funcctx, KmerPGetDatum(kmer));
+    uint64_t value;
+    if (next_kmer_value(state, &value)) {
+        Kmer kmer = { value, state->kmer_length };
+        SRF_RETURN_NEXT(funcctx, KmerGetDatum(kmer));
     } else {
         SRF_RETURN_DONE(funcctx);
     }
 }
 
+/**
+ * @brief Postgres function to generate K-mers from a DNA sequence.
+ * 
+ * @param dna The DNA object.
+ * @param kmer_length The length of the K-mers to generate.
+ * @return A set of K-mers.
+ */
+PG_FUNCTION_INFO_V1(dna_generate_kmers);
+Datum dna_generate_kmers(PG_FUNCTION_ARGS) {
+    return generate_kmers(fcinfo, false);
+}
+
+/**
+ * @brief Postgres function to generate the canonical K-mers of a DNA sequence, the canonical
+ * form being the smallest of a K-mer and its reverse complement (strand-agnostic).
+ * 
+ * @param dna The DNA object.
+ * @param kmer_length The length of the K-mers to generate.
+ * @return A set of canonical K-mers.
+ */
+PG_FUNCTION_INFO_V1(dna_generate_canonical_kmers);
+Datum dna_generate_canonical_kmers(PG_FUNCTION_ARGS) {
+    return generate_kmers(fcinfo, true);
+}
+
+/**
+ * @brief Postgres function to generate the minimizers of a DNA sequence: the K-mer with the smallest
+ * (hashed) order of every window of consecutive K-mers, each one output once.
+ * 
+ * @param dna The DNA object.
+ * @param kmer_length The length of the K-mers.
+ * @param window_size The number of K-mers per window.
+ * @return A set of K-mers.
+ */
+PG_FUNCTION_INFO_V1(dna_generate_minimizers);
+Datum dna_generate_minimizers(PG_FUNCTION_ARGS) {
+    materialize_minimizers(fcinfo, false);
+    return (Datum) 0;
+}
+
+/**
+ * @brief Postgres function to generate the minimizers of a DNA sequence with their positions.
+ * 
+ * @param dna The DNA object.
+ * @param kmer_length The length of the K-mers.
+ * @param window_size The number of K-mers per window.
+ * @return A set of (pos, kmer) rows, pos being the (1-based) position of the K-mer.
+ */
+PG_FUNCTION_INFO_V1(dna_generate_minimizer_positions);
+Datum dna_generate_minimizer_positions(PG_FUNCTION_ARGS) {
+    materialize_minimizers(fcinfo, true);
+    return (Datum) 0;
+}
+
+/**
+ * @brief Postgres function to generate the closed syncmers of a DNA sequence: the K-mers whose
+ * smallest (hashed) S-mer is their first or last one.
+ * 
+ * @param dna The DNA object.
+ * @param kmer_length The length of the K-mers.
+ * @param smer_length The length of the S-mers.
+ * @return A set of K-mers.
+ */
+PG_FUNCTION_INFO_V1(dna_generate_syncmers);
+Datum dna_generate_syncmers(PG_FUNCTION_ARGS) {
+    materialize_syncmers(fcinfo, false);
+    return (Datum) 0;
+}
+
+/**
+ * @brief Postgres function to generate the closed syncmers of a DNA sequence with their positions.
+ * 
+ * @param dna The DNA object.
+ * @param kmer_length The length of the K-mers.
+ * @param smer_length The length of the S-mers.
+ * @return A set of (pos, kmer) rows, pos being the (1-based) position of the K-mer.
+ */
+PG_FUNCTION_INFO_V1(dna_generate_syncmer_positions);
+Datum dna_generate_syncmer_positions(PG_FUNCTION_ARGS) {
+    materialize_syncmers(fcinfo, true);
+    return (Datum) 0;
+}
+
+/**
+ * @brief Postgres function to check if two DNA sequences are equal. The packing of a sequence is unique,
+ * so their bytes are compared, and sequences of different sizes are not even detoasted (like texteq).
+ * 
+ * @param a The first DNA object.
+ * @param b The second DNA object.
+ * @return True if the DNA sequences are equal, false otherwise.
+ */
+PG_FUNCTION_INFO_V1(dna_eq);
+Datum dna_eq(PG_FUNCTION_ARGS) {
+    if (toast_raw_datum_size(PG_GETARG_DATUM(0)) != toast_raw_datum_size(PG_GETARG_DATUM(1))) {
+        PG_RETURN_BOOL(false);
+    }
+    DNA* a = PG_GETARG_BYTEA_PP(0);
+    DNA* b = PG_GETARG_BYTEA_PP(1);
+    bool result = memcmp(VARDATA_ANY(a), VARDATA_ANY(b), VARSIZE_ANY_EXHDR(a)) == 0;
+    PG_FREE_IF_COPY(a, 0);
+    PG_FREE_IF_COPY(b, 1);
+    PG_RETURN_BOOL(result);
+}
+
+/**
+ * @brief Postgres function to get the hash value of a DNA sequence (hash support function 1).
+ * 
+ * @param dna The DNA object.
+ * @return The hash value of the DNA sequence.
+ */
+PG_FUNCTION_INFO_V1(dna_hash);
+Datum dna_hash(PG_FUNCTION_ARGS) {
+    DNA* dna = PG_GETARG_BYTEA_PP(0);
+    Datum hash = hash_any((unsigned char*) VARDATA_ANY(dna), VARSIZE_ANY_EXHDR(dna));
+    PG_FREE_IF_COPY(dna, 0);
+    return hash;
+}
 
+/**
+ * @brief Postgres function to get the seeded 64-bit hash value of a DNA sequence (hash support function 2).
+ * With seed 0, its low 32 bits are the hash value of dna_hash.
+ * 
+ * @param dna The DNA object.
+ * @param seed The seed.
+ * @return The hash value of the DNA sequence.
+ */
+PG_FUNCTION_INFO_V1(dna_hash_extended);
+Datum dna_hash_extended(PG_FUNCTION_ARGS) {
+    DNA* dna = PG_GETARG_BYTEA_PP(0);
+    Datum hash = hash_any_extended((unsigned char*) VARDATA_ANY(dna), VARSIZE_ANY_EXHDR(dna), PG_GETARG_INT64(1));
+    PG_FREE_IF_COPY(dna, 0);
+    return hash;
+}
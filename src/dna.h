@@ -2,10 +2,237 @@
 #define DNA_H
 
 #include "kmea.h"
+#include "nucleotide.h"
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
 #include "funcapi.h"
+#include "access/detoast.h"
+#include "common/hashfn.h"
+#include "utils/tuplestore.h"
 
-#endif
\ No newline at end of file
+/*
+ * Layout of a DNA object (after the varlena header):
+ *   uint8   flags: number of nucleotides held by the last packed byte (1-4) in the low bits, and
+ *           DNA_HAS_EXCEPTIONS when the sequence holds IUPAC ambiguity codes (N, R, Y, ...)
+ *   [uint32 number of exception runs, then the runs (uint32 start, uint32 length, char code), sorted
+ *           and maximal]                                                only with DNA_HAS_EXCEPTIONS
+ *   bytes   packed nucleotides, 4 per byte, first nucleotide in the most significant bits;
+ *           the positions covered by exception runs hold A (00)
+ * Sequences made only of ACGT have no exception section, so their layout is unchanged.
+ */
+#define DNA_LAST_BYTE_LENGTH_MASK 0b00000111
+#define DNA_HAS_EXCEPTIONS 0b10000000
+#define DNA_EXCEPTIONS_OFFSET (1 + sizeof(uint32_t))                 // flags + number of runs
+#define DNA_EXCEPTION_SIZE (2 * sizeof(uint32_t) + 1)                // start + length + code
+#define DNA_MAX_LENGTH ((uint32_t) MaxAllocSize - 1)                 // printable by dna_out, an int32 for length()
+
+/**
+ * @brief Run of consecutive positions of a DNA sequence holding the same IUPAC ambiguity code.
+ */
+typedef struct DnaException {
+    uint32_t start;         /**< (0-based) position of the first nucleotide of the run */
+    uint32_t length;        /**< Number of nucleotides of the run */
+    char code;              /**< Upper case IUPAC ambiguity code */
+} DnaException;
+
+/**
+ * @brief Builder packing a DNA sequence incrementally, e.g. line by line from a FASTA file.
+ */
+typedef struct DnaBuilder {
+    uint8_t* packed;            /**< Packed nucleotides, zeroed after the last one */
+    Size max_bytes;             /**< Number of bytes allocated for the packed nucleotides */
+    uint32_t length;            /**< Number of nucleotides appended */
+    DnaException* exceptions;   /**< Exception runs of the nucleotides appended */
+    uint32_t nb_exceptions;     /**< Number of exception runs */
+    uint32_t max_exceptions;    /**< Number of exception runs allocated */
+} DnaBuilder;
+
+void init_dna_builder(DnaBuilder* builder);
+void append_to_dna_builder(DnaBuilder* builder, const char* str, uint32_t length);
+DNA* build_dna(const DnaBuilder* builder);
+void reset_dna_builder(DnaBuilder* builder);
+void free_dna_builder(DnaBuilder* builder);
+DNA* make_dna_from_kmer(const Kmer* kmer);
+uint8_t check_kmer_length(int32 kmer_length);
+uint64_t* collect_kmer_values(DNA* dna, uint8_t kmer_length, uint32_t window_size, bool canonical, int32* nb_values);
+
+/**
+ * @brief Gets the number of exception runs of a DNA sequence.
+ *
+ * @param header The data of the DNA object (after the varlena header).
+ * @return The number of exception runs.
+ */
+static inline uint32_t get_dna_nb_exceptions(const uint8_t* header) {
+    uint32_t nb_exceptions = 0;
+    if (*header & DNA_HAS_EXCEPTIONS) {
+        memcpy(&nb_exceptions, header + 1, sizeof(nb_exceptions));
+    }
+    return nb_exceptions;
+}
+
+/**
+ * @brief Gets the number of bytes preceding the packed nucleotides of a DNA sequence.
+ *
+ * @param nb_exceptions The number of exception runs of the DNA sequence.
+ * @return The size of the header.
+ */
+static inline Size get_dna_header_size(uint32_t nb_exceptions) {
+    return nb_exceptions == 0 ? 1 : DNA_EXCEPTIONS_OFFSET + (Size) nb_exceptions * DNA_EXCEPTION_SIZE;
+}
+
+/**
+ * @brief Reads an exception run of a DNA sequence.
+ *
+ * @param header The data of the DNA object (after the varlena header).
+ * @param index The index of the run.
+ * @param exception The run read.
+ */
+static inline void get_dna_exception(const uint8_t* header, uint32_t index, DnaException* exception) {
+    const uint8_t* run = header + DNA_EXCEPTIONS_OFFSET + (Size) index * DNA_EXCEPTION_SIZE;
+    memcpy(&exception->start, run, sizeof(uint32_t));
+    memcpy(&exception->length, run + sizeof(uint32_t), sizeof(uint32_t));
+    exception->code = (char) run[2 * sizeof(uint32_t)];
+}
+
+/**
+ * @brief Computes the length of a DNA sequence from the size of its packed nucleotides.
+ *
+ * @param header The data of the DNA object (after the varlena header).
+ * @param nb_bytes The number of bytes of packed nucleotides.
+ * @return The length of the DNA sequence.
+ */
+static inline uint32_t compute_dna_sequence_length(const uint8_t* header, Size nb_bytes) {
+    return nb_bytes * 4 - (4 - (*header & DNA_LAST_BYTE_LENGTH_MASK));
+}
+
+/**
+ * @brief Gets the packed nucleotides of a DNA sequence.
+ *
+ * @param dna The DNA object.
+ * @return A pointer to the byte holding the first nucleotide.
+ */
+static inline uint8_t* get_dna_nucleotides(DNA* dna) {
+    uint8_t* header = (uint8_t*) VARDATA(dna);
+    return header + get_dna_header_size(get_dna_nb_exceptions(header));
+}
+
+/**
+ * @brief Gets the length of the DNA sequence.
+ *
+ * @param dna The DNA object.
+ * @return The length of the DNA sequence.
+ */
+static inline uint32_t get_dna_sequence_length(DNA* dna) {
+    uint8_t* header = (uint8_t*) VARDATA(dna);
+    Size header_size = get_dna_header_size(get_dna_nb_exceptions(header));
+    return compute_dna_sequence_length(header, VARSIZE(dna) - VARHDRSZ - header_size);
+}
+
+/**
+ * @brief Structure used to store the state of the K-mer generator.
+ * 
+ * The generator keeps a rolling window over the DNA sequence: every new K-mer is obtained
+ * from the previous one by shifting in the next nucleotide and masking out the oldest one.
+ * The K-mers overlapping an exception run are skipped by jumping over the run and refilling the window.
+ * For canonical K-mers, a second window holds the reverse complement, updated in O(1) as well.
+ */
+typedef struct KmerGeneratorState {
+    uint8_t kmer_length;       /**< Length of the K-mer(s) to generate */
+    uint32_t length;           /**< Total length of the DNA sequence */
+    uint32_t position;         /**< Position of the next nucleotide to read */
+    uint64_t ready_at;         /**< Position from which the window holds a complete K-mer */
+    const uint8_t* nucleotides;/**< Packed nucleotides of the DNA sequence */
+    const uint8_t* header;     /**< Data of the DNA object, holding the exception runs */
+    uint32_t nb_exceptions;    /**< Number of exception runs of the DNA sequence */
+    uint32_t next_exception;   /**< Index of the next exception run */
+    uint32_t exception_start;  /**< Start of the next exception run, UINT32_MAX if there is none */
+    uint64_t window;           /**< Value of the K-mer currently held by the rolling window */
+    uint64_t window_mask;      /**< Mask keeping only the 2 * kmer_length bits of the window */
+    bool canonical;            /**< Whether the canonical K-mers are generated */
+    uint64_t reverse_window;   /**< Reverse complement of the K-mer held by the rolling window */
+    uint8_t reverse_shift;     /**< Position of the complement of the newest nucleotide in reverse_window */
+} KmerGeneratorState;
+
+/**
+ * @brief Moves the K-mer generator to the next exception run, if any.
+ * 
+ * @param state The K-mer generator state.
+ */
+static inline void load_next_exception(KmerGeneratorState *state) {
+    DnaException exception;
+    if (state->next_exception < state->nb_exceptions) {
+        get_dna_exception(state->header, state->next_exception, &exception);
+        state->exception_start = exception.start;
+    } else {
+        state->exception_start = UINT32_MAX;
+    }
+}
+
+/**
+ * @brief Skips the exception run starting at the current position and empties the rolling window.
+ * 
+ * @param state The K-mer generator state.
+ */
+static inline void skip_exception(KmerGeneratorState *state) {
+    DnaException exception;
+    get_dna_exception(state->header, state->next_exception++, &exception);
+    state->position = exception.start + exception.length;
+    state->ready_at = (uint64_t) state->position + state->kmer_length;
+    state->window = 0;
+    state->reverse_window = 0;
+    load_next_exception(state);
+}
+
+/**
+ * @brief Slides the rolling window by one nucleotide, in O(1), until it holds a complete K-mer.
+ * 
+ * @param state The K-mer generator state.
+ * @param value The value of the next K-mer.
+ * @return Whether a K-mer was generated, false at the end of the DNA sequence.
+ */
+static inline bool next_kmer_value(KmerGeneratorState *state, uint64_t *value) {
+    while (state->position < state->length) {
+        if (unlikely(state->position == state->exception_start)) {
+            skip_exception(state);
+            continue;
+        }
+        uint32_t position = state->position++;
+        uint8_t nucleotide = (state->nucleotides[position / 4] >> (6 - (position % 4) * 2)) & 0b11;
+        state->window = ((state->window << 2) | nucleotide) & state->window_mask;
+        state->reverse_window = (state->reverse_window >> 2) | ((uint64_t) (nucleotide ^ 0b11) << state->reverse_shift);
+        if (state->position >= state->ready_at) {
+            *value = state->canonical ? Min(state->window, state->reverse_window) : state->window;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Initializes the state for K-mer generation.
+ * 
+ * @param state The KmerGeneratorState object to initialize.
+ * @param dna The DNA object.
+ * @param kmer_length The length of the K-mers to generate.
+ * @param canonical Whether the canonical K-mers are generated.
+ */
+static inline void init_kmer_generator_state(KmerGeneratorState *state, DNA *dna, uint8_t kmer_length, bool canonical) {
+    state->kmer_length = kmer_length;
+    state->length = get_dna_sequence_length(dna);
+    state->position = 0;
+    state->ready_at = kmer_length;
+    state->nucleotides = get_dna_nucleotides(dna);
+    state->header = (uint8_t *) VARDATA(dna);
+    state->nb_exceptions = get_dna_nb_exceptions(state->header);
+    state->next_exception = 0;
+    state->window = 0;
+    state->window_mask = (1ULL << (2 * kmer_length)) - 1;
+    state->canonical = canonical;
+    state->reverse_window = 0;
+    state->reverse_shift = 2 * (kmer_length - 1);
+    load_next_exception(state);
+}
+
+#endif
@@ -0,0 +1,251 @@
+#include "dna.h"
+#include "qkmer.h"
+#include "access/gin.h"
+#include "access/reloptions.h"
+#include "port/pg_bitutils.h"
+
+#define KMER_CONTAINED_STRATEGY_NUMBER 1
+#define DNA_CONTAINED_STRATEGY_NUMBER 2
+#define QKMER_CONTAINED_STRATEGY_NUMBER 3
+
+#define DNA_GIN_DEFAULT_KMER_LENGTH 12
+#define DNA_GIN_MAX_WINDOW_SIZE 255
+#define DNA_GIN_MAX_QKMER_EXPANSIONS 256
+
+/**
+ * @brief Parameters of the GIN operator class on DNA, e.g. (k = 21, canonical = true, w = 10).
+ */
+typedef struct DnaGinOptions {
+    int32 vl_len_;          /**< Varlena header (do not touch directly) */
+    int kmer_length;        /**< Length of the indexed K-mers */
+    bool canonical;         /**< Whether the canonical K-mers are indexed */
+    int window_size;        /**< Minimizer window, 1 to index all the K-mers */
+} DnaGinOptions;
+
+/**
+ * @brief Gets the parameters of the GIN index, or the defaults.
+ *
+ * @param fcinfo The function call information of a support function.
+ * @param options The parameters.
+ */
+static void get_dna_gin_options(FunctionCallInfo fcinfo, DnaGinOptions* options) {
+    if (PG_HAS_OPCLASS_OPTIONS()) {
+        *options = *(DnaGinOptions*) PG_GET_OPCLASS_OPTIONS();
+    } else {
+        options->kmer_length = DNA_GIN_DEFAULT_KMER_LENGTH;
+        options->canonical = false;
+        options->window_size = 1;
+    }
+}
+
+/**
+ * @brief Converts the values of K-mers to GIN keys.
+ *
+ * @param values The values of the K-mers (freed).
+ * @param nb_values The number of values.
+ * @return The keys.
+ */
+static Datum* make_gin_keys(uint64_t* values, int32 nb_values) {
+    Datum* keys = palloc(Max(nb_values, 1) * sizeof(Datum));
+    for (int32 i = 0; i < nb_values; i++) {
+        keys[i] = Int64GetDatum((int64) values[i]);
+    }
+    pfree(values);
+    return keys;
+}
+
+/**
+ * @brief Expands the degenerate positions of the window of a Q-kmer with the fewest matching K-mers.
+ *
+ * @param qkmer The Q-kmer, at least as long as the K-mers.
+ * @param kmer_length The length of the K-mers.
+ * @param canonical Whether the canonical K-mers are generated.
+ * @param nb_values The number of K-mers generated, 0 if there would be more than DNA_GIN_MAX_QKMER_EXPANSIONS.
+ * @return The values of the K-mers matching the window (palloc'd), NULL if there would be too many.
+ */
+static uint64_t* expand_qkmer(const Qkmer* qkmer, uint8_t kmer_length, bool canonical, int32* nb_values) {
+    uint32_t best_start = 0;
+    uint32_t best_count = UINT32_MAX;
+    for (uint32_t start = 0; start + kmer_length <= qkmer->k; start++) {
+        uint32_t count = 1;
+        for (uint32_t i = start; i < start + kmer_length && count <= DNA_GIN_MAX_QKMER_EXPANSIONS; i++) {
+            count *= pg_number_of_ones[get_qkmer_nucleotides(qkmer, i)];
+        }
+        if (count < best_count) {
+            best_start = start;
+            best_count = count;
+        }
+    }
+    if (best_count > DNA_GIN_MAX_QKMER_EXPANSIONS) {
+        *nb_values = 0;
+        return NULL;
+    }
+
+    uint64_t* values = palloc(Max(best_count, 1) * sizeof(uint64_t));
+    uint32_t count = 1;
+    values[0] = 0;
+    for (uint32_t i = best_start; i < best_start + kmer_length; i++) {
+        uint8_t nucleotides = get_qkmer_nucleotides(qkmer, i);
+        uint32_t nb_nucleotides = pg_number_of_ones[nucleotides];
+        for (int64 j = (int64) count - 1; j >= 0; j--) {          // backwards, the prefixes are expanded in place
+            uint64_t prefix = values[j];
+            uint32_t index = j * nb_nucleotides;
+            for (uint8_t nucleotide = 0; nucleotide < 4; nucleotide++) {
+                if (nucleotides & (1 << nucleotide)) {
+                    values[index++] = (prefix << 2) | nucleotide;
+                }
+            }
+        }
+        count *= nb_nucleotides;
+    }
+    if (canonical) {
+        for (uint32_t j = 0; j < count; j++) {
+            values[j] = Min(values[j], reverse_complement_kmer_value(values[j], kmer_length));
+        }
+    }
+    *nb_values = count;
+    return values;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Declares the parameters of the GIN operator class.
+ *
+ * @param relopts The local reloptions to fill.
+ */
+PG_FUNCTION_INFO_V1(gin_dna_options);
+Datum gin_dna_options(PG_FUNCTION_ARGS) {
+    local_relopts* relopts = (local_relopts*) PG_GETARG_POINTER(0);
+    init_local_reloptions(relopts, sizeof(DnaGinOptions));
+    add_local_int_reloption(relopts, "k", "length of the indexed kmers",
+                            DNA_GIN_DEFAULT_KMER_LENGTH, 1, KMER_MAX_LENGTH, offsetof(DnaGinOptions, kmer_length));
+    add_local_bool_reloption(relopts, "canonical", "whether the canonical kmers are indexed",
+                             false, offsetof(DnaGinOptions, canonical));
+    add_local_int_reloption(relopts, "w", "minimizer window (1 indexes all the kmers)",
+                            1, 1, DNA_GIN_MAX_WINDOW_SIZE, offsetof(DnaGinOptions, window_size));
+    PG_RETURN_VOID();
+}
+
+/**
+ * @brief Extracts the keys of a DNA sequence: its K-mers (or minimizers) as int8 values.
+ *
+ * @param dna The DNA object.
+ * @param nkeys The number of keys.
+ * @return The keys.
+ */
+PG_FUNCTION_INFO_V1(gin_dna_extract_value);
+Datum gin_dna_extract_value(PG_FUNCTION_ARGS) {
+    DNA* dna = PG_GETARG_BYTEA_P(0);
+    int32* nkeys = (int32*) PG_GETARG_POINTER(1);
+    DnaGinOptions options;
+    int32 nb_values;
+
+    get_dna_gin_options(fcinfo, &options);
+    uint64_t* values = collect_kmer_values(dna, options.kmer_length, options.window_size, options.canonical, &nb_values);
+    *nkeys = nb_values;
+    PG_RETURN_POINTER(make_gin_keys(values, nb_values));
+}
+
+/**
+ * @brief Extracts the keys of a query:
+ * - dna @> kmer and dna @> dna: the K-mers (or minimizers) of the query, which must all be indexed,
+ * - dna @> qkmer: the K-mers matching the most specific window of the Q-kmer, one of which must be indexed.
+ * When no key can be extracted (e.g. a query shorter than the indexed K-mers, or a Q-kmer on an index
+ * of minimizers), the whole index is scanned.
+ *
+ * @param query The query.
+ * @param nkeys The number of keys.
+ * @param strategy The strategy number of the operator.
+ * @param searchMode The GIN search mode.
+ * @return The keys.
+ */
+PG_FUNCTION_INFO_V1(gin_dna_extract_query);
+Datum gin_dna_extract_query(PG_FUNCTION_ARGS) {
+    int32* nkeys = (int32*) PG_GETARG_POINTER(1);
+    StrategyNumber strategy = PG_GETARG_UINT16(2);
+    int32* searchMode = (int32*) PG_GETARG_POINTER(6);
+    DnaGinOptions options;
+    uint64_t* values = NULL;
+    int32 nb_values = 0;
+
+    get_dna_gin_options(fcinfo, &options);
+    switch (strategy) {
+        case KMER_CONTAINED_STRATEGY_NUMBER: {
+            Kmer kmer = PG_GETARG_KMER(0);
+            if (kmer.k >= options.kmer_length) {
+                DNA* dna = make_dna_from_kmer(&kmer);
+                values = collect_kmer_values(dna, options.kmer_length, options.window_size, options.canonical, &nb_values);
+                pfree(dna);
+            }
+            break;
+        }
+        case DNA_CONTAINED_STRATEGY_NUMBER: {
+            DNA* dna = PG_GETARG_BYTEA_P(0);
+            values = collect_kmer_values(dna, options.kmer_length, options.window_size, options.canonical, &nb_values);
+            break;
+        }
+        case QKMER_CONTAINED_STRATEGY_NUMBER: {
+            Qkmer* qkmer = PG_GETARG_QKMER_P(0);
+            if (qkmer->k >= options.kmer_length && options.window_size == 1) {
+                values = expand_qkmer(qkmer, options.kmer_length, options.canonical, &nb_values);
+            }
+            break;
+        }
+        default:
+            elog(ERROR, "unrecognized strategy number: %d", strategy);
+    }
+
+    *nkeys = nb_values;
+    if (nb_values == 0) {
+        *searchMode = GIN_SEARCH_MODE_ALL;
+        if (values != NULL) {
+            pfree(values);
+        }
+        PG_RETURN_POINTER(NULL);
+    }
+    PG_RETURN_POINTER(make_gin_keys(values, nb_values));
+}
+
+/**
+ * @brief Checks if an indexed DNA sequence may match a query, from the keys it holds.
+ * Only a K-mer query of the indexed length, on an index of all the (non canonical) K-mers, is exact.
+ *
+ * @param check Whether the DNA sequence holds each key of the query.
+ * @param strategy The strategy number of the operator.
+ * @param query The query.
+ * @param nkeys The number of keys of the query.
+ * @param recheck Whether the operator must be rechecked on the DNA sequence.
+ * @return Whether the DNA sequence may match the query.
+ */
+PG_FUNCTION_INFO_V1(gin_dna_consistent);
+Datum gin_dna_consistent(PG_FUNCTION_ARGS) {
+    bool* check = (bool*) PG_GETARG_POINTER(0);
+    StrategyNumber strategy = PG_GETARG_UINT16(1);
+    int32 nkeys = PG_GETARG_INT32(3);
+    bool* recheck = (bool*) PG_GETARG_POINTER(5);
+    DnaGinOptions options;
+
+    get_dna_gin_options(fcinfo, &options);
+    *recheck = true;
+    if (nkeys == 0) {
+        PG_RETURN_BOOL(true);                                   // full index scan
+    }
+    if (strategy == QKMER_CONTAINED_STRATEGY_NUMBER) {
+        for (int32 i = 0; i < nkeys; i++) {
+            if (check[i]) {
+                PG_RETURN_BOOL(true);
+            }
+        }
+        PG_RETURN_BOOL(false);
+    }
+    for (int32 i = 0; i < nkeys; i++) {
+        if (!check[i]) {
+            PG_RETURN_BOOL(false);
+        }
+    }
+    if (strategy == KMER_CONTAINED_STRATEGY_NUMBER && !options.canonical && options.window_size == 1) {
+        *recheck = PG_GETARG_KMER(2).k != options.kmer_length;
+    }
+    PG_RETURN_BOOL(true);
+}
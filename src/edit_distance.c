@@ -0,0 +1,235 @@
+#include "edit_distance.h"
+#include "miscadmin.h"
+
+/**
+ * @brief Initializes the state of an edit distance computation, precomputing the match masks
+ * of the pattern from its packed nucleotides.
+ *
+ * @param state The MyersState object to initialize.
+ * @param pattern The DNA object of the pattern (the rows of the matrix).
+ * @param search Whether the pattern may start anywhere in the text, otherwise the whole text is aligned.
+ */
+static void init_myers_state(MyersState* state, DNA* pattern, bool search) {
+    DnaSymbolReader reader;
+
+    init_dna_symbol_reader(&reader, pattern);
+    state->length = reader.length;
+    state->nb_blocks = (reader.length + EDIT_BLOCK_SIZE - 1) / EDIT_BLOCK_SIZE;
+    state->last_bit = 1ULL << ((reader.length - 1) % EDIT_BLOCK_SIZE);
+    state->search = search;
+    state->column = 0;
+    state->peq = palloc0((Size) state->nb_blocks * (EDIT_NB_SYMBOLS + 2) * sizeof(uint64_t));
+    state->pv = state->peq + (Size) state->nb_blocks * EDIT_NB_SYMBOLS;
+    state->mv = state->pv + state->nb_blocks;
+    state->scores = palloc((Size) state->nb_blocks * sizeof(int64));
+
+    for (uint32_t i = 0; i < reader.length; i++) {
+        uint8_t symbol = read_next_dna_symbol(&reader);
+        state->peq[(Size) (i / EDIT_BLOCK_SIZE) * EDIT_NB_SYMBOLS + symbol] |= 1ULL << (i % EDIT_BLOCK_SIZE);
+    }
+    for (uint32_t b = 0; b < state->nb_blocks; b++) {
+        state->pv[b] = UINT64_MAX;                              // D[i][0] = i
+        state->scores[b] = Min((int64) (b + 1) * EDIT_BLOCK_SIZE, (int64) reader.length);
+    }
+}
+
+/**
+ * @brief Frees the state of an edit distance computation.
+ *
+ * @param state The state.
+ */
+static void free_myers_state(MyersState* state) {
+    pfree(state->peq);
+    pfree(state->scores);
+}
+
+/**
+ * @brief Advances a block of the pattern by one column of the matrix.
+ *
+ * @param state The state.
+ * @param block The index of the block.
+ * @param eq The rows of the block matching the text symbol.
+ * @param hin The horizontal difference (-1, 0 or +1) entering the block at its top.
+ * @param high_bit The bit of the last row of the block.
+ * @return The horizontal difference leaving the block at its last row.
+ */
+static inline int advance_myers_block(MyersState* state, uint32_t block, uint64_t eq, int hin, uint64_t high_bit) {
+    uint64_t pv = state->pv[block];
+    uint64_t mv = state->mv[block];
+    uint64_t hin_negative = hin < 0;
+    uint64_t xv = eq | mv;
+    eq |= hin_negative;
+    uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+    uint64_t ph = mv | ~(xh | pv);
+    uint64_t mh = pv & xh;
+    int hout = (ph & high_bit) ? 1 : (mh & high_bit) ? -1 : 0;
+    ph = (ph << 1) | (uint64_t) (hin > 0);
+    mh = (mh << 1) | hin_negative;
+    state->pv[block] = mh | ~(xv | ph);
+    state->mv[block] = ph & xv;
+    return hout;
+}
+
+/**
+ * @brief Advances the computation by one column of the matrix, i.e. one symbol of the text.
+ *
+ * @param state The state.
+ * @param symbol The symbol of the text.
+ */
+static inline void advance_myers_state(MyersState* state, uint8_t symbol) {
+    const uint64_t* peq = state->peq + symbol;
+    uint32_t last = state->nb_blocks - 1;
+    int h = state->search ? 0 : 1;                               // D[0][j] - D[0][j - 1]
+
+    for (uint32_t b = 0; b < last; b++) {
+        h = advance_myers_block(state, b, peq[(Size) b * EDIT_NB_SYMBOLS], h, 1ULL << (EDIT_BLOCK_SIZE - 1));
+        state->scores[b] += h;
+    }
+    state->scores[last] += advance_myers_block(state, last, peq[(Size) last * EDIT_NB_SYMBOLS], h, state->last_bit);
+    state->column++;
+}
+
+/**
+ * @brief Gets the score at a row of the current column, from the score of the previous block and
+ * the vertical differences of the rows above it in its block.
+ *
+ * @param state The state.
+ * @param row The row, from 0 to the length of the pattern.
+ * @return The score.
+ */
+static inline int64 get_myers_score(const MyersState* state, uint32_t row) {
+    if (row == 0) {
+        return state->search ? 0 : state->column;
+    }
+    uint32_t block = (row - 1) / EDIT_BLOCK_SIZE;
+    uint64_t mask = UINT64_MAX >> (EDIT_BLOCK_SIZE - 1 - (row - 1) % EDIT_BLOCK_SIZE);
+    int64 score = block == 0 ? get_myers_score(state, 0) : state->scores[block - 1];
+    return score + pg_popcount64(state->pv[block] & mask) - pg_popcount64(state->mv[block] & mask);
+}
+
+/**
+ * @brief Computes the edit distance (Levenshtein distance) between two DNA sequences with Myers'
+ * bit-parallel algorithm, in O(ceil(m / 64) * n) for sequences of lengths m <= n.
+ *
+ * With a bound, the computation stops as soon as the distance is known to exceed it: the scores never
+ * decrease along a diagonal of the matrix, and the distance is at least the score of the diagonal ending
+ * at its last cell. Sequences differing by more than the bound in length are not aligned at all.
+ *
+ * @param a The first DNA object.
+ * @param b The second DNA object.
+ * @param max_edits The bound, negative for none.
+ * @return The edit distance, max_edits + 1 if it exceeds the bound.
+ */
+static int64 compute_edit_distance(DNA* a, DNA* b, int64 max_edits) {
+    if (get_dna_sequence_length(a) > get_dna_sequence_length(b)) {
+        DNA* swap = a;                                          // the shorter sequence is the pattern
+        a = b;
+        b = swap;
+    }
+    uint32_t m = get_dna_sequence_length(a);
+    uint32_t n = get_dna_sequence_length(b);
+    if (max_edits >= 0 && n - m > max_edits) {
+        return max_edits + 1;
+    }
+
+    MyersState state;
+    DnaSymbolReader reader;
+    int64 distance;
+
+    init_myers_state(&state, a, false);
+    init_dna_symbol_reader(&reader, b);
+    for (uint32_t j = 1; j <= n; j++) {
+        CHECK_FOR_INTERRUPTS();
+        advance_myers_state(&state, read_next_dna_symbol(&reader));
+        if (max_edits >= 0 && j >= n - m && get_myers_score(&state, j - (n - m)) > max_edits) {
+            free_myers_state(&state);
+            return max_edits + 1;
+        }
+    }
+    distance = state.scores[state.nb_blocks - 1];
+    free_myers_state(&state);
+    return distance;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Postgres function to compute the edit distance between two DNA sequences: the minimal number
+ * of substitutions, insertions and deletions of nucleotides turning one into the other.
+ * An IUPAC ambiguity code only matches itself.
+ *
+ * With a third argument max_edits, the computation stops early when the distance exceeds it, and
+ * max_edits + 1 is returned instead (like levenshtein_less_equal), so that edit_distance(a, b, 3) <= 3
+ * is a cheap filter.
+ *
+ * @param a The first DNA object.
+ * @param b The second DNA object.
+ * @param max_edits The bound on the distance (optional).
+ * @return The edit distance.
+ */
+PG_FUNCTION_INFO_V1(dna_edit_distance);
+Datum dna_edit_distance(PG_FUNCTION_ARGS) {
+    DNA* a = PG_GETARG_BYTEA_P(0);
+    DNA* b = PG_GETARG_BYTEA_P(1);
+    int64 max_edits = -1;
+    if (PG_NARGS() > 2) {
+        max_edits = PG_GETARG_INT32(2);
+        if (max_edits < 0) {
+            ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                errmsg("maximal number of edits should not be negative")));
+        }
+    }
+
+    int64 distance = compute_edit_distance(a, b, max_edits);
+    PG_FREE_IF_COPY(a, 0);
+    PG_FREE_IF_COPY(b, 1);
+    PG_RETURN_INT32((int32) Min(distance, PG_INT32_MAX));
+}
+
+/**
+ * @brief Postgres function to find the approximate occurrences of a pattern in a DNA sequence, i.e. the
+ * substrings within max_edits substitutions, insertions and deletions of the pattern, with Myers'
+ * bit-parallel algorithm in O(ceil(m / 64) * n) for a pattern of length m and a sequence of length n.
+ * An IUPAC ambiguity code only matches itself.
+ *
+ * @param dna The DNA object.
+ * @param pattern The DNA object of the pattern.
+ * @param max_edits The maximal number of edits.
+ * @return A set of (end_pos, edits) rows: the (1-based) position of the last nucleotide of each
+ * occurrence, and the smallest number of edits of an occurrence ending there.
+ */
+PG_FUNCTION_INFO_V1(dna_approx_find);
+Datum dna_approx_find(PG_FUNCTION_ARGS) {
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+    DNA* dna = PG_GETARG_BYTEA_P(0);
+    DNA* pattern = PG_GETARG_BYTEA_P(1);
+    int32 max_edits = PG_GETARG_INT32(2);
+    if (max_edits < 0) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("maximal number of edits should not be negative")));
+    }
+
+    InitMaterializedSRF(fcinfo, MAT_SRF_USE_EXPECTED_DESC);
+
+    MyersState state;
+    DnaSymbolReader reader;
+    Datum values[2];
+    bool nulls[2] = {false, false};
+
+    init_myers_state(&state, pattern, true);
+    init_dna_symbol_reader(&reader, dna);
+    for (uint32_t j = 1; j <= reader.length; j++) {
+        CHECK_FOR_INTERRUPTS();
+        advance_myers_state(&state, read_next_dna_symbol(&reader));
+        int64 edits = state.scores[state.nb_blocks - 1];
+        if (edits <= max_edits) {
+            values[0] = Int64GetDatum((int64) j);
+            values[1] = Int32GetDatum((int32) edits);
+            tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+        }
+    }
+    free_myers_state(&state);
+    PG_FREE_IF_COPY(dna, 0);
+    PG_FREE_IF_COPY(pattern, 1);
+    return (Datum) 0;
+}
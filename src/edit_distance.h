@@ -0,0 +1,103 @@
+#ifndef EDIT_DISTANCE_H
+#define EDIT_DISTANCE_H
+
+#include "dna.h"
+#include <stdint.h>
+#include <string.h>
+#include "port/pg_bitutils.h"
+#include "utils/memutils.h"
+
+/*
+ * Symbols of the alignments: the nucleotides A, C, G, T (0 to 3), then the IUPAC ambiguity codes,
+ * 4 + (code - 'A'). An ambiguity code only matches itself, e.g. N does not match A but matches N.
+ */
+#define EDIT_NB_NUCLEOTIDES 4
+#define EDIT_NB_SYMBOLS (EDIT_NB_NUCLEOTIDES + 26)
+#define EDIT_BLOCK_SIZE 64
+
+/**
+ * @brief Reader decoding the symbols of a DNA sequence one by one, from its packed nucleotides.
+ */
+typedef struct DnaSymbolReader {
+    uint32_t length;           /**< Total length of the DNA sequence */
+    uint32_t position;         /**< Position of the next symbol to read */
+    const uint8_t* nucleotides;/**< Packed nucleotides of the DNA sequence */
+    const uint8_t* header;     /**< Data of the DNA object, holding the exception runs */
+    uint32_t nb_exceptions;    /**< Number of exception runs of the DNA sequence */
+    uint32_t next_exception;   /**< Index of the next exception run */
+    uint32_t exception_start;  /**< Start of the current exception run, UINT32_MAX if there is none */
+    uint32_t exception_end;    /**< End (excluded) of the current exception run, UINT32_MAX if there is none */
+    uint8_t exception_symbol;  /**< Symbol of the current exception run */
+} DnaSymbolReader;
+
+/**
+ * @brief State of Myers' bit-parallel edit distance computation (in Hyyrö's formulation), the
+ * pattern being split into blocks of 64 rows of the dynamic programming matrix.
+ *
+ * Each block holds, as bit-vectors, the vertical differences of its column between consecutive
+ * rows (+1 in pv, -1 in mv), and the score at its last row.
+ */
+typedef struct MyersState {
+    uint32_t length;           /**< Length m of the pattern */
+    uint32_t nb_blocks;        /**< Number of blocks, ceil(m / 64) */
+    uint64_t last_bit;         /**< Bit of the last row (m) in the last block */
+    bool search;               /**< Whether the pattern may start anywhere in the text (D[0][j] = 0) */
+    uint32_t column;           /**< Number of text symbols read */
+    uint64_t* peq;             /**< For each block and symbol, the rows of the block matching the symbol */
+    uint64_t* pv;              /**< Positive vertical differences of each block */
+    uint64_t* mv;              /**< Negative vertical differences of each block */
+    int64* scores;             /**< Score at the last row of each block */
+} MyersState;
+
+/**
+ * @brief Moves a symbol reader to the next exception run, if any.
+ *
+ * @param reader The symbol reader.
+ */
+static inline void load_next_symbol_exception(DnaSymbolReader* reader) {
+    DnaException exception;
+    if (reader->next_exception < reader->nb_exceptions) {
+        get_dna_exception(reader->header, reader->next_exception++, &exception);
+        reader->exception_start = exception.start;
+        reader->exception_end = exception.start + exception.length;
+        reader->exception_symbol = EDIT_NB_NUCLEOTIDES + (uint8_t) (exception.code - 'A');
+    } else {
+        reader->exception_start = UINT32_MAX;
+        reader->exception_end = UINT32_MAX;
+    }
+}
+
+/**
+ * @brief Initializes a symbol reader at the start of a DNA sequence.
+ *
+ * @param reader The DnaSymbolReader object to initialize.
+ * @param dna The DNA object.
+ */
+static inline void init_dna_symbol_reader(DnaSymbolReader* reader, DNA* dna) {
+    reader->length = get_dna_sequence_length(dna);
+    reader->position = 0;
+    reader->nucleotides = get_dna_nucleotides(dna);
+    reader->header = (uint8_t*) VARDATA(dna);
+    reader->nb_exceptions = get_dna_nb_exceptions(reader->header);
+    reader->next_exception = 0;
+    load_next_symbol_exception(reader);
+}
+
+/**
+ * @brief Reads the next symbol of a DNA sequence, which must not be exhausted.
+ *
+ * @param reader The symbol reader.
+ * @return The symbol.
+ */
+static inline uint8_t read_next_dna_symbol(DnaSymbolReader* reader) {
+    uint32_t position = reader->position++;
+    while (unlikely(position >= reader->exception_end)) {
+        load_next_symbol_exception(reader);
+    }
+    if (unlikely(position >= reader->exception_start)) {
+        return reader->exception_symbol;
+    }
+    return (reader->nucleotides[position / 4] >> (6 - (position % 4) * 2)) & 0b11;
+}
+
+#endif
@@ -0,0 +1,485 @@
+#include "fasta.h"
+
+#define READER_BUFFER_SIZE (256 * 1024)
+
+/**
+ * @brief Formats of sequence files.
+ */
+typedef enum SequenceFileFormat {
+    FORMAT_FASTA,
+    FORMAT_FASTQ
+} SequenceFileFormat;
+
+/**
+ * @brief What the reader is currently parsing.
+ */
+typedef enum ReaderMode {
+    MODE_LINE_START,        /**< The beginning of a line */
+    MODE_HEADER,            /**< A header line (after '>' or '@') */
+    MODE_SEQUENCE,          /**< A line of nucleotides */
+    MODE_SKIP_LINE,         /**< A comment line (FASTA ';') or a separator line (FASTQ '+') */
+    MODE_QUALITY            /**< The quality scores of a FASTQ record */
+} ReaderMode;
+
+/**
+ * @brief Structure used to store the state of a sequence file reader.
+ *
+ * The file is read through a fixed-size buffer and the nucleotides are packed as they are read, so
+ * memory usage only depends on the size of the rows returned (bounded by chunk_size when it is set).
+ */
+typedef struct SequenceReaderState {
+    SequenceFileFormat format;  /**< Format of the file */
+    char* path;                 /**< Path of the file */
+    FILE* file;                 /**< The file, NULL once closed */
+    char* buffer;               /**< Buffer holding the bytes read from the file */
+    size_t buffer_len;          /**< Number of bytes held by the buffer */
+    size_t buffer_pos;          /**< Position of the next byte to parse in the buffer */
+    ReaderMode mode;            /**< What is currently parsed */
+    int64 line_number;          /**< Number of the line currently parsed (1-based) */
+    bool in_record;             /**< Whether a record has been started and not returned yet */
+    bool in_separator;          /**< Whether the separator line of a FASTQ record is parsed */
+    StringInfoData header;      /**< Header of the current record */
+    DnaBuilder builder;         /**< Nucleotides of the current chunk */
+    uint64 record_length;       /**< Number of nucleotides of the current record read so far */
+    uint64 chunk_start;         /**< Position of the first nucleotide of the current chunk in the record */
+    uint64 quality_remaining;   /**< Number of quality scores of the current FASTQ record left to skip */
+    uint32_t chunk_size;        /**< Maximal number of nucleotides per row, 0 for whole records */
+    ExprContext* econtext;      /**< Expression context to which the shutdown callback is registered */
+} SequenceReaderState;
+
+
+/**
+ * @brief Error context callback giving the position in the sequence file.
+ *
+ * @param arg The sequence reader state.
+ */
+static void sequence_reader_error_callback(void* arg) {
+    SequenceReaderState* state = (SequenceReaderState*) arg;
+    errcontext("%s file \"%s\", line " INT64_FORMAT,
+               state->format == FORMAT_FASTA ? "FASTA" : "FASTQ", state->path, state->line_number);
+}
+
+/**
+ * @brief Closes the sequence file if it is still open.
+ * Also registered as a shutdown callback, for queries that stop reading the rows early.
+ *
+ * @param arg The sequence reader state.
+ */
+static void close_sequence_file(Datum arg) {
+    SequenceReaderState* state = (SequenceReaderState*) DatumGetPointer(arg);
+    if (state->file != NULL) {
+        FreeFile(state->file);
+        state->file = NULL;
+    }
+}
+
+/**
+ * @brief Reads the next block of the sequence file into the buffer.
+ *
+ * @param state The sequence reader state.
+ * @return Whether bytes were read, false at the end of the file.
+ */
+static bool fill_reader_buffer(SequenceReaderState* state) {
+    state->buffer_len = fread(state->buffer, 1, READER_BUFFER_SIZE, state->file);
+    state->buffer_pos = 0;
+    if (state->buffer_len == 0 && ferror(state->file)) {
+        ereport(ERROR, (errcode_for_file_access(),
+            errmsg("could not read file \"%s\": %m", state->path)));
+    }
+    return state->buffer_len > 0;
+}
+
+/**
+ * @brief Fills the values of the row holding the current chunk, and empties the chunk.
+ *
+ * @param state The sequence reader state.
+ * @param values The values of the row (header, seq, pos).
+ * @param nulls The null flags of the row.
+ */
+static void make_sequence_row(SequenceReaderState* state, Datum* values, bool* nulls) {
+    values[0] = PointerGetDatum(cstring_to_text_with_len(state->header.data, state->header.len));
+    nulls[0] = false;
+    nulls[1] = state->builder.length == 0;                              // a DNA sequence cannot be empty
+    values[1] = nulls[1] ? (Datum) 0 : PointerGetDatum(build_dna(&state->builder));
+    values[2] = Int64GetDatum(state->chunk_start + 1);
+    nulls[2] = false;
+
+    state->chunk_start += state->builder.length;
+    reset_dna_builder(&state->builder);
+}
+
+/**
+ * @brief Ends the current record, and fills the row holding its last chunk.
+ * Records without nucleotides give a row with a NULL sequence, unless they were already split in chunks.
+ *
+ * @param state The sequence reader state.
+ * @param values The values of the row (header, seq, pos).
+ * @param nulls The null flags of the row.
+ * @return Whether a row was filled.
+ */
+static bool end_sequence_record(SequenceReaderState* state, Datum* values, bool* nulls) {
+    bool has_row = state->builder.length > 0 || state->chunk_start == 0;
+    if (has_row) {
+        make_sequence_row(state, values, nulls);
+    }
+    state->in_record = false;
+    state->record_length = 0;
+    state->chunk_start = 0;
+    return has_row;
+}
+
+/**
+ * @brief Starts a new record, whose header follows.
+ *
+ * @param state The sequence reader state.
+ */
+static void start_sequence_record(SequenceReaderState* state) {
+    resetStringInfo(&state->header);
+    state->buffer_pos++;                                                // skip '>' or '@'
+    state->in_record = true;
+    state->mode = MODE_HEADER;
+}
+
+/**
+ * @brief Ends the header line of the current record.
+ *
+ * @param state The sequence reader state.
+ */
+static void end_header(SequenceReaderState* state) {
+    if (state->header.len > 0 && state->header.data[state->header.len - 1] == '\r') {
+        state->header.data[--state->header.len] = '\0';
+    }
+    state->mode = MODE_LINE_START;
+}
+
+/**
+ * @brief Parses the beginning of a line.
+ *
+ * @param state The sequence reader state.
+ * @param values The values of the row (header, seq, pos).
+ * @param nulls The null flags of the row.
+ * @return Whether a row was filled (at the start of a FASTA record ending the previous one).
+ */
+static bool parse_line_start(SequenceReaderState* state, Datum* values, bool* nulls) {
+    char c = state->buffer[state->buffer_pos];
+    if (c == '\n' || c == '\r') {                                       // empty line
+        state->line_number += c == '\n';
+        state->buffer_pos++;
+        return false;
+    }
+
+    if (state->format == FORMAT_FASTA) {
+        if (c == '>') {
+            if (state->in_record) {
+                return end_sequence_record(state, values, nulls);       // the '>' is parsed again afterwards
+            }
+            start_sequence_record(state);
+        } else if (c == ';') {
+            state->mode = MODE_SKIP_LINE;
+        } else if (!state->in_record) {
+            ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+                errmsg("FASTA record should start with '>'")));
+        } else {
+            state->mode = MODE_SEQUENCE;
+        }
+    } else {
+        if (!state->in_record) {
+            if (c != '@') {
+                ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+                    errmsg("FASTQ record should start with '@'")));
+            }
+            start_sequence_record(state);
+        } else if (c == '+') {
+            state->in_separator = true;
+            state->quality_remaining = state->record_length;
+            state->mode = MODE_SKIP_LINE;
+        } else {
+            state->mode = MODE_SEQUENCE;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Skips the rest of a line, up to the end of the buffer.
+ *
+ * @param state The sequence reader state.
+ * @return Whether the end of the line was reached.
+ */
+static bool skip_line(SequenceReaderState* state) {
+    const char* end = memchr(state->buffer + state->buffer_pos, '\n', state->buffer_len - state->buffer_pos);
+    if (end == NULL) {
+        state->buffer_pos = state->buffer_len;
+        return false;
+    }
+    state->buffer_pos = end - state->buffer + 1;
+    state->line_number++;
+    return true;
+}
+
+/**
+ * @brief Gets the number of bytes of the current line held by the buffer.
+ *
+ * @param state The sequence reader state.
+ * @param complete Whether the end of the line is held by the buffer.
+ * @return The number of bytes, without the end of line.
+ */
+static size_t get_line_length(SequenceReaderState* state, bool* complete) {
+    const char* start = state->buffer + state->buffer_pos;
+    const char* end = memchr(start, '\n', state->buffer_len - state->buffer_pos);
+    *complete = end != NULL;
+    return (end != NULL ? end : state->buffer + state->buffer_len) - start;
+}
+
+/**
+ * @brief Parses nucleotides of the current line, up to the end of the line, of the buffer or of the chunk.
+ *
+ * @param state The sequence reader state.
+ * @param values The values of the row (header, seq, pos).
+ * @param nulls The null flags of the row.
+ * @return Whether a row was filled (when the chunk is full).
+ */
+static bool parse_sequence(SequenceReaderState* state, Datum* values, bool* nulls) {
+    bool complete;
+    size_t length = get_line_length(state, &complete);
+    const char* nucleotides = state->buffer + state->buffer_pos;
+    size_t count = length;
+    if (count > 0 && nucleotides[count - 1] == '\r') {
+        count--;
+    }
+
+    if (state->chunk_size > 0 && count >= state->chunk_size - state->builder.length) {
+        count = state->chunk_size - state->builder.length;               // fill the chunk, the rest comes afterwards
+        append_to_dna_builder(&state->builder, nucleotides, count);
+        state->record_length += count;
+        state->buffer_pos += count;
+        make_sequence_row(state, values, nulls);
+        return true;
+    }
+
+    append_to_dna_builder(&state->builder, nucleotides, count);
+    state->record_length += count;
+    state->buffer_pos += length;
+    if (complete) {
+        state->buffer_pos++;
+        state->line_number++;
+        state->mode = MODE_LINE_START;
+    }
+    return false;
+}
+
+/**
+ * @brief Skips the quality scores of a FASTQ record, which hold as many characters as its sequence.
+ *
+ * @param state The sequence reader state.
+ * @param values The values of the row (header, seq, pos).
+ * @param nulls The null flags of the row.
+ * @return Whether a row was filled (at the end of the record).
+ */
+static bool parse_quality(SequenceReaderState* state, Datum* values, bool* nulls) {
+    while (state->quality_remaining > 0 && state->buffer_pos < state->buffer_len) {
+        char c = state->buffer[state->buffer_pos++];
+        if (c == '\n') {
+            state->line_number++;
+        } else if (c != '\r') {
+            state->quality_remaining--;
+        }
+    }
+    if (state->quality_remaining > 0) {
+        return false;
+    }
+    state->mode = MODE_LINE_START;
+    return end_sequence_record(state, values, nulls);
+}
+
+/**
+ * @brief Reads the sequence file until the next row is complete.
+ *
+ * @param state The sequence reader state.
+ * @param values The values of the row (header, seq, pos).
+ * @param nulls The null flags of the row.
+ * @return Whether a row was filled, false at the end of the file.
+ */
+static bool read_sequence_row(SequenceReaderState* state, Datum* values, bool* nulls) {
+    bool complete;
+    size_t length;
+
+    for (;;) {
+        if (state->buffer_pos == state->buffer_len && !fill_reader_buffer(state)) {
+            break;
+        }
+
+        switch (state->mode) {
+            case MODE_LINE_START:
+                if (parse_line_start(state, values, nulls)) {
+                    return true;
+                }
+                break;
+            case MODE_HEADER:
+                length = get_line_length(state, &complete);
+                appendBinaryStringInfo(&state->header, state->buffer + state->buffer_pos, length);
+                if (skip_line(state)) {
+                    end_header(state);
+                }
+                break;
+            case MODE_SEQUENCE:
+                if (parse_sequence(state, values, nulls)) {
+                    return true;
+                }
+                break;
+            case MODE_SKIP_LINE:
+                if (skip_line(state)) {
+                    state->mode = state->in_separator ? MODE_QUALITY : MODE_LINE_START;
+                    if (state->in_separator) {
+                        state->in_separator = false;
+                        if (parse_quality(state, values, nulls)) {                  // the record may be empty
+                            return true;
+                        }
+                    }
+                }
+                break;
+            case MODE_QUALITY:
+                if (parse_quality(state, values, nulls)) {
+                    return true;
+                }
+                break;
+        }
+    }
+
+    // end of the file
+    if (!state->in_record) {
+        return false;
+    }
+    if (state->mode == MODE_HEADER) {
+        end_header(state);
+    }
+    if (state->format == FORMAT_FASTQ) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+            errmsg("unexpected end of file in FASTQ record \"%s\"", state->header.data)));
+    }
+    return end_sequence_record(state, values, nulls);
+}
+
+/**
+ * @brief Initializes the state of a sequence file reader and opens the file.
+ *
+ * @param fcinfo The function call information.
+ * @param format The format of the file.
+ * @return The sequence reader state, allocated in the current memory context.
+ */
+static SequenceReaderState* init_sequence_reader(FunctionCallInfo fcinfo, SequenceFileFormat format) {
+    ReturnSetInfo* rsinfo = (ReturnSetInfo*) fcinfo->resultinfo;
+    int32 chunk_size = PG_GETARG_INT32(1);
+    if (chunk_size < 0) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("chunk size should not be negative")));
+    }
+    if (!has_privs_of_role(GetUserId(), ROLE_PG_READ_SERVER_FILES)) {
+        ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+            errmsg("permission denied to read server files"),
+            errdetail("Only roles with privileges of the \"%s\" role may read files on the server.",
+                      "pg_read_server_files")));
+    }
+
+    SequenceReaderState* state = palloc0(sizeof(SequenceReaderState));
+    state->format = format;
+    state->path = text_to_cstring(PG_GETARG_TEXT_PP(0));
+    state->chunk_size = chunk_size;
+    state->buffer = palloc(READER_BUFFER_SIZE);
+    state->mode = MODE_LINE_START;
+    state->line_number = 1;
+    initStringInfo(&state->header);
+    init_dna_builder(&state->builder);
+
+    state->file = AllocateFile(state->path, PG_BINARY_R);
+    if (state->file == NULL) {
+        ereport(ERROR, (errcode_for_file_access(),
+            errmsg("could not open file \"%s\" for reading: %m", state->path)));
+    }
+    state->econtext = rsinfo->econtext;
+    RegisterExprContextCallback(state->econtext, close_sequence_file, PointerGetDatum(state));
+    return state;
+}
+
+/**
+ * @brief Returns the records of a sequence file, one per call.
+ *
+ * @param fcinfo The function call information.
+ * @param format The format of the file.
+ * @return The next row (header, seq, pos).
+ */
+static Datum read_sequence_file(FunctionCallInfo fcinfo, SequenceFileFormat format) {
+    FuncCallContext* funcctx;
+    ReturnSetInfo* rsinfo = (ReturnSetInfo*) fcinfo->resultinfo;
+
+    if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo)) {
+        ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+            errmsg("set-valued function called in context that cannot accept a set")));
+    }
+
+    if (SRF_IS_FIRSTCALL()) {
+        MemoryContext oldcontext;
+        TupleDesc tupdesc;
+        funcctx = SRF_FIRSTCALL_INIT();
+        oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+        if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+            ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                errmsg("function returning record called in context that cannot accept type record")));
+        }
+        funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+        funcctx->user_fctx = init_sequence_reader(fcinfo, format);
+
+        MemoryContextSwitchTo(oldcontext);
+    }
+
+    funcctx = SRF_PERCALL_SETUP();
+    SequenceReaderState* state = (SequenceReaderState*) funcctx->user_fctx;
+    Datum values[3];
+    bool nulls[3];
+
+    ErrorContextCallback errcallback;
+    errcallback.callback = sequence_reader_error_callback;
+    errcallback.arg = state;
+    errcallback.previous = error_context_stack;
+    error_context_stack = &errcallback;
+    bool has_row = read_sequence_row(state, values, nulls);
+    error_context_stack = errcallback.previous;
+
+    if (has_row) {
+        HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+        SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+    } else {
+        UnregisterExprContextCallback(state->econtext, close_sequence_file, PointerGetDatum(state));
+        close_sequence_file(PointerGetDatum(state));
+        SRF_RETURN_DONE(funcctx);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Postgres function reading the records of a FASTA file on the server.
+ * Lines starting with ';' are comments.
+ *
+ * @param path The path of the file.
+ * @param chunk_size The maximal number of nucleotides per row, 0 to return whole records.
+ * @return A set of (header, seq, pos) rows, pos being the position of the first nucleotide of seq in the record.
+ */
+PG_FUNCTION_INFO_V1(read_fasta);
+Datum read_fasta(PG_FUNCTION_ARGS) {
+    return read_sequence_file(fcinfo, FORMAT_FASTA);
+}
+
+/**
+ * @brief Postgres function reading the records of a FASTQ file on the server.
+ * The quality scores are skipped, and may span several lines.
+ *
+ * @param path The path of the file.
+ * @param chunk_size The maximal number of nucleotides per row, 0 to return whole records.
+ * @return A set of (header, seq, pos) rows, pos being the position of the first nucleotide of seq in the record.
+ */
+PG_FUNCTION_INFO_V1(read_fastq);
+Datum read_fastq(PG_FUNCTION_ARGS) {
+    return read_sequence_file(fcinfo, FORMAT_FASTQ);
+}
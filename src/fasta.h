@@ -0,0 +1,16 @@
+#ifndef FASTA_H
+#define FASTA_H
+
+#include "dna.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "miscadmin.h"
+#include "access/htup_details.h"
+#include "catalog/pg_authid.h"
+#include "lib/stringinfo.h"
+#include "storage/fd.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+
+#endif
@@ -0,0 +1,377 @@
+#include "hll.h"
+
+/**
+ * @brief Creates an empty HyperLogLog sketch, in the current memory context.
+ *
+ * @return The HyperLogLog sketch.
+ */
+static KmerHll* make_hll(void) {
+    KmerHll* hll = palloc0(HLL_SIZE);
+    SET_VARSIZE(hll, HLL_SIZE);
+    hll->precision = HLL_PRECISION;
+    return hll;
+}
+
+/**
+ * @brief Copies a HyperLogLog sketch into a memory context.
+ *
+ * @param context The memory context.
+ * @param hll The HyperLogLog sketch.
+ * @return The copy.
+ */
+static KmerHll* copy_hll(MemoryContext context, const KmerHll* hll) {
+    KmerHll* copy = MemoryContextAlloc(context, HLL_SIZE);
+    memcpy(copy, hll, HLL_SIZE);
+    return copy;
+}
+
+/**
+ * @brief Merges a HyperLogLog sketch into another one, by keeping the largest register values.
+ *
+ * @param hll The HyperLogLog sketch receiving the other one.
+ * @param other The HyperLogLog sketch merged.
+ */
+static void merge_hll(KmerHll* hll, const KmerHll* other) {
+    for (int i = 0; i < HLL_NB_REGISTERS; i++) {
+        hll->registers[i] = Max(hll->registers[i], other->registers[i]);
+    }
+}
+
+/**
+ * @brief Computes the sigma function of Ertl's improved HyperLogLog estimator.
+ *
+ * @param x The fraction of registers equal to 0.
+ * @return sigma(x).
+ */
+static double hll_sigma(double x) {
+    double y = 1, z = x, previous;
+    if (x == 1) {
+        return INFINITY;
+    }
+    do {
+        x *= x;
+        previous = z;
+        z += x * y;
+        y += y;
+    } while (z != previous);
+    return z;
+}
+
+/**
+ * @brief Computes the tau function of Ertl's improved HyperLogLog estimator.
+ *
+ * @param x The fraction of registers not at their maximal value.
+ * @return tau(x).
+ */
+static double hll_tau(double x) {
+    double y = 1, z = 1 - x, previous;
+    if (x == 0 || x == 1) {
+        return 0;
+    }
+    do {
+        x = sqrt(x);
+        previous = z;
+        y *= 0.5;
+        z -= (1 - x) * (1 - x) * y;
+    } while (z != previous);
+    return z / 3;
+}
+
+/**
+ * @brief Estimates the number of distinct K-mers added to a HyperLogLog sketch.
+ *
+ * Uses the improved estimator of Ertl ("New cardinality estimation algorithms for HyperLogLog
+ * sketches", 2017), which is unbiased over the whole range of cardinalities without the switch to
+ * linear counting and the empirical bias correction of the original estimator.
+ *
+ * @param hll The HyperLogLog sketch.
+ * @return The estimated number of distinct K-mers.
+ */
+static int64 estimate_hll_cardinality(const KmerHll* hll) {
+    const int q = 64 - HLL_PRECISION;
+    const double m = HLL_NB_REGISTERS;
+    uint32_t histogram[64 - HLL_PRECISION + 2] = {0};
+    for (int i = 0; i < HLL_NB_REGISTERS; i++) {
+        histogram[hll->registers[i]]++;
+    }
+    double z = m * hll_tau(1 - histogram[q + 1] / m);
+    for (int k = q; k >= 1; k--) {
+        z = 0.5 * (z + histogram[k]);
+    }
+    z += m * hll_sigma(histogram[0] / m);
+    return (int64) llround(m * m / (2 * M_LN2) / z);
+}
+
+/**
+ * @brief Checks the HyperLogLog sketch read by the input and receive functions.
+ *
+ * @param hll The HyperLogLog sketch.
+ * @param sqlerrcode The error code to report.
+ */
+static void check_hll(const KmerHll* hll, int sqlerrcode) {
+    for (int i = 0; i < HLL_NB_REGISTERS; i++) {
+        if (hll->registers[i] > 64 - HLL_PRECISION + 1) {
+            ereport(ERROR, (errcode(sqlerrcode),
+                errmsg("invalid kmer_hll register value: %u", hll->registers[i])));
+        }
+    }
+}
+
+/**
+ * @brief Gets the state of a HyperLogLog aggregate, creating it in the aggregate context for the first row.
+ *
+ * @param fcinfo The function call information.
+ * @return The HyperLogLog sketch.
+ */
+static KmerHll* get_hll_agg_state(FunctionCallInfo fcinfo) {
+    MemoryContext context = get_aggregate_context(fcinfo, "kmer_hll aggregate");
+    if (PG_ARGISNULL(0)) {
+        MemoryContext old_context = MemoryContextSwitchTo(context);
+        KmerHll* hll = make_hll();
+        MemoryContextSwitchTo(old_context);
+        return hll;
+    }
+    return (KmerHll*) PG_GETARG_POINTER(0);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Postgres input function for HyperLogLog sketch.
+ *
+ * @param str The input string: \x followed by the precision and the registers, in hexadecimal.
+ * @return The HyperLogLog sketch created from the input string.
+ */
+PG_FUNCTION_INFO_V1(hll_in);
+Datum hll_in(PG_FUNCTION_ARGS) {
+    char* str = PG_GETARG_CSTRING(0);
+    size_t length = strlen(str);
+    if (length != 2 + 2 * (HLL_SIZE - VARHDRSZ) || str[0] != '\\' || str[1] != 'x') {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+            errmsg("invalid input syntax for type kmer_hll")));
+    }
+    KmerHll* hll = make_hll();
+    hex_decode(str + 2, length - 2, (char*) hll + VARHDRSZ);
+    if (hll->precision != HLL_PRECISION) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+            errmsg("unsupported kmer_hll precision: %u", hll->precision)));
+    }
+    check_hll(hll, ERRCODE_INVALID_TEXT_REPRESENTATION);
+    PG_RETURN_POINTER(hll);
+}
+
+/**
+ * @brief Postgres output function for HyperLogLog sketch.
+ *
+ * @param hll The HyperLogLog sketch.
+ * @return The string representation of the HyperLogLog sketch.
+ */
+PG_FUNCTION_INFO_V1(hll_out);
+Datum hll_out(PG_FUNCTION_ARGS) {
+    KmerHll* hll = PG_GETARG_KMER_HLL_P(0);
+    char* str = palloc(2 + 2 * (HLL_SIZE - VARHDRSZ) + 1);
+    str[0] = '\\';
+    str[1] = 'x';
+    str[2 + hex_encode((char*) hll + VARHDRSZ, HLL_SIZE - VARHDRSZ, str + 2)] = '\0';
+    PG_FREE_IF_COPY(hll, 0);
+    PG_RETURN_CSTRING(str);
+}
+
+/*
+ * Binary format of HyperLogLog sketch (used by hll_send and hll_recv):
+ *   int8    precision p (HLL_PRECISION)
+ *   2^p times int8 register
+ */
+
+/**
+ * @brief Postgres receive function for HyperLogLog sketch.
+ *
+ * @param buf The binary representation of the HyperLogLog sketch.
+ * @return The HyperLogLog sketch created from the binary representation.
+ */
+PG_FUNCTION_INFO_V1(hll_recv);
+Datum hll_recv(PG_FUNCTION_ARGS) {
+    StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
+    KmerHll* hll = make_hll();
+    uint8_t precision = pq_getmsgbyte(buf);
+    if (precision != HLL_PRECISION) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+            errmsg("unsupported kmer_hll precision: %u", precision)));
+    }
+    pq_copymsgbytes(buf, (char*) hll->registers, HLL_NB_REGISTERS);
+    check_hll(hll, ERRCODE_INVALID_BINARY_REPRESENTATION);
+    PG_RETURN_POINTER(hll);
+}
+
+/**
+ * @brief Postgres send function for HyperLogLog sketch.
+ *
+ * @param hll The HyperLogLog sketch.
+ * @return The binary representation of the HyperLogLog sketch.
+ */
+PG_FUNCTION_INFO_V1(hll_send);
+Datum hll_send(PG_FUNCTION_ARGS) {
+    KmerHll* hll = PG_GETARG_KMER_HLL_P(0);
+    StringInfoData buf;
+    pq_begintypsend(&buf);
+    pq_sendint8(&buf, hll->precision);
+    pq_sendbytes(&buf, (const char*) hll->registers, HLL_NB_REGISTERS);
+    PG_FREE_IF_COPY(hll, 0);
+    PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+/**
+ * @brief Estimates the number of distinct K-mers of a HyperLogLog sketch.
+ *
+ * @param hll The HyperLogLog sketch.
+ * @return The estimated number of distinct K-mers.
+ */
+PG_FUNCTION_INFO_V1(hll_cardinality);
+Datum hll_cardinality(PG_FUNCTION_ARGS) {
+    KmerHll* hll = PG_GETARG_KMER_HLL_P(0);
+    int64 cardinality = estimate_hll_cardinality(hll);
+    PG_FREE_IF_COPY(hll, 0);
+    PG_RETURN_INT64(cardinality);
+}
+
+/**
+ * @brief Merges two HyperLogLog sketches.
+ *
+ * @param hll1 The first HyperLogLog sketch.
+ * @param hll2 The second HyperLogLog sketch.
+ * @return The HyperLogLog sketch of the K-mers of both.
+ */
+PG_FUNCTION_INFO_V1(hll_union);
+Datum hll_union(PG_FUNCTION_ARGS) {
+    KmerHll* hll1 = PG_GETARG_KMER_HLL_P(0);
+    KmerHll* hll2 = PG_GETARG_KMER_HLL_P(1);
+    KmerHll* result = copy_hll(CurrentMemoryContext, hll1);
+    merge_hll(result, hll2);
+    PG_FREE_IF_COPY(hll1, 0);
+    PG_FREE_IF_COPY(hll2, 1);
+    PG_RETURN_POINTER(result);
+}
+
+/**
+ * @brief Transition function of the kmer_hll(kmer) aggregate: adds a K-mer to the sketch.
+ *
+ * @param state The HyperLogLog sketch (NULL for the first row).
+ * @param kmer The K-mer.
+ * @return The HyperLogLog sketch.
+ */
+PG_FUNCTION_INFO_V1(hll_add_kmer_transfn);
+Datum hll_add_kmer_transfn(PG_FUNCTION_ARGS) {
+    KmerHll* hll = get_hll_agg_state(fcinfo);
+    if (!PG_ARGISNULL(1)) {
+        Kmer kmer = PG_GETARG_KMER(1);
+        add_hash_to_hll(hll, get_kmer_hll_hash(kmer.value, kmer.k));
+    }
+    PG_RETURN_POINTER(hll);
+}
+
+/**
+ * @brief Transition function of the kmer_hll(dna, k) and approx_distinct_kmers(dna, k) aggregates:
+ * adds the K-mers of a DNA sequence to the sketch. The K-mers overlapping an IUPAC ambiguity code are skipped.
+ *
+ * @param state The HyperLogLog sketch (NULL for the first row).
+ * @param dna The DNA object.
+ * @param kmer_length The length of the K-mers.
+ * @return The HyperLogLog sketch.
+ */
+PG_FUNCTION_INFO_V1(hll_add_dna_transfn);
+Datum hll_add_dna_transfn(PG_FUNCTION_ARGS) {
+    KmerHll* hll = get_hll_agg_state(fcinfo);
+    if (!PG_ARGISNULL(1) && !PG_ARGISNULL(2)) {
+        uint8_t kmer_length = check_kmer_length(PG_GETARG_INT32(2));
+        DNA* dna = PG_GETARG_BYTEA_P(1);
+        KmerGeneratorState generator;
+        uint64_t value;
+        init_kmer_generator_state(&generator, dna, kmer_length, false);
+        while (next_kmer_value(&generator, &value)) {
+            add_hash_to_hll(hll, get_kmer_hll_hash(value, kmer_length));
+        }
+        PG_FREE_IF_COPY(dna, 1);
+    }
+    PG_RETURN_POINTER(hll);
+}
+
+/**
+ * @brief Transition function of the hll_union_agg aggregate: merges a HyperLogLog sketch into the state.
+ *
+ * @param state The HyperLogLog sketch (NULL for the first row).
+ * @param hll The HyperLogLog sketch to merge.
+ * @return The HyperLogLog sketch.
+ */
+PG_FUNCTION_INFO_V1(hll_union_transfn);
+Datum hll_union_transfn(PG_FUNCTION_ARGS) {
+    KmerHll* hll = get_hll_agg_state(fcinfo);
+    if (!PG_ARGISNULL(1)) {
+        KmerHll* other = PG_GETARG_KMER_HLL_P(1);
+        merge_hll(hll, other);
+        PG_FREE_IF_COPY(other, 1);
+    }
+    PG_RETURN_POINTER(hll);
+}
+
+/**
+ * @brief Combine function of the HyperLogLog aggregates: merges two sketches.
+ *
+ * @param state1 The first HyperLogLog sketch (possibly NULL), which receives the other one.
+ * @param state2 The second HyperLogLog sketch (possibly NULL).
+ * @return The merged HyperLogLog sketch.
+ */
+PG_FUNCTION_INFO_V1(hll_combinefn);
+Datum hll_combinefn(PG_FUNCTION_ARGS) {
+    MemoryContext context = get_aggregate_context(fcinfo, "kmer_hll aggregate");
+    KmerHll* hll1 = PG_ARGISNULL(0) ? NULL : (KmerHll*) PG_GETARG_POINTER(0);
+    KmerHll* hll2 = PG_ARGISNULL(1) ? NULL : (KmerHll*) PG_GETARG_POINTER(1);
+    if (hll2 == NULL) {
+        if (hll1 == NULL) {
+            PG_RETURN_NULL();
+        }
+        PG_RETURN_POINTER(hll1);
+    }
+    if (hll1 == NULL) {
+        PG_RETURN_POINTER(copy_hll(context, hll2));
+    }
+    merge_hll(hll1, hll2);
+    PG_RETURN_POINTER(hll1);
+}
+
+/**
+ * @brief Serialization function of the HyperLogLog aggregates, also the final function of the
+ * aggregates returning a sketch.
+ *
+ * @param state The HyperLogLog sketch.
+ * @return A copy of the HyperLogLog sketch.
+ */
+PG_FUNCTION_INFO_V1(hll_serialfn);
+Datum hll_serialfn(PG_FUNCTION_ARGS) {
+    KmerHll* hll = (KmerHll*) PG_GETARG_POINTER(0);
+    PG_RETURN_POINTER(copy_hll(CurrentMemoryContext, hll));
+}
+
+/**
+ * @brief Deserialization function of the HyperLogLog aggregates.
+ *
+ * @param serialized The HyperLogLog sketch.
+ * @return A copy of the HyperLogLog sketch in the aggregate context.
+ */
+PG_FUNCTION_INFO_V1(hll_deserialfn);
+Datum hll_deserialfn(PG_FUNCTION_ARGS) {
+    MemoryContext context = get_aggregate_context(fcinfo, "kmer_hll aggregate");
+    KmerHll* hll = PG_GETARG_KMER_HLL_P(0);
+    PG_RETURN_POINTER(copy_hll(context, hll));
+}
+
+/**
+ * @brief Final function of the approx_distinct_kmers aggregate.
+ *
+ * @param state The HyperLogLog sketch.
+ * @return The estimated number of distinct K-mers.
+ */
+PG_FUNCTION_INFO_V1(hll_cardinality_finalfn);
+Datum hll_cardinality_finalfn(PG_FUNCTION_ARGS) {
+    KmerHll* hll = (KmerHll*) PG_GETARG_POINTER(0);
+    PG_RETURN_INT64(estimate_hll_cardinality(hll));
+}
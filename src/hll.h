@@ -0,0 +1,58 @@
+#ifndef HLL_H
+#define HLL_H
+
+#include "dna.h"
+#include "util.h"
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "port/pg_bitutils.h"
+#include "utils/builtins.h"
+
+#define HLL_PRECISION 14
+#define HLL_NB_REGISTERS (1 << HLL_PRECISION)
+
+/**
+ * @typedef KmerHll
+ * @brief HyperLogLog sketch estimating the number of distinct K-mers.
+ *
+ * The first HLL_PRECISION bits of the hash of a K-mer select a register, which keeps the largest
+ * position of the first 1 bit among the remaining bits of the hashes it saw.
+ */
+typedef struct KmerHll {
+    int32 vl_len_;          /**< Varlena header (do not touch directly) */
+    uint8_t precision;      /**< Number of bits selecting a register (HLL_PRECISION) */
+    uint8_t registers[FLEXIBLE_ARRAY_MEMBER];  /**< The 2^precision registers */
+} KmerHll;
+
+#define HLL_SIZE (offsetof(KmerHll, registers) + HLL_NB_REGISTERS)
+#define DatumGetKmerHllP(X) ((KmerHll*) PG_DETOAST_DATUM(X))
+#define PG_GETARG_KMER_HLL_P(n) DatumGetKmerHllP(PG_GETARG_DATUM(n))
+
+/**
+ * @brief Hashes a K-mer for the HyperLogLog sketches, directly from its 2-bit value.
+ *
+ * @param value The value of the K-mer.
+ * @param k The length of the K-mer, so that e.g. A and AA do not collide.
+ * @return The hash of the K-mer.
+ */
+static inline uint64_t get_kmer_hll_hash(uint64_t value, uint8_t k) {
+    return hash_combine64(k, murmurhash64(value));
+}
+
+/**
+ * @brief Adds a hash to a HyperLogLog sketch.
+ *
+ * @param hll The HyperLogLog sketch.
+ * @param hash The hash.
+ */
+static inline void add_hash_to_hll(KmerHll* hll, uint64_t hash) {
+    uint32_t index = hash >> (64 - HLL_PRECISION);
+    uint64_t remaining = hash << HLL_PRECISION;
+    uint8_t rank = remaining == 0 ? 64 - HLL_PRECISION + 1 : 64 - pg_leftmost_one_pos64(remaining);   // leading zeros + 1
+    if (rank > hll->registers[index]) {
+        hll->registers[index] = rank;
+    }
+}
+
+#endif
@@ -9,12 +9,7 @@
 #include "utils/elog.h"
 #include "utils/varlena.h"
 #include "varatt.h"
-
-// Define macros for Kmer because we use a struct to represent a Kmer
-#define DatumGetKmerP(X)  ((Kmer *) DatumGetPointer(X))
-#define KmerPGetDatum(X)  PointerGetDatum(X)
-#define PG_GETARG_KMER_P(n) DatumGetKmerP(PG_GETARG_DATUM(n))
-#define PG_RETURN_KMER_P(x) return KmerPGetDatum(x)
+#include "port/pg_bitutils.h"
 
 // Define macros for Qkmer because we use a struct to represent a Qkmer
 #define DatumGetQkmerP(X)  ((Qkmer *) DatumGetPointer(X))
@@ -30,13 +25,53 @@ typedef bytea DNA;
 
 /**
  * @typedef Kmer
- * @brief Structure used to store a K-mer.
+ * @brief Structure used to work on a K-mer, unpacked from its Datum.
  */
 typedef struct Kmer {
 	uint64_t value;	  /**< The value of the K-mer */
 	uint8_t k;        /**< The length of the K-mer */
 } Kmer;
 
+/*
+ * A K-mer is passed by value, as an 8-byte Datum holding its value with a sentinel bit set just
+ * above it (bit 2 * k), so that its length is given by the highest bit set. This leaves room for
+ * K-mers of up to 31 nucleotides. The empty K-mers (the empty suffixes of the SP-GiST index) are
+ * the sentinel alone, and the Datum 0 (e.g. the reconstructed value at the root of the index) is
+ * read as an empty K-mer as well.
+ */
+#define KMER_MAX_LENGTH 31
+
+#if SIZEOF_DATUM < 8
+#error "the kmer type needs 8-byte Datums"
+#endif
+
+/**
+ * @brief Unpacks a K-mer from its Datum.
+ *
+ * @param datum The Datum.
+ * @return The K-mer.
+ */
+static inline Kmer DatumGetKmer(Datum datum) {
+	uint64_t bits = DatumGetUInt64(datum);
+	Kmer kmer;
+	kmer.k = bits == 0 ? 0 : pg_leftmost_one_pos64(bits) / 2;
+	kmer.value = bits & ((1ULL << (2 * kmer.k)) - 1);
+	return kmer;
+}
+
+/**
+ * @brief Packs a K-mer in a Datum.
+ *
+ * @param kmer The K-mer, of at most KMER_MAX_LENGTH nucleotides.
+ * @return The Datum.
+ */
+static inline Datum KmerGetDatum(Kmer kmer) {
+	return UInt64GetDatum(kmer.value | (1ULL << (2 * kmer.k)));
+}
+
+#define PG_GETARG_KMER(n) DatumGetKmer(PG_GETARG_DATUM(n))
+#define PG_RETURN_KMER(x) return KmerGetDatum(x)
+
 /**
  * @typedef Qkmer
  * @brief Structure used to store a Q-kmer.
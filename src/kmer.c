@@ -1,4 +1,13 @@
 #include "kmer.h"
+#include "access/stratnum.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_opfamily.h"
+#include "catalog/pg_type.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "nodes/supportnodes.h"
+#include "utils/lsyscache.h"
+#include "utils/syscache.h"
 
 
 /**
@@ -6,16 +15,16 @@
  * 
  * @param str The string representing the K-mer.
  * @param length The length of the K-mer.
- * @return A pointer to the created K-mer.
+ * @return The created K-mer.
 */
-static Kmer* make_kmer(const char *str, uint8_t length) {
-	Kmer* kmer = palloc0(sizeof(Kmer));
-	kmer -> k = length;
-	kmer -> value = 0;
+static Kmer make_kmer(const char *str, uint8_t length) {
+	Kmer kmer;
+	kmer.k = length;
+	kmer.value = 0;
 
 	for (uint8_t i = 0; i < length; i++) {
 		char c = str[i];
-		add_nucleotide_to_uint(kmer -> value, c);
+		add_nucleotide_to_uint(kmer.value, c);
 	}
 	return kmer;
 }
@@ -24,14 +33,14 @@ static Kmer* make_kmer(const char *str, uint8_t length) {
  * @brief Parses a K-mer from a string.
  * 
  * @param str The string representing the K-mer to parse.
- * @return A pointer to the K-mer created from the string.
+ * @return The K-mer created from the string.
  */
-static Kmer* kmer_parse(const char* str) {
-	uint8_t length = strlen(str);
+static Kmer kmer_parse(const char* str) {
+	size_t length = strlen(str);
 	//! elog(INFO, "kmer length (kmer_parse): %d", length);
-	if (length > 32) {
+	if (length > KMER_MAX_LENGTH) {
 		ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
-      	errmsg("kmer should not exceed 32 nucleotides")));
+      	errmsg("kmer should not exceed %d nucleotides", KMER_MAX_LENGTH)));
 	} else if (length == 0) {
 		ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
 	  	errmsg("kmer should not be empty")));
@@ -46,17 +55,12 @@ static Kmer* kmer_parse(const char* str) {
  * @return The string representation of the K-mer.
  */
 static char* kmer_value_to_string(Kmer* kmer) {
-	char str[32];
-	//! elog(INFO, "kmer value (kmer_value_to_string): %lu", kmer -> value);
-	for (uint8_t i = 0; i < kmer -> k; i++) {
-        uint8_t shift = (kmer -> k - i - 1) * 2;
-        uint8_t nucleotide = (kmer -> value >> shift) & 0b11;
-
-		str[i] = BINARY_TO_NUCLEOTIDE[nucleotide];
-    }
-	str[kmer->k] = '\0';
-	return psprintf("%s", str);
+	char* str = palloc(kmer -> k + 1);
+	unpack_kmer_value(kmer -> value, kmer -> k, str);
+	str[kmer -> k] = '\0';
+	return str;
 }
+
 /**
  * @brief Checks if a K-mer starts with a prefix.
  * 
@@ -79,13 +83,13 @@ bool internal_kmer_startswith(Kmer* kmer, Kmer* prefix) {
  * @param k The number of nucleotides to get.
  * @return The K-mer with the first k nucleotides.
  */
-Kmer* get_first_k_nucleotides(Kmer* kmer, uint8_t k) {
+Kmer get_first_k_nucleotides(Kmer* kmer, uint8_t k) {
     if (k > kmer->k) {
         ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("k cannot be greater than the K-mer size")));
     }
-    Kmer* first_kmer = palloc0(sizeof(Kmer));
-    first_kmer->k = k;
-    first_kmer->value = kmer->value >> (2 * (kmer->k - k));
+    Kmer first_kmer;
+    first_kmer.k = k;
+    first_kmer.value = kmer->value >> (2 * (kmer->k - k));
     return first_kmer;
 }
 
@@ -96,10 +100,10 @@ Kmer* get_first_k_nucleotides(Kmer* kmer, uint8_t k) {
  * @param k The number of nucleotides to get.
  * @return The K-mer with the last k nucleotides.
  */
-Kmer* get_last_k_nucleotides(Kmer* kmer, uint8_t k) {
-    Kmer* last_kmer = palloc0(sizeof(Kmer));
-    last_kmer->k = k;
-    last_kmer->value = kmer->value & ((1ULL << (2 * k)) - 1);
+Kmer get_last_k_nucleotides(Kmer* kmer, uint8_t k) {
+    Kmer last_kmer;
+    last_kmer.k = k;
+    last_kmer.value = kmer->value & ((1ULL << (2 * k)) - 1);
     return last_kmer;
 }
 
@@ -147,40 +151,82 @@ uint8_t get_common_prefix_len(Kmer* kmer1, Kmer* kmer2) {
  * @return The comparison result, -1 if kmer1 < kmer2, 0 if kmer1 == kmer2, 1 if kmer1 > kmer2.
  */
 int compare_kmers(Kmer* kmer1, Kmer* kmer2, uint8_t n) {
-    Kmer* first_kmer1 = get_first_k_nucleotides(kmer1, n);
-    Kmer* first_kmer2 = get_first_k_nucleotides(kmer2, n);
+    Kmer first_kmer1 = get_first_k_nucleotides(kmer1, n);
+    Kmer first_kmer2 = get_first_k_nucleotides(kmer2, n);
 
     int result = 0;
-    if (first_kmer1->value < first_kmer2->value) {
+    if (first_kmer1.value < first_kmer2.value) {
         result = -1;
-    } else if (first_kmer1->value > first_kmer2->value) {
+    } else if (first_kmer1.value > first_kmer2.value) {
         result = 1;
     }
-    pfree(first_kmer1);
-    pfree(first_kmer2);
     return result;
 }
 
 /**
- * @brief Function to compute the canonical form of a K-mer.
+ * @brief Compares two K-mers in lexicographic order of their nucleotides, a K-mer coming after its
+ * prefixes (like compare_kmers on their common length, then by length).
+ * 
+ * @param kmer1 The first K-mer.
+ * @param kmer2 The second K-mer.
+ * @return -1 if kmer1 < kmer2, 0 if kmer1 == kmer2, 1 if kmer1 > kmer2.
+ */
+static inline int compare_kmer_order(Kmer kmer1, Kmer kmer2) {
+	uint64_t key1 = get_kmer_sort_key(kmer1);
+	uint64_t key2 = get_kmer_sort_key(kmer2);
+	if (key1 != key2) {
+		return key1 < key2 ? -1 : 1;                   // the K-mers differ before the end of the shorter one
+	}
+	return (kmer1.k > kmer2.k) - (kmer1.k < kmer2.k);  // one is a prefix of the other (padded with A)
+}
+
+/**
+ * @brief Computes the Hamming distance of two K-mers, aligned on their first nucleotide.
+ * The nucleotides of the longer K-mer past the end of the shorter one count as mismatches.
+ * 
+ * @param value1 The value of the first K-mer.
+ * @param k1 The length of the first K-mer.
+ * @param value2 The value of the second K-mer.
+ * @param k2 The length of the second K-mer.
+ * @return The number of mismatches.
+ */
+uint8_t get_kmer_distance(uint64_t value1, uint8_t k1, uint64_t value2, uint8_t k2) {
+	uint8_t n = Min(k1, k2);
+	uint8_t mismatches = count_kmer_mismatches(value1 >> (2 * (k1 - n)), value2 >> (2 * (k2 - n)));
+	return mismatches + (k1 > k2 ? k1 - k2 : k2 - k1);
+}
+
+/**
+ * @brief Computes a lower bound of the distance from a K-mer to all the K-mers starting with a prefix,
+ * e.g. to prune the branches of a trie.
+ * 
+ * @param prefix_value The value of the prefix.
+ * @param prefix_k The length of the prefix.
+ * @param value The value of the K-mer.
+ * @param k The length of the K-mer.
+ * @return The number of mismatches of any K-mer starting with the prefix.
+ */
+uint8_t get_kmer_distance_lower_bound(uint64_t prefix_value, uint8_t prefix_k, uint64_t value, uint8_t k) {
+	uint8_t n = Min(prefix_k, k);
+	if (n == 0) {
+		return 0;                                 // an empty prefix, e.g. at the root of a trie
+	}
+	uint8_t mismatches = count_kmer_mismatches(prefix_value >> (2 * (prefix_k - n)), value >> (2 * (k - n)));
+	return mismatches + (prefix_k > k ? prefix_k - k : 0);
+}
+
+/**
+ * @brief Function to compute the canonical form of a K-mer, the smallest of the K-mer and its reverse complement.
  * 
  * @param kmer The K-mer to compute the canonical form of.
  * @return The canonical form of the K-mer.
  */
-static Kmer* internal_kmer_canonical(Kmer* kmer) {
-	Kmer* canonical_kmer = palloc0(sizeof(Kmer));
-	canonical_kmer->k = kmer->k;
-	canonical_kmer->value = 0;
-
-	uint64_t complement = kmer->value ^ ((1ULL << kmer->k * 2) - 1);
-	uint64_t reverse_complement = 0;
-    for (int i = 0; i < kmer->k; i++) {
-        uint8_t byte = complement & 0b11;
-        reverse_complement <<= 2;
-        reverse_complement |= byte;
-        complement >>= 2;
-    }
-	canonical_kmer->value = Min(kmer->value, reverse_complement);
+static Kmer internal_kmer_canonical(Kmer* kmer) {
+	Kmer canonical_kmer;
+	canonical_kmer.k = kmer->k;
+
+	uint64_t reverse_complement = reverse_complement_kmer_value(kmer->value, kmer->k);
+	canonical_kmer.value = Min(kmer->value, reverse_complement);
 	return canonical_kmer;
 }
 
@@ -196,8 +242,8 @@ static Kmer* internal_kmer_canonical(Kmer* kmer) {
 PG_FUNCTION_INFO_V1(kmer_in);
 Datum kmer_in(PG_FUNCTION_ARGS) {
 	char *str = PG_GETARG_CSTRING(0);
-	Kmer* kmer = kmer_parse(str);
-	PG_RETURN_KMER_P(kmer);
+	Kmer kmer = kmer_parse(str);
+	PG_RETURN_KMER(kmer);
 }
 
 /**
@@ -208,44 +254,78 @@ Datum kmer_in(PG_FUNCTION_ARGS) {
  */
 PG_FUNCTION_INFO_V1(kmer_out);
 Datum kmer_out(PG_FUNCTION_ARGS) {
-	Kmer *kmer = PG_GETARG_KMER_P(0);
-	char *str = kmer_value_to_string(kmer);
-	PG_FREE_IF_COPY(kmer, 0);
+	Kmer kmer = PG_GETARG_KMER(0);
+	char *str = kmer_value_to_string(&kmer);
 	PG_RETURN_CSTRING(str);
 }
 
+/*
+ * Binary format of K-mer (used by kmer_send and kmer_recv):
+ *   int64   value, 2 bits per nucleotide, last nucleotide in the least significant bits
+ *   int8    length k (1-31); the bits of value above the 2 * k lowest ones must be 0
+ */
+
 /**
  * @brief Postgres receive function for K-mer.
  * 
- * @param buf The bytea representation of the K-mer.
- * @return The K-mer object created from the bytea.
+ * @param buf The binary representation of the K-mer.
+ * @return The K-mer object created from the binary representation.
  */
 PG_FUNCTION_INFO_V1(kmer_recv);
 Datum kmer_recv(PG_FUNCTION_ARGS) {
 	StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
-	Kmer *kmer = palloc0(sizeof(Kmer));
-	kmer -> value = pq_getmsgint64(buf);
-	kmer -> k = pq_getmsgint(buf, 8);
-	PG_RETURN_KMER_P(kmer);
+	Kmer kmer;
+	kmer.value = pq_getmsgint64(buf);
+	kmer.k = pq_getmsgbyte(buf);
+	if (kmer.k == 0 || kmer.k > KMER_MAX_LENGTH) {
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+		errmsg("invalid kmer length in external value: %d", kmer.k)));
+	}
+	if ((kmer.value >> (2 * kmer.k)) != 0) {
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+		errmsg("kmer value does not fit in %d nucleotides", kmer.k)));
+	}
+	PG_RETURN_KMER(kmer);
 }
 
 /**
  * @brief Postgres send function for K-mer.
  * 
  * @param kmer The K-mer object.
- * @return The bytea representation of the K-mer.
+ * @return The binary representation of the K-mer.
  */
 PG_FUNCTION_INFO_V1(kmer_send);
 Datum kmer_send(PG_FUNCTION_ARGS) {
-	Kmer *kmer = PG_GETARG_KMER_P(0);
+	Kmer kmer = PG_GETARG_KMER(0);
 	StringInfoData buf;
 	pq_begintypsend(&buf);
-	pq_sendint64(&buf, kmer -> value);
-	pq_sendint8(&buf, kmer -> k);
-	PG_FREE_IF_COPY(kmer, 0);
+	pq_sendint64(&buf, kmer.value);
+	pq_sendint8(&buf, kmer.k);
 	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
 }
 
+/*
+ * Layout of a K-mer stored by kmea 1.0, passed by reference (INTERNALLENGTH = 9):
+ *   uint64  value, 2 bits per nucleotide
+ *   uint8   length k (1-32)
+ */
+
+/**
+ * @brief Output function for the K-mers stored by kmea 1.0, only used by the update to 1.1 to
+ * convert the stored K-mers through text (see kmea--1.0--1.1.sql).
+ * 
+ * @param kmer A pointer to the K-mer, in its 1.0 layout.
+ * @return The string representation of the K-mer.
+ */
+PG_FUNCTION_INFO_V1(kmer_v10_out);
+Datum kmer_v10_out(PG_FUNCTION_ARGS) {
+	const uint8_t* data = (const uint8_t*) PG_GETARG_POINTER(0);
+	Kmer kmer;
+	memcpy(&kmer.value, data, sizeof(uint64_t));
+	kmer.k = data[sizeof(uint64_t)];
+	PG_RETURN_CSTRING(kmer_value_to_string(&kmer));
+}
+
 /**
  * @brief Postgres cast function from text to K-mer.
  * 
@@ -257,9 +337,9 @@ Datum kmer_cast_from_text(PG_FUNCTION_ARGS) {
 	text *txt = PG_GETARG_TEXT_P(0);
 	char *str = DatumGetCString(DirectFunctionCall1(textout,
 	             PointerGetDatum(txt)));
-	Kmer* kmer = kmer_parse(str);
+	Kmer kmer = kmer_parse(str);
 	PG_FREE_IF_COPY(txt, 0);
-	PG_RETURN_KMER_P(kmer);
+	PG_RETURN_KMER(kmer);
 }
 
 /**
@@ -270,10 +350,10 @@ Datum kmer_cast_from_text(PG_FUNCTION_ARGS) {
  */
 PG_FUNCTION_INFO_V1(kmer_cast_to_text);
 Datum kmer_cast_to_text(PG_FUNCTION_ARGS) {
-	Kmer* kmer  = PG_GETARG_KMER_P(0);
-	text* out = (text *)DirectFunctionCall1(textin, 
-						PointerGetDatum(kmer_value_to_string(kmer)));
-	PG_FREE_IF_COPY(kmer, 0);
+	Kmer kmer = PG_GETARG_KMER(0);
+	text* out = (text *) palloc(VARHDRSZ + kmer.k);
+	SET_VARSIZE(out, VARHDRSZ + kmer.k);
+	unpack_kmer_value(kmer.value, kmer.k, VARDATA(out));
 	PG_RETURN_TEXT_P(out);
 }
 
@@ -285,10 +365,8 @@ Datum kmer_cast_to_text(PG_FUNCTION_ARGS) {
  */
 PG_FUNCTION_INFO_V1(kmer_length);
 Datum kmer_length(PG_FUNCTION_ARGS) {
-	Kmer* kmer  = PG_GETARG_KMER_P(0);
-	uint8_t length = kmer -> k;
-	PG_FREE_IF_COPY(kmer, 0);
-	PG_RETURN_CHAR(length);
+	Kmer kmer = PG_GETARG_KMER(0);
+	PG_RETURN_CHAR(kmer.k);
 }
 
 /**
@@ -299,10 +377,8 @@ Datum kmer_length(PG_FUNCTION_ARGS) {
  */
 PG_FUNCTION_INFO_V1(kmer_canonical);
 Datum kmer_canonical(PG_FUNCTION_ARGS) {
-	Kmer* kmer = PG_GETARG_KMER_P(0);
-	Kmer* canonical_kmer = internal_kmer_canonical(kmer);
-	PG_FREE_IF_COPY(kmer, 0);
-	PG_RETURN_KMER_P(canonical_kmer);
+	Kmer kmer = PG_GETARG_KMER(0);
+	PG_RETURN_KMER(internal_kmer_canonical(&kmer));
 }
 
 /**
@@ -314,12 +390,55 @@ Datum kmer_canonical(PG_FUNCTION_ARGS) {
  */
 PG_FUNCTION_INFO_V1(kmer_eq);
 Datum kmer_eq(PG_FUNCTION_ARGS) {
-	Kmer* a = PG_GETARG_KMER_P(0);
-	Kmer* b = PG_GETARG_KMER_P(1);
-	bool result = KMER_EQUAL(a, b);
-	PG_FREE_IF_COPY(a, 0);
-	PG_FREE_IF_COPY(b, 1);
-	PG_RETURN_BOOL(result);
+	PG_RETURN_BOOL(PG_GETARG_DATUM(0) == PG_GETARG_DATUM(1));          // the packing is unique
+}
+
+/**
+ * @brief Postgres function to check if a K-mer comes before another one.
+ * 
+ * @param a The first K-mer.
+ * @param b The second K-mer.
+ * @return True if a < b in lexicographic order, false otherwise.
+ */
+PG_FUNCTION_INFO_V1(kmer_lt);
+Datum kmer_lt(PG_FUNCTION_ARGS) {
+	PG_RETURN_BOOL(compare_kmer_order(PG_GETARG_KMER(0), PG_GETARG_KMER(1)) < 0);
+}
+
+/**
+ * @brief Postgres function to check if a K-mer comes before another one or equals it.
+ * 
+ * @param a The first K-mer.
+ * @param b The second K-mer.
+ * @return True if a <= b in lexicographic order, false otherwise.
+ */
+PG_FUNCTION_INFO_V1(kmer_le);
+Datum kmer_le(PG_FUNCTION_ARGS) {
+	PG_RETURN_BOOL(compare_kmer_order(PG_GETARG_KMER(0), PG_GETARG_KMER(1)) <= 0);
+}
+
+/**
+ * @brief Postgres function to check if a K-mer comes after another one.
+ * 
+ * @param a The first K-mer.
+ * @param b The second K-mer.
+ * @return True if a > b in lexicographic order, false otherwise.
+ */
+PG_FUNCTION_INFO_V1(kmer_gt);
+Datum kmer_gt(PG_FUNCTION_ARGS) {
+	PG_RETURN_BOOL(compare_kmer_order(PG_GETARG_KMER(0), PG_GETARG_KMER(1)) > 0);
+}
+
+/**
+ * @brief Postgres function to check if a K-mer comes after another one or equals it.
+ * 
+ * @param a The first K-mer.
+ * @param b The second K-mer.
+ * @return True if a >= b in lexicographic order, false otherwise.
+ */
+PG_FUNCTION_INFO_V1(kmer_ge);
+Datum kmer_ge(PG_FUNCTION_ARGS) {
+	PG_RETURN_BOOL(compare_kmer_order(PG_GETARG_KMER(0), PG_GETARG_KMER(1)) >= 0);
 }
 
 /**
@@ -331,12 +450,9 @@ Datum kmer_eq(PG_FUNCTION_ARGS) {
  */
 PG_FUNCTION_INFO_V1(kmer_startswith);
 Datum kmer_startswith(PG_FUNCTION_ARGS) {
-	Kmer *prefix = PG_GETARG_KMER_P(0);
-	Kmer *kmer = PG_GETARG_KMER_P(1);
-	bool result = internal_kmer_startswith(kmer, prefix);
-	PG_FREE_IF_COPY(prefix, 0);
-	PG_FREE_IF_COPY(kmer, 1);
-	PG_RETURN_BOOL(result);
+	Kmer prefix = PG_GETARG_KMER(0);
+	Kmer kmer = PG_GETARG_KMER(1);
+	PG_RETURN_BOOL(internal_kmer_startswith(&kmer, &prefix));
 }
 
 /**
@@ -348,31 +464,370 @@ Datum kmer_startswith(PG_FUNCTION_ARGS) {
  */
 PG_FUNCTION_INFO_V1(kmer_startswith_inv);
 Datum kmer_startswith_inv(PG_FUNCTION_ARGS) {
-	Kmer *kmer = PG_GETARG_KMER_P(0);
-	Kmer *prefix = PG_GETARG_KMER_P(1);
-	bool result = internal_kmer_startswith(kmer, prefix);
-	PG_FREE_IF_COPY(kmer, 0);
-	PG_FREE_IF_COPY(prefix, 1);
-	PG_RETURN_BOOL(result);
+	Kmer kmer = PG_GETARG_KMER(0);
+	Kmer prefix = PG_GETARG_KMER(1);
+	PG_RETURN_BOOL(internal_kmer_startswith(&kmer, &prefix));
+}
+
+/**
+ * @brief Gets the smallest K-mer greater than all the K-mers starting with a prefix, in lexicographic
+ * order: the prefix without its trailing T's, whose last nucleotide is incremented.
+ * 
+ * @param prefix The prefix.
+ * @param upper The upper bound.
+ * @return False if there is none (a prefix made only of T's).
+ */
+static bool get_kmer_prefix_upper_bound(Kmer prefix, Kmer* upper) {
+	while (prefix.k > 0 && (prefix.value & 0b11) == 0b11) {
+		prefix.value >>= 2;
+		prefix.k--;
+	}
+	if (prefix.k == 0) {
+		return false;
+	}
+	upper->value = prefix.value + 1;
+	upper->k = prefix.k;
+	return true;
+}
+
+/**
+ * @brief Checks if an operator family is a B-tree or BRIN one, whose strategies are the B-tree ones.
+ * 
+ * @param opfamily The operator family.
+ * @return True if the operator family orders its values like a B-tree.
+ */
+static bool is_ordering_opfamily(Oid opfamily) {
+	HeapTuple tuple = SearchSysCache1(OPFAMILYOID, ObjectIdGetDatum(opfamily));
+	if (!HeapTupleIsValid(tuple)) {
+		return false;
+	}
+	Oid method = ((Form_pg_opfamily) GETSTRUCT(tuple))->opfmethod;
+	ReleaseSysCache(tuple);
+	return method == BTREE_AM_OID || method == BRIN_AM_OID;
+}
+
+/**
+ * @brief Makes a comparison of an indexed K-mer with a constant K-mer, as an index condition.
+ * 
+ * @param opfamily The operator family of the index.
+ * @param strategy The B-tree strategy of the comparison.
+ * @param indexed The indexed expression.
+ * @param kmer The constant K-mer.
+ * @return The comparison, NULL if the operator family has no such operator.
+ */
+static Expr* make_kmer_comparison(Oid opfamily, StrategyNumber strategy, Expr* indexed, Kmer kmer) {
+	Oid kmer_type = exprType((Node*) indexed);
+	Oid operator = get_opfamily_member(opfamily, kmer_type, kmer_type, strategy);
+	if (!OidIsValid(operator)) {
+		return NULL;
+	}
+	Const* constant = makeConst(kmer_type, -1, InvalidOid, sizeof(Datum), KmerGetDatum(kmer), false, true);
+	return make_opclause(operator, BOOLOID, false, indexed, (Expr*) constant, InvalidOid, InvalidOid);
+}
+
+/**
+ * @brief Postgres planner support function of kmer ^@ prefix: on B-tree and BRIN indexes, a constant
+ * prefix is turned into the range of K-mers starting with it, kmer >= prefix AND kmer < upper bound.
+ * The range holds exactly the K-mers starting with the prefix, so the operator need not be rechecked.
+ * 
+ * @param rawreq The support request.
+ * @return The index conditions, NULL if the request is not supported.
+ */
+PG_FUNCTION_INFO_V1(kmer_startswith_support);
+Datum kmer_startswith_support(PG_FUNCTION_ARGS) {
+	Node* rawreq = (Node*) PG_GETARG_POINTER(0);
+	if (!IsA(rawreq, SupportRequestIndexCondition)) {
+		PG_RETURN_POINTER(NULL);
+	}
+	SupportRequestIndexCondition* req = (SupportRequestIndexCondition*) rawreq;
+	List* args;
+	if (is_opclause(req->node)) {
+		args = ((OpExpr*) req->node)->args;
+	} else if (is_funcclause(req->node)) {
+		args = ((FuncExpr*) req->node)->args;
+	} else {
+		PG_RETURN_POINTER(NULL);
+	}
+	if (list_length(args) != 2 || req->indexarg != 0 || !is_ordering_opfamily(req->opfamily)) {
+		PG_RETURN_POINTER(NULL);
+	}
+	Node* prefix_arg = (Node*) lsecond(args);
+	if (!IsA(prefix_arg, Const) || ((Const*) prefix_arg)->constisnull) {
+		PG_RETURN_POINTER(NULL);
+	}
+
+	Expr* indexed = (Expr*) linitial(args);
+	Kmer prefix = DatumGetKmer(((Const*) prefix_arg)->constvalue);
+	Kmer upper;
+	Expr* lower_condition = make_kmer_comparison(req->opfamily, BTGreaterEqualStrategyNumber, indexed, prefix);
+	if (lower_condition == NULL) {
+		PG_RETURN_POINTER(NULL);
+	}
+	List* conditions = list_make1(lower_condition);
+	if (get_kmer_prefix_upper_bound(prefix, &upper)) {
+		Expr* upper_condition = make_kmer_comparison(req->opfamily, BTLessStrategyNumber, indexed, upper);
+		if (upper_condition == NULL) {
+			PG_RETURN_POINTER(NULL);
+		}
+		conditions = lappend(conditions, upper_condition);
+	}
+	req->lossy = false;
+	PG_RETURN_POINTER(conditions);
+}
+
+/**
+ * @brief Postgres function to compute the Hamming distance of two K-mers.
+ * 
+ * @param a The first K-mer.
+ * @param b The second K-mer.
+ * @return The number of mismatches (the extra nucleotides of the longer K-mer count as mismatches).
+ */
+PG_FUNCTION_INFO_V1(kmer_distance);
+Datum kmer_distance(PG_FUNCTION_ARGS) {
+	Kmer a = PG_GETARG_KMER(0);
+	Kmer b = PG_GETARG_KMER(1);
+	PG_RETURN_INT32(get_kmer_distance(a.value, a.k, b.value, b.k));
+}
+
+/* Kmer ball */
+
+/**
+ * @brief Postgres input function for K-mer ball.
+ * 
+ * @param str The input string, the center K-mer and the radius, e.g. 'ACGTACGT/2'.
+ * @return The K-mer ball object created from the input string.
+ */
+PG_FUNCTION_INFO_V1(kmer_ball_in);
+Datum kmer_ball_in(PG_FUNCTION_ARGS) {
+	char *str = pstrdup(PG_GETARG_CSTRING(0));
+	char *separator = strchr(str, '/');
+	char *end;
+	if (separator == NULL) {
+		ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+		errmsg("invalid input syntax for type kmer_ball: \"%s\"", str)));
+	}
+	*separator = '\0';
+	long radius = strtol(separator + 1, &end, 10);
+	if (end == separator + 1 || *end != '\0' || radius < 0 || radius > 32) {
+		ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+		errmsg("kmer_ball radius should be between 0 and 32")));
+	}
+	Kmer center = kmer_parse(str);
+	KmerBall* ball = palloc0(sizeof(KmerBall));
+	ball -> value = center.value;
+	ball -> k = center.k;
+	ball -> radius = (uint8_t) radius;
+	pfree(str);
+	PG_RETURN_KMER_BALL_P(ball);
+}
+
+/**
+ * @brief Postgres output function for K-mer ball.
+ * 
+ * @param ball The K-mer ball object.
+ * @return The string representation of the K-mer ball.
+ */
+PG_FUNCTION_INFO_V1(kmer_ball_out);
+Datum kmer_ball_out(PG_FUNCTION_ARGS) {
+	KmerBall* ball = PG_GETARG_KMER_BALL_P(0);
+	Kmer center = { ball -> value, ball -> k };
+	char *center_str = kmer_value_to_string(&center);
+	PG_RETURN_CSTRING(psprintf("%s/%u", center_str, ball -> radius));
+}
+
+/*
+ * Binary format of K-mer ball (used by kmer_ball_send and kmer_ball_recv):
+ *   int64   value of the center, as in the binary format of K-mer
+ *   int8    length k of the center (1-31)
+ *   int8    radius (0-32)
+ */
+
+/**
+ * @brief Postgres receive function for K-mer ball.
+ * 
+ * @param buf The binary representation of the K-mer ball.
+ * @return The K-mer ball object created from the binary representation.
+ */
+PG_FUNCTION_INFO_V1(kmer_ball_recv);
+Datum kmer_ball_recv(PG_FUNCTION_ARGS) {
+	StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
+	KmerBall* ball = palloc0(sizeof(KmerBall));
+	ball -> value = pq_getmsgint64(buf);
+	ball -> k = pq_getmsgbyte(buf);
+	ball -> radius = pq_getmsgbyte(buf);
+	if (ball -> k == 0 || ball -> k > KMER_MAX_LENGTH) {
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+		errmsg("invalid kmer length in external value: %d", ball -> k)));
+	}
+	if ((ball -> value >> (2 * ball -> k)) != 0) {
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+		errmsg("kmer value does not fit in %d nucleotides", ball -> k)));
+	}
+	if (ball -> radius > 32) {
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+		errmsg("invalid kmer_ball radius in external value: %d", ball -> radius)));
+	}
+	PG_RETURN_KMER_BALL_P(ball);
+}
+
+/**
+ * @brief Postgres send function for K-mer ball.
+ * 
+ * @param ball The K-mer ball object.
+ * @return The binary representation of the K-mer ball.
+ */
+PG_FUNCTION_INFO_V1(kmer_ball_send);
+Datum kmer_ball_send(PG_FUNCTION_ARGS) {
+	KmerBall* ball = PG_GETARG_KMER_BALL_P(0);
+	StringInfoData buf;
+	pq_begintypsend(&buf);
+	pq_sendint64(&buf, ball -> value);
+	pq_sendint8(&buf, ball -> k);
+	pq_sendint8(&buf, ball -> radius);
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+/**
+ * @brief Postgres function to build the ball of the K-mers within a Hamming distance of a K-mer.
+ * 
+ * @param kmer The center K-mer.
+ * @param radius The maximal number of mismatches.
+ * @return The K-mer ball.
+ */
+PG_FUNCTION_INFO_V1(kmer_ball);
+Datum kmer_ball(PG_FUNCTION_ARGS) {
+	Kmer kmer = PG_GETARG_KMER(0);
+	int32 radius = PG_GETARG_INT32(1);
+	if (radius < 0) {
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+		errmsg("kmer_ball radius should not be negative")));
+	}
+	KmerBall* ball = palloc0(sizeof(KmerBall));
+	ball -> value = kmer.value;
+	ball -> k = kmer.k;
+	ball -> radius = (uint8_t) Min(radius, 32);
+	PG_RETURN_KMER_BALL_P(ball);
+}
+
+/**
+ * @brief Postgres function to check if a K-mer is within the Hamming distance of a K-mer ball.
+ * 
+ * @param kmer The K-mer to check.
+ * @param ball The K-mer ball.
+ * @return True if the K-mer has at most radius mismatches with the center of the ball.
+ */
+PG_FUNCTION_INFO_V1(kmer_in_ball);
+Datum kmer_in_ball(PG_FUNCTION_ARGS) {
+	Kmer kmer = PG_GETARG_KMER(0);
+	KmerBall* ball = PG_GETARG_KMER_BALL_P(1);
+	PG_RETURN_BOOL(get_kmer_distance(kmer.value, kmer.k, ball -> value, ball -> k) <= ball -> radius);
 }
 
 /* Kmer Hash operators */
 
 /**
- * @brief Postgres function to get the hash value of a K-mer.
+ * @brief Hashes a K-mer with a seed: a 64-bit integer finalizer of its Datum, which packs its length.
+ * With seed 0, the low 32 bits are the standard hash of the K-mer, as PostgreSQL requires.
+ * 
+ * @param kmer The K-mer.
+ * @param seed The seed.
+ * @return The hash of the K-mer.
+ */
+static inline uint64 get_kmer_hash(Kmer kmer, uint64 seed) {
+	return murmurhash64(KmerGetDatum(kmer) ^ murmurhash64(seed));     // murmurhash64(0) = 0
+}
+
+/**
+ * @brief Postgres function to get the hash value of a K-mer (hash support function 1).
  * 
  * @param kmer The K-mer to get the hash value of.
  * @return The hash value of the K-mer.
  */
 PG_FUNCTION_INFO_V1(kmer_hash);
 Datum kmer_hash(PG_FUNCTION_ARGS) {
-	Kmer* kmer = PG_GETARG_KMER_P(0);
+	PG_RETURN_INT32((int32) get_kmer_hash(PG_GETARG_KMER(0), 0));
+}
 
-	uint64_t kmer_value = kmer->value << (kmer->k * 2);
-	uint64_t removed_bits = kmer->value >> (64 - kmer->k * 2);
-	uint64_t hash_input = kmer_value ^ removed_bits;
+/**
+ * @brief Postgres function to get the seeded 64-bit hash value of a K-mer (hash support function 2),
+ * used by hash partitioning.
+ * 
+ * @param kmer The K-mer to get the hash value of.
+ * @param seed The seed.
+ * @return The hash value of the K-mer.
+ */
+PG_FUNCTION_INFO_V1(kmer_hash_extended);
+Datum kmer_hash_extended(PG_FUNCTION_ARGS) {
+	PG_RETURN_INT64((int64) get_kmer_hash(PG_GETARG_KMER(0), (uint64) PG_GETARG_INT64(1)));
+}
 
-	int32 hash = hash_any((unsigned char *) &hash_input, sizeof(hash_input));
+/* Kmer B-tree operators */
 
-    PG_RETURN_INT32(hash);
-}
\ No newline at end of file
+/**
+ * @brief Postgres function to compare two K-mers in lexicographic order (B-tree support function 1).
+ * 
+ * @param a The first K-mer.
+ * @param b The second K-mer.
+ * @return -1 if a < b, 0 if a == b, 1 if a > b.
+ */
+PG_FUNCTION_INFO_V1(kmer_cmp);
+Datum kmer_cmp(PG_FUNCTION_ARGS) {
+	PG_RETURN_INT32(compare_kmer_order(PG_GETARG_KMER(0), PG_GETARG_KMER(1)));
+}
+
+/**
+ * @brief Compares two K-mer Datums, for sorts.
+ * 
+ * @param x The first K-mer.
+ * @param y The second K-mer.
+ * @param ssup The sort support information.
+ * @return -1 if x < y, 0 if x == y, 1 if x > y.
+ */
+static int kmer_fastcmp(Datum x, Datum y, SortSupport ssup) {
+	return compare_kmer_order(DatumGetKmer(x), DatumGetKmer(y));
+}
+
+/**
+ * @brief Converts a K-mer to its abbreviated key, its sort key. The abbreviated keys only tie for
+ * equal K-mers, or a K-mer and the same K-mer followed by A's.
+ * 
+ * @param original The K-mer.
+ * @param ssup The sort support information.
+ * @return The abbreviated key.
+ */
+static Datum kmer_abbrev_convert(Datum original, SortSupport ssup) {
+	return UInt64GetDatum(get_kmer_sort_key(DatumGetKmer(original)));
+}
+
+/**
+ * @brief Decides whether to abort the abbreviation: never, the keys are exact but for prefixes.
+ * 
+ * @param memtupcount The number of tuples sorted so far.
+ * @param ssup The sort support information.
+ * @return False.
+ */
+static bool kmer_abbrev_abort(int memtupcount, SortSupport ssup) {
+	return false;
+}
+
+/**
+ * @brief Postgres sort support function for K-mers (B-tree support function 2). With abbreviation,
+ * the K-mers are sorted on their 64-bit sort keys with the unsigned integer comparator, for which
+ * the sorts have a specialized (inlined) quicksort.
+ * 
+ * @param ssup The sort support information to fill.
+ * @return void
+ */
+PG_FUNCTION_INFO_V1(kmer_sortsupport);
+Datum kmer_sortsupport(PG_FUNCTION_ARGS) {
+	SortSupport ssup = (SortSupport) PG_GETARG_POINTER(0);
+
+	ssup->comparator = kmer_fastcmp;
+	if (ssup->abbreviate) {
+		ssup->comparator = ssup_datum_unsigned_cmp;
+		ssup->abbrev_converter = kmer_abbrev_convert;
+		ssup->abbrev_abort = kmer_abbrev_abort;
+		ssup->abbrev_full_comparator = kmer_fastcmp;
+	}
+	PG_RETURN_VOID();
+}
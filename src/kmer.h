@@ -2,20 +2,75 @@
 #define KMER_H
 
 #include "kmea.h"
+#include "nucleotide.h"
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "access/hash.h"
+#include "port/pg_bitutils.h"
+#include "utils/sortsupport.h"
+
+/**
+ * @typedef KmerBall
+ * @brief Structure used to store the K-mers within a Hamming distance of a center K-mer.
+ * Its SQL type has an internal length of 16 bytes (with padding) and a double alignment.
+ */
+typedef struct KmerBall {
+	uint64_t value;   /**< The value of the center K-mer */
+	uint8_t k;        /**< The length of the center K-mer */
+	uint8_t radius;   /**< The maximal number of mismatches */
+} KmerBall;
+
+#define DatumGetKmerBallP(X)  ((KmerBall *) DatumGetPointer(X))
+#define KmerBallPGetDatum(X)  PointerGetDatum(X)
+#define PG_GETARG_KMER_BALL_P(n) DatumGetKmerBallP(PG_GETARG_DATUM(n))
+#define PG_RETURN_KMER_BALL_P(x) return KmerBallPGetDatum(x)
 
 // Macro to check if two Kmers are equal
 #define KMER_EQUAL(kmer1, kmer2) ((kmer1 -> value == kmer2 -> value) && (kmer1 -> k == kmer2 -> k))
 
 bool internal_kmer_startswith(Kmer* kmer, Kmer* prefix);
 
-Kmer* get_first_k_nucleotides(Kmer* kmer, uint8_t k);
-Kmer* get_last_k_nucleotides(Kmer* kmer, uint8_t k);
+Kmer get_first_k_nucleotides(Kmer* kmer, uint8_t k);
+Kmer get_last_k_nucleotides(Kmer* kmer, uint8_t k);
 
 uint8_t get_common_prefix_len(Kmer* kmer1, Kmer* kmer2);
 int compare_kmers(Kmer* kmer1, Kmer* kmer2, uint8_t n);
 
+uint8_t get_kmer_distance(uint64_t value1, uint8_t k1, uint64_t value2, uint8_t k2);
+uint8_t get_kmer_distance_lower_bound(uint64_t prefix_value, uint8_t prefix_k, uint64_t value, uint8_t k);
+
+/**
+ * @brief Gets the sort key of a K-mer: its value aligned on the most significant bits, so that
+ * K-mers compare as unsigned integers in lexicographic order, up to the length of the shorter one.
+ * 
+ * @param kmer The K-mer.
+ * @return The sort key.
+ */
+static inline uint64_t get_kmer_sort_key(Kmer kmer) {
+	return kmer.k == 0 ? 0 : kmer.value << (64 - 2 * kmer.k);
+}
+
+/**
+ * @brief Gets the mask of the first n nucleotides of sort keys (values aligned on the most significant bits).
+ * 
+ * @param n The number of nucleotides, at most 32.
+ * @return The mask.
+ */
+static inline uint64_t get_kmer_prefix_mask(uint8_t n) {
+	return n == 0 ? 0 : UINT64_MAX << (64 - 2 * n);
+}
+
+/**
+ * @brief Counts the mismatching nucleotides of two K-mer values, by XOR and popcount over the 2-bit lanes.
+ * 
+ * @param value1 The value of the first K-mer.
+ * @param value2 The value of the second K-mer.
+ * @return The number of mismatches.
+ */
+static inline uint8_t count_kmer_mismatches(uint64_t value1, uint64_t value2) {
+	uint64_t difference = value1 ^ value2;
+	return pg_popcount64((difference | (difference >> 1)) & 0x5555555555555555);
+}
+
 #endif
\ No newline at end of file
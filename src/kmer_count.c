@@ -0,0 +1,435 @@
+#include "kmer_count.h"
+
+#define KMER_COUNT_INITIAL_CAPACITY 1024
+
+/**
+ * @brief Hash table counting K-mers, the state of the kmer_count aggregate.
+ *
+ * The table uses open addressing with linear probing. The values and the counts are stored in two
+ * parallel arrays whose size is a power of two, a count of 0 marking an empty slot.
+ */
+typedef struct KmerCountTable {
+    uint8_t k;                 /**< Length of the counted K-mers */
+    uint64 nb_entries;         /**< Number of distinct K-mers */
+    uint64 capacity;           /**< Number of slots (a power of two) */
+    uint64* values;            /**< Values of the K-mers */
+    int64* counts;             /**< Numbers of occurrences of the K-mers, 0 for empty slots */
+    MemoryContext context;     /**< Memory context holding the table */
+} KmerCountTable;
+
+/*
+ * Serialized format of a table (used to exchange partial states between parallel workers, and as
+ * the kmer_count_table result of the aggregate, also its binary format):
+ *   int8    K-mer length
+ *   int64   number of distinct K-mers n
+ *   n times int64 value, int64 count (> 0)
+ * All the integers are in network byte order. A kmer_count_table value is limited to MaxAllocSize,
+ * hence to about 67 million distinct K-mers.
+ */
+#define KMER_COUNT_HEADER_SIZE (1 + sizeof(int64))
+#define KMER_COUNT_ENTRY_SIZE (2 * sizeof(int64))
+
+
+/**
+ * @brief Allocates the slots of a K-mer count table.
+ *
+ * @param table The K-mer count table.
+ * @param capacity The number of slots (a power of two).
+ */
+static void allocate_kmer_count_slots(KmerCountTable* table, uint64 capacity) {
+    table->capacity = capacity;
+    table->values = MemoryContextAllocExtended(table->context, capacity * sizeof(uint64), MCXT_ALLOC_HUGE);
+    table->counts = MemoryContextAllocExtended(table->context, capacity * sizeof(int64), MCXT_ALLOC_HUGE | MCXT_ALLOC_ZERO);
+}
+
+/**
+ * @brief Creates an empty K-mer count table.
+ *
+ * @param context The memory context holding the table.
+ * @param k The length of the counted K-mers.
+ * @param capacity The initial number of slots (a power of two).
+ * @return The K-mer count table.
+ */
+static KmerCountTable* create_kmer_count_table(MemoryContext context, uint8_t k, uint64 capacity) {
+    KmerCountTable* table = MemoryContextAlloc(context, sizeof(KmerCountTable));
+    table->k = k;
+    table->nb_entries = 0;
+    table->context = context;
+    allocate_kmer_count_slots(table, capacity);
+    return table;
+}
+
+/**
+ * @brief Adds occurrences of a K-mer to a K-mer count table, without growing it.
+ *
+ * @param table The K-mer count table, which must have an empty slot.
+ * @param value The value of the K-mer.
+ * @param count The number of occurrences.
+ */
+static inline void insert_kmer_count(KmerCountTable* table, uint64 value, int64 count) {
+    uint64 mask = table->capacity - 1;
+    uint64 slot = murmurhash64(value) & mask;
+    while (table->counts[slot] != 0) {
+        if (table->values[slot] == value) {
+            table->counts[slot] += count;
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+    table->values[slot] = value;
+    table->counts[slot] = count;
+    table->nb_entries++;
+}
+
+/**
+ * @brief Doubles the number of slots of a K-mer count table, and rehashes its K-mers.
+ *
+ * @param table The K-mer count table.
+ */
+static void grow_kmer_count_table(KmerCountTable* table) {
+    uint64* values = table->values;
+    int64* counts = table->counts;
+    uint64 capacity = table->capacity;
+
+    allocate_kmer_count_slots(table, capacity * 2);
+    table->nb_entries = 0;
+    for (uint64 i = 0; i < capacity; i++) {
+        if (counts[i] != 0) {
+            insert_kmer_count(table, values[i], counts[i]);
+        }
+    }
+    pfree(values);
+    pfree(counts);
+}
+
+/**
+ * @brief Adds occurrences of a K-mer to a K-mer count table, growing it above a load factor of 1/2.
+ *
+ * @param table The K-mer count table.
+ * @param value The value of the K-mer.
+ * @param count The number of occurrences.
+ */
+static inline void add_kmer_count(KmerCountTable* table, uint64 value, int64 count) {
+    if (unlikely(table->nb_entries * 2 >= table->capacity)) {
+        grow_kmer_count_table(table);
+    }
+    insert_kmer_count(table, value, count);
+}
+
+/**
+ * @brief Checks that two K-mer lengths counted by the same aggregate are equal.
+ *
+ * @param k1 The first K-mer length.
+ * @param k2 The second K-mer length.
+ */
+static void check_same_kmer_length(uint8_t k1, uint8_t k2) {
+    if (k1 != k2) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("cannot count kmers of different lengths (%u and %u) together", k1, k2)));
+    }
+}
+
+/**
+ * @brief Reads the header of a serialized K-mer count table, and checks its size.
+ *
+ * @param serialized The serialized K-mer count table.
+ * @param k The length of the counted K-mers.
+ * @param sqlerrcode The error code raised when the table is invalid.
+ * @return The number of distinct K-mers.
+ */
+static uint64 read_kmer_count_header(bytea* serialized, uint8_t* k, int sqlerrcode) {
+    Size size = VARSIZE_ANY_EXHDR(serialized);
+    const uint8_t* data = (const uint8_t*) VARDATA_ANY(serialized);
+    uint64 nb_entries;
+
+    if (size < KMER_COUNT_HEADER_SIZE) {
+        ereport(ERROR, (errcode(sqlerrcode),
+            errmsg("invalid kmer count table")));
+    }
+    *k = data[0];
+    memcpy(&nb_entries, data + 1, sizeof(nb_entries));
+    nb_entries = pg_ntoh64(nb_entries);
+    if (*k < 1 || *k > KMER_MAX_LENGTH || nb_entries > (size - KMER_COUNT_HEADER_SIZE) / KMER_COUNT_ENTRY_SIZE
+        || size != KMER_COUNT_HEADER_SIZE + nb_entries * KMER_COUNT_ENTRY_SIZE) {
+        ereport(ERROR, (errcode(sqlerrcode),
+            errmsg("invalid kmer count table")));
+    }
+    return nb_entries;
+}
+
+/**
+ * @brief Reads an entry of a serialized K-mer count table.
+ *
+ * @param serialized The serialized K-mer count table.
+ * @param index The index of the entry.
+ * @param value The value of the K-mer.
+ * @param count The number of occurrences of the K-mer.
+ */
+static inline void read_kmer_count_entry(bytea* serialized, uint64 index, uint64* value, int64* count) {
+    const uint8_t* entry = (const uint8_t*) VARDATA_ANY(serialized) + KMER_COUNT_HEADER_SIZE + index * KMER_COUNT_ENTRY_SIZE;
+    uint64 raw_count;
+    memcpy(value, entry, sizeof(uint64));
+    memcpy(&raw_count, entry + sizeof(uint64), sizeof(uint64));
+    *value = pg_ntoh64(*value);
+    *count = (int64) pg_ntoh64(raw_count);
+}
+
+/**
+ * @brief Checks a K-mer count table received from the outside: its K-mers must fit their length, and
+ * their counts must be positive.
+ *
+ * @param serialized The serialized K-mer count table.
+ * @param sqlerrcode The error code raised when the table is invalid.
+ */
+static void check_kmer_count_table(bytea* serialized, int sqlerrcode) {
+    uint8_t k;
+    uint64 nb_entries = read_kmer_count_header(serialized, &k, sqlerrcode);
+    for (uint64 i = 0; i < nb_entries; i++) {
+        uint64 value;
+        int64 count;
+        read_kmer_count_entry(serialized, i, &value, &count);
+        if ((value >> (2 * k)) != 0 || count <= 0) {
+            ereport(ERROR, (errcode(sqlerrcode),
+                errmsg("invalid kmer count table")));
+        }
+    }
+}
+
+/**
+ * @brief Postgres input function for K-mer count table: the hexadecimal digits of its binary format,
+ * after \x (as for bytea).
+ *
+ * @param str The string representation of the K-mer count table.
+ * @return The K-mer count table.
+ */
+PG_FUNCTION_INFO_V1(kmer_count_table_in);
+Datum kmer_count_table_in(PG_FUNCTION_ARGS) {
+    char* str = PG_GETARG_CSTRING(0);
+    size_t length = strlen(str);
+    if (length < 2 || length % 2 != 0 || str[0] != '\\' || str[1] != 'x') {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+            errmsg("invalid input syntax for type kmer_count_table")));
+    }
+    Size size = VARHDRSZ + (length - 2) / 2;
+    bytea* serialized = palloc(size);
+    SET_VARSIZE(serialized, size);
+    hex_decode(str + 2, length - 2, VARDATA(serialized));
+    check_kmer_count_table(serialized, ERRCODE_INVALID_TEXT_REPRESENTATION);
+    PG_RETURN_BYTEA_P(serialized);
+}
+
+/**
+ * @brief Postgres output function for K-mer count table.
+ *
+ * @param counts The K-mer count table.
+ * @return The string representation of the K-mer count table.
+ */
+PG_FUNCTION_INFO_V1(kmer_count_table_out);
+Datum kmer_count_table_out(PG_FUNCTION_ARGS) {
+    bytea* serialized = PG_GETARG_BYTEA_PP(0);
+    Size size = VARSIZE_ANY_EXHDR(serialized);
+    char* str = palloc(2 + 2 * size + 1);
+    str[0] = '\\';
+    str[1] = 'x';
+    str[2 + hex_encode(VARDATA_ANY(serialized), size, str + 2)] = '\0';
+    PG_FREE_IF_COPY(serialized, 0);
+    PG_RETURN_CSTRING(str);
+}
+
+/**
+ * @brief Postgres receive function for K-mer count table.
+ *
+ * @param buf The binary representation of the K-mer count table.
+ * @return The K-mer count table created from the binary representation.
+ */
+PG_FUNCTION_INFO_V1(kmer_count_table_recv);
+Datum kmer_count_table_recv(PG_FUNCTION_ARGS) {
+    StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
+    Size size = VARHDRSZ + (buf->len - buf->cursor);
+    bytea* serialized = palloc(size);
+    SET_VARSIZE(serialized, size);
+    pq_copymsgbytes(buf, VARDATA(serialized), size - VARHDRSZ);
+    check_kmer_count_table(serialized, ERRCODE_INVALID_BINARY_REPRESENTATION);
+    PG_RETURN_BYTEA_P(serialized);
+}
+
+/**
+ * @brief Postgres send function for K-mer count table.
+ *
+ * @param counts The K-mer count table.
+ * @return The binary representation of the K-mer count table.
+ */
+PG_FUNCTION_INFO_V1(kmer_count_table_send);
+Datum kmer_count_table_send(PG_FUNCTION_ARGS) {
+    bytea* serialized = PG_GETARG_BYTEA_PP(0);
+    StringInfoData buf;
+    pq_begintypsend(&buf);
+    pq_sendbytes(&buf, VARDATA_ANY(serialized), VARSIZE_ANY_EXHDR(serialized));
+    PG_FREE_IF_COPY(serialized, 0);
+    PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Transition function of the kmer_count aggregate: adds the K-mers of a DNA sequence to the table.
+ * The K-mers overlapping an IUPAC ambiguity code are skipped.
+ *
+ * @param state The K-mer count table (NULL for the first row).
+ * @param dna The DNA object.
+ * @param kmer_length The length of the K-mers.
+ * @param canonical Whether the canonical K-mers are counted (optional, false by default).
+ * @return The K-mer count table.
+ */
+PG_FUNCTION_INFO_V1(kmer_count_transfn);
+Datum kmer_count_transfn(PG_FUNCTION_ARGS) {
+    MemoryContext context = get_aggregate_context(fcinfo, "kmer_count");
+    KmerCountTable* table = PG_ARGISNULL(0) ? NULL : (KmerCountTable*) PG_GETARG_POINTER(0);
+
+    if (PG_ARGISNULL(1) || PG_ARGISNULL(2) || (PG_NARGS() > 3 && PG_ARGISNULL(3))) {
+        if (table == NULL) {
+            PG_RETURN_NULL();
+        }
+        PG_RETURN_POINTER(table);
+    }
+
+    uint8_t kmer_length = check_kmer_length(PG_GETARG_INT32(2));
+    bool canonical = PG_NARGS() > 3 && PG_GETARG_BOOL(3);
+    if (table == NULL) {
+        table = create_kmer_count_table(context, kmer_length, KMER_COUNT_INITIAL_CAPACITY);
+    }
+    check_same_kmer_length(table->k, kmer_length);
+
+    DNA* dna = PG_GETARG_BYTEA_P(1);
+    KmerGeneratorState generator;
+    uint64_t value;
+    init_kmer_generator_state(&generator, dna, kmer_length, canonical);
+    while (next_kmer_value(&generator, &value)) {
+        add_kmer_count(table, value, 1);
+    }
+    PG_FREE_IF_COPY(dna, 1);
+    PG_RETURN_POINTER(table);
+}
+
+/**
+ * @brief Combine function of the kmer_count aggregate: merges two K-mer count tables.
+ *
+ * @param state1 The first K-mer count table (possibly NULL), which receives the K-mers.
+ * @param state2 The second K-mer count table (possibly NULL).
+ * @return The merged K-mer count table.
+ */
+PG_FUNCTION_INFO_V1(kmer_count_combinefn);
+Datum kmer_count_combinefn(PG_FUNCTION_ARGS) {
+    MemoryContext context = get_aggregate_context(fcinfo, "kmer_count");
+    KmerCountTable* table1 = PG_ARGISNULL(0) ? NULL : (KmerCountTable*) PG_GETARG_POINTER(0);
+    KmerCountTable* table2 = PG_ARGISNULL(1) ? NULL : (KmerCountTable*) PG_GETARG_POINTER(1);
+
+    if (table2 == NULL) {
+        if (table1 == NULL) {
+            PG_RETURN_NULL();
+        }
+        PG_RETURN_POINTER(table1);
+    }
+    if (table1 == NULL) {                                           // copy table2 into the aggregate context
+        table1 = create_kmer_count_table(context, table2->k, table2->capacity);
+    }
+    check_same_kmer_length(table1->k, table2->k);
+    for (uint64 i = 0; i < table2->capacity; i++) {
+        if (table2->counts[i] != 0) {
+            add_kmer_count(table1, table2->values[i], table2->counts[i]);
+        }
+    }
+    PG_RETURN_POINTER(table1);
+}
+
+/**
+ * @brief Serialization function of the kmer_count aggregate, also its final function returning a
+ * kmer_count_table.
+ *
+ * @param state The K-mer count table.
+ * @return The serialized K-mer count table.
+ */
+PG_FUNCTION_INFO_V1(kmer_count_serialfn);
+Datum kmer_count_serialfn(PG_FUNCTION_ARGS) {
+    KmerCountTable* table = (KmerCountTable*) PG_GETARG_POINTER(0);
+    Size size = VARHDRSZ + KMER_COUNT_HEADER_SIZE + table->nb_entries * KMER_COUNT_ENTRY_SIZE;
+    if (size > MaxAllocSize) {
+        ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+            errmsg("too many distinct kmers (" UINT64_FORMAT ") to serialize the kmer count table", table->nb_entries)));
+    }
+
+    bytea* serialized = palloc(size);
+    SET_VARSIZE(serialized, size);
+    uint8_t* data = (uint8_t*) VARDATA(serialized);
+    uint64 nb_entries = pg_hton64(table->nb_entries);
+    data[0] = table->k;
+    memcpy(data + 1, &nb_entries, sizeof(nb_entries));
+
+    uint8_t* entry = data + KMER_COUNT_HEADER_SIZE;
+    for (uint64 i = 0; i < table->capacity; i++) {
+        if (table->counts[i] != 0) {
+            uint64 value = pg_hton64(table->values[i]);
+            uint64 count = pg_hton64((uint64) table->counts[i]);
+            memcpy(entry, &value, sizeof(value));
+            memcpy(entry + sizeof(value), &count, sizeof(count));
+            entry += KMER_COUNT_ENTRY_SIZE;
+        }
+    }
+    PG_RETURN_BYTEA_P(serialized);
+}
+
+/**
+ * @brief Deserialization function of the kmer_count aggregate.
+ *
+ * @param serialized The serialized K-mer count table.
+ * @return The K-mer count table.
+ */
+PG_FUNCTION_INFO_V1(kmer_count_deserialfn);
+Datum kmer_count_deserialfn(PG_FUNCTION_ARGS) {
+    MemoryContext context = get_aggregate_context(fcinfo, "kmer_count");
+    bytea* serialized = PG_GETARG_BYTEA_PP(0);
+    uint8_t k;
+    uint64 nb_entries = read_kmer_count_header(serialized, &k, ERRCODE_INVALID_BINARY_REPRESENTATION);
+
+    uint64 capacity = KMER_COUNT_INITIAL_CAPACITY;
+    while (capacity <= nb_entries * 2) {
+        capacity *= 2;
+    }
+    KmerCountTable* table = create_kmer_count_table(context, k, capacity);
+    for (uint64 i = 0; i < nb_entries; i++) {
+        uint64 value;
+        int64 count;
+        read_kmer_count_entry(serialized, i, &value, &count);
+        insert_kmer_count(table, value, count);
+    }
+    PG_RETURN_POINTER(table);
+}
+
+/**
+ * @brief Postgres function to unnest the result of the kmer_count aggregate.
+ *
+ * @param counts The K-mer count table.
+ * @return A set of (kmer, count) rows.
+ */
+PG_FUNCTION_INFO_V1(kmer_count_unnest);
+Datum kmer_count_unnest(PG_FUNCTION_ARGS) {
+    ReturnSetInfo* rsinfo = (ReturnSetInfo*) fcinfo->resultinfo;
+    bytea* serialized = PG_GETARG_BYTEA_PP(0);
+    uint8_t k;
+    uint64 nb_entries = read_kmer_count_header(serialized, &k, ERRCODE_DATA_CORRUPTED);
+    Kmer kmer;
+    int64 count;
+    Datum values[2];
+    bool nulls[2] = { false, false };
+
+    InitMaterializedSRF(fcinfo, MAT_SRF_USE_EXPECTED_DESC);
+
+    kmer.k = k;
+    for (uint64 i = 0; i < nb_entries; i++) {
+        read_kmer_count_entry(serialized, i, &kmer.value, &count);
+        values[0] = KmerGetDatum(kmer);
+        values[1] = Int64GetDatum(count);
+        tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+    }
+    return (Datum) 0;
+}
@@ -0,0 +1,11 @@
+#ifndef KMER_COUNT_H
+#define KMER_COUNT_H
+
+#include "dna.h"
+#include "util.h"
+#include <stdint.h>
+#include <string.h>
+#include "utils/memutils.h"
+#include "utils/builtins.h"
+
+#endif
@@ -1,8 +1,8 @@
 #include "kmer.h"
 #include "qkmer.h"
+#include "access/reloptions.h"
 #include "access/spgist.h"
 #include "utils/pg_locale.h"
-#include "utils/datum.h"
 
 #ifdef PG_MODULE_MAGIC
 PG_MODULE_MAGIC;
@@ -11,14 +11,97 @@ PG_MODULE_MAGIC;
 #define EQUAL_STRATEGY_NUMBER 1
 #define PREFIX_STRATEGY_NUMBER 2
 #define QKMER_MATCHING_STRATEGY_NUMBER 3
+#define KMER_BALL_STRATEGY_NUMBER 4
+#define DISTANCE_STRATEGY_NUMBER 5
+
+#define KMER_SPGIST_DEFAULT_STRIDE 1
+#define KMER_SPGIST_MAX_STRIDE 3
+
+/*
+ * Node labels of the trie, with a stride of s nucleotides per inner tuple (a fan-out of 4^s):
+ *   0 to 4^s - 1      the K-mers continuing with these s nucleotides
+ *   4^s + ...         the K-mers ending with n < s nucleotides: 4^s + (4^n - 4) / 3 + their value
+ *   -1                the K-mers ending at the node
+ *   -2                all the K-mers (added when the K-mers of an inner tuple are all the same)
+ * The prefixes of the inner tuples hold whole strides, so that splitting a prefix leaves a full
+ * stride for the label of its node. With a stride of 1, this is the trie of one nucleotide per level.
+ */
+#define KMER_SPGIST_PARTIAL_LABELS(stride) (1 << (2 * (stride)))
+
+/**
+ * @brief Parameters of the SP-GiST operator class on K-mers, e.g. (stride = 2).
+ */
+typedef struct KmerSpgistOptions {
+    int32 vl_len_;          /**< Varlena header (do not touch directly) */
+    int stride;             /**< Number of nucleotides of the node labels */
+} KmerSpgistOptions;
 
 typedef struct KmerNodePtr
 {
 	Datum		kmer_datum;
 	int			position;
-	int16		first_non_common_nucleotide;
+	int16		node_label;
 } KmerNodePtr;
 
+/**
+ * @brief Gets the stride of the index, or the default.
+ * 
+ * @param fcinfo The function call information of a support function.
+ * @return The number of nucleotides of the node labels.
+ */
+static int get_kmer_spgist_stride(FunctionCallInfo fcinfo) {
+    if (PG_HAS_OPCLASS_OPTIONS()) {
+        return ((KmerSpgistOptions*) PG_GET_OPCLASS_OPTIONS())->stride;
+    }
+    return KMER_SPGIST_DEFAULT_STRIDE;
+}
+
+/**
+ * @brief Gets the node label of a K-mer, from its nucleotides after a position.
+ * 
+ * @param kmer The K-mer.
+ * @param consumed The number of nucleotides before the label.
+ * @param stride The stride of the index.
+ * @return The node label.
+ */
+static int16 get_kmer_node_label(Kmer kmer, uint8_t consumed, int stride) {
+    uint8_t remaining = kmer.k - consumed;
+    if (remaining == 0) {
+        return -1;
+    }
+    uint8_t n = Min(remaining, stride);
+    int16 nucleotides = (kmer.value >> (2 * (remaining - n))) & ((1 << (2 * n)) - 1);
+    if (n == stride) {
+        return nucleotides;
+    }
+    return KMER_SPGIST_PARTIAL_LABELS(stride) + ((1 << (2 * n)) - 4) / 3 + nucleotides;
+}
+
+/**
+ * @brief Decodes a node label into its nucleotides.
+ * 
+ * @param label The node label.
+ * @param stride The stride of the index.
+ * @return The nucleotides of the label (empty for -1 and -2).
+ */
+static Kmer decode_kmer_node_label(int16 label, int stride) {
+    Kmer nucleotides = { 0, 0 };
+    if (label < 0) {
+        return nucleotides;
+    }
+    if (label < KMER_SPGIST_PARTIAL_LABELS(stride)) {
+        nucleotides.k = stride;
+        nucleotides.value = label;
+        return nucleotides;
+    }
+    label -= KMER_SPGIST_PARTIAL_LABELS(stride);
+    for (nucleotides.k = 1; label >= (1 << (2 * nucleotides.k)); nucleotides.k++) {
+        label -= 1 << (2 * nucleotides.k);
+    }
+    nucleotides.value = label;
+    return nucleotides;
+}
+
 /**
  * @brief Function to get the common prefix length of a set of K-mers.
  * 
@@ -27,12 +110,12 @@ typedef struct KmerNodePtr
  * @return The common prefix length.
  */
 static uint8_t get_common_prefix_len_array(Datum *datums, int nTuples) {
-    Kmer* first_kmer = DatumGetKmerP(datums[0]);
-    uint8_t common_prefix_len = first_kmer->k;
+    Kmer first_kmer = DatumGetKmer(datums[0]);
+    uint8_t common_prefix_len = first_kmer.k;
     for (int i = 1; i < nTuples && common_prefix_len > 0; i++) {
-        Kmer* kmer = DatumGetKmerP(datums[i]);
+        Kmer kmer = DatumGetKmer(datums[i]);
 
-        uint8_t prefix_len = get_common_prefix_len(first_kmer, kmer);
+        uint8_t prefix_len = get_common_prefix_len(&first_kmer, &kmer);
 
         if (prefix_len < common_prefix_len) {
             common_prefix_len = prefix_len;
@@ -74,21 +157,100 @@ static bool search_nucleotide(Datum *nodeLabels, int nNodes, int16 c, int *i) {
 
 
 /**
- * @brief Match a QK-mer with a K-mer up to a certain length.
+ * @brief Scan key compiled for the consistent functions: the query is aligned on the most significant
+ * bits once, so that a K-mer (or the prefix of a subtree) is checked with a few operations on 64-bit words.
+ */
+typedef struct KmerScanKey {
+    StrategyNumber strategy;    /**< Strategy of the operator */
+    uint8_t k;                  /**< Length of the K-mer or Q-kmer of the query */
+    uint64_t key;               /**< Sort key of the K-mer of the query (= and ^@) */
+    uint64_t ac;                /**< A/C mask of the Q-kmer of the query, aligned like the sort keys (@>) */
+    uint64_t gt;                /**< G/T mask of the Q-kmer of the query, aligned like the sort keys (@>) */
+    KmerBall* ball;             /**< Ball of the query (<@) */
+} KmerScanKey;
+
+#define KMER_SPGIST_LOCAL_SCAN_KEYS 8
+
+/**
+ * @brief Compiles the scan keys of an index scan.
+ * 
+ * @param scankeys The scan keys.
+ * @param nkeys The number of scan keys.
+ * @param local_keys An array of KMER_SPGIST_LOCAL_SCAN_KEYS compiled keys, used if there are not more scan keys.
+ * @return The compiled keys.
+ */
+static KmerScanKey* compile_kmer_scan_keys(ScanKey scankeys, int nkeys, KmerScanKey* local_keys) {
+    KmerScanKey* keys = nkeys <= KMER_SPGIST_LOCAL_SCAN_KEYS ? local_keys : palloc(sizeof(KmerScanKey) * nkeys);
+    for (int j = 0; j < nkeys; j++) {
+        KmerScanKey* key = &keys[j];
+        key->strategy = scankeys[j].sk_strategy;
+        switch (key->strategy) {
+            case EQUAL_STRATEGY_NUMBER:
+            case PREFIX_STRATEGY_NUMBER: {
+                Kmer kmer = DatumGetKmer(scankeys[j].sk_argument);
+                key->k = kmer.k;
+                key->key = get_kmer_sort_key(kmer);
+                break;
+            }
+            case QKMER_MATCHING_STRATEGY_NUMBER: {
+                Qkmer* qkmer = DatumGetQkmerP(scankeys[j].sk_argument);
+                key->k = qkmer->k;
+                key->ac = qkmer->ac << (64 - 2 * qkmer->k);
+                key->gt = qkmer->gt << (64 - 2 * qkmer->k);
+                break;
+            }
+            case KMER_BALL_STRATEGY_NUMBER:
+                key->ball = DatumGetKmerBallP(scankeys[j].sk_argument);
+                break;
+            default:
+                ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("unrecognized strategy number: %d", key->strategy)));
+        }
+    }
+    return keys;
+}
+
+/**
+ * @brief Checks if the K-mers of a subtree may match a compiled scan key, from their common prefix.
+ * 
+ * @param key The compiled scan key.
+ * @param prefix The common prefix of the K-mers of the subtree.
+ * @param prefix_key The sort key of the prefix.
+ * @return false if no K-mer of the subtree matches the scan key.
+ */
+static inline bool kmer_scan_key_matches_prefix(const KmerScanKey* key, Kmer prefix, uint64_t prefix_key) {
+    switch (key->strategy) {
+        case EQUAL_STRATEGY_NUMBER:
+            return key->k >= prefix.k && ((prefix_key ^ key->key) & get_kmer_prefix_mask(prefix.k)) == 0;
+        case PREFIX_STRATEGY_NUMBER:
+            return ((prefix_key ^ key->key) & get_kmer_prefix_mask(Min(prefix.k, key->k))) == 0;
+        case QKMER_MATCHING_STRATEGY_NUMBER:
+            return qkmer_masks_match_value(key->ac, key->gt, prefix_key, get_kmer_prefix_mask(Min(prefix.k, key->k)));
+        default:
+            // Prune the branch when its prefix already has more mismatches than the radius
+            return get_kmer_distance_lower_bound(prefix.value, prefix.k, key->ball->value, key->ball->k) <= key->ball->radius;
+    }
+}
+
+/**
+ * @brief Checks if a K-mer matches a compiled scan key.
  * 
- * @param qkmer The QK-mer.
+ * @param key The compiled scan key.
  * @param kmer The K-mer.
- * @param n The number of nucleotides to compare.
- * @return true if the QK-mer matches the K-mer, false otherwise.
+ * @param kmer_key The sort key of the K-mer.
+ * @return true if the K-mer matches the scan key, false otherwise.
  */
-static bool qkmer_contains_n(Qkmer* qkmer, Kmer* kmer, uint8_t n) {
-    Qkmer* first_qkmer = get_first_k_nucleotides_qkmer(qkmer, n);
-    Kmer* first_kmer = get_first_k_nucleotides(kmer, n);
-
-    bool result = qkmer_contains_internal(first_qkmer, first_kmer);
-    pfree(first_qkmer);
-    pfree(first_kmer);
-    return result;
+static inline bool kmer_scan_key_matches(const KmerScanKey* key, Kmer kmer, uint64_t kmer_key) {
+    switch (key->strategy) {
+        case EQUAL_STRATEGY_NUMBER:
+            return key->k == kmer.k && kmer_key == key->key;
+        case PREFIX_STRATEGY_NUMBER:
+            return kmer.k >= key->k && ((kmer_key ^ key->key) & get_kmer_prefix_mask(key->k)) == 0;
+        case QKMER_MATCHING_STRATEGY_NUMBER:
+            // The Q-kmer must match the full K-mer exactly (no truncation)
+            return key->k == kmer.k && qkmer_masks_match_value(key->ac, key->gt, kmer_key, get_kmer_prefix_mask(kmer.k));
+        default:
+            return get_kmer_distance(kmer.value, kmer.k, key->ball->value, key->ball->k) <= key->ball->radius;
+    }
 }
 
 /* ************************************************************************** */
@@ -106,7 +268,7 @@ Datum kmer_spgist_config(PG_FUNCTION_ARGS) {
     spgConfigIn *in = (spgConfigIn *) PG_GETARG_POINTER(0);
 
     cfg->prefixType = in->attType;
-    cfg->labelType = INT2OID; // 2 bits for the nucleotide
+    cfg->labelType = INT2OID; // nucleotides of the node labels, see get_kmer_node_label
     // leaftype not initialized see https://www.postgresql.org/docs/current/spgist.html#SPGIST-BUILTIN-OPCLASSES-TABLE
     cfg->canReturnData = true;
     cfg->longValuesOK = false;
@@ -114,6 +276,20 @@ Datum kmer_spgist_config(PG_FUNCTION_ARGS) {
     PG_RETURN_VOID();
 }
 
+/**
+ * @brief Declares the parameters of the SP-GiST operator class.
+ * 
+ * @param relopts The local reloptions to fill.
+ */
+PG_FUNCTION_INFO_V1(kmer_spgist_options);
+Datum kmer_spgist_options(PG_FUNCTION_ARGS) {
+    local_relopts* relopts = (local_relopts*) PG_GETARG_POINTER(0);
+    init_local_reloptions(relopts, sizeof(KmerSpgistOptions));
+    add_local_int_reloption(relopts, "stride", "number of nucleotides per level of the trie (fan-out of 4^stride)",
+                            KMER_SPGIST_DEFAULT_STRIDE, 1, KMER_SPGIST_MAX_STRIDE, offsetof(KmerSpgistOptions, stride));
+    PG_RETURN_VOID();
+}
+
 /**
  * @brief Postgres function to choose the best K-mer to split a page.
  * 
@@ -126,77 +302,59 @@ kmer_spgist_choose(PG_FUNCTION_ARGS)
 {
     spgChooseIn *in = (spgChooseIn *) PG_GETARG_POINTER(0);
     spgChooseOut *out = (spgChooseOut *) PG_GETARG_POINTER(1);
+    int stride = get_kmer_spgist_stride(fcinfo);
 
     // Kmer that will be indexed
-    Kmer *kmer_in = DatumGetKmerP(in->datum);
+    Kmer kmer_in = DatumGetKmer(in->datum);
 
     uint8_t common_prefix_len = 0;
-    int16 first_non_common_nucleotide = 0;
     
     if (in->hasPrefix) {
         // K-mer that is the prefix of the indexed K-mer
-        Kmer* prefix_kmer = DatumGetKmerP(in->prefixDatum);
+        Kmer prefix_kmer = DatumGetKmer(in->prefixDatum);
 
         // prefix_kmer at the current level
-        Kmer* remaining_kmer_in = get_last_k_nucleotides(kmer_in, kmer_in->k - in->level);
+        Kmer remaining_kmer_in = get_last_k_nucleotides(&kmer_in, kmer_in.k - in->level);
 
         // common prefix length between the prefix K-mer and the indexed K-mer
-        common_prefix_len = get_common_prefix_len(remaining_kmer_in, prefix_kmer);
+        common_prefix_len = get_common_prefix_len(&remaining_kmer_in, &prefix_kmer);
 
-        if (common_prefix_len == prefix_kmer->k) {
-            if (common_prefix_len == kmer_in->k) {
-                first_non_common_nucleotide = -1;
-            } else {
-                first_non_common_nucleotide = kmer_in->value >> (2 * (kmer_in->k - common_prefix_len - in->level - 1)) & 0b11;
-            }
-        } else {
-            // split tuple
+        if (common_prefix_len < prefix_kmer.k) {
+            // split tuple, after whole strides of the prefix
+            common_prefix_len -= common_prefix_len % stride;
             out->resultType = spgSplitTuple;
 
             if (common_prefix_len == 0) {
                 out->result.splitTuple.prefixHasPrefix = false;
             } else {
                 out->result.splitTuple.prefixHasPrefix = true;
-                Kmer* prefix_prefix_kmer = get_first_k_nucleotides(prefix_kmer, common_prefix_len);
-                out->result.splitTuple.prefixPrefixDatum = KmerPGetDatum(prefix_prefix_kmer);
+                out->result.splitTuple.prefixPrefixDatum = KmerGetDatum(get_first_k_nucleotides(&prefix_kmer, common_prefix_len));
             }
             out->result.splitTuple.prefixNNodes = 1;
             out->result.splitTuple.prefixNodeLabels = (Datum *) palloc(sizeof(Datum));
-            int16 nucleotide_after_prefix_prefix = prefix_kmer->value >> (2 * (prefix_kmer->k - common_prefix_len - 1)) & 0b11;
-            out->result.splitTuple.prefixNodeLabels[0] = Int16GetDatum(nucleotide_after_prefix_prefix);
+            out->result.splitTuple.prefixNodeLabels[0] = Int16GetDatum(get_kmer_node_label(prefix_kmer, common_prefix_len, stride));
             out->result.splitTuple.childNodeN = 0;
 
-            if (prefix_kmer->k - common_prefix_len == 1) {
+            if (prefix_kmer.k - common_prefix_len == stride) {
                 out->result.splitTuple.postfixHasPrefix = false;
             } else {
                 out->result.splitTuple.postfixHasPrefix = true;
-                Kmer* prefix_postfix_kmer = get_last_k_nucleotides(prefix_kmer, prefix_kmer->k - common_prefix_len - 1);
-                out->result.splitTuple.postfixPrefixDatum = KmerPGetDatum(prefix_postfix_kmer);
+                Kmer prefix_postfix_kmer = get_last_k_nucleotides(&prefix_kmer, prefix_kmer.k - common_prefix_len - stride);
+                out->result.splitTuple.postfixPrefixDatum = KmerGetDatum(prefix_postfix_kmer);
             }
             PG_RETURN_VOID();
         }
-    } else if (kmer_in->k > in->level) { 
-        first_non_common_nucleotide = kmer_in->value >> (2 * (kmer_in->k - in->level - 1)) & 0b11;
-    } else {
-        first_non_common_nucleotide = -1;
     }
+    int16 node_label = get_kmer_node_label(kmer_in, in->level + common_prefix_len, stride);
     int position = 0;
-    if (search_nucleotide(in->nodeLabels, in->nNodes, first_non_common_nucleotide, &position)) {
+    if (search_nucleotide(in->nodeLabels, in->nNodes, node_label, &position)) {
        // Descent to existing node because it exists, at position "position"
         out->resultType = spgMatchNode;
         out->result.matchNode.nodeN = position;
 
-        int level_add = common_prefix_len;
-        if (first_non_common_nucleotide >= 0) {
-            level_add++;
-        }
+        int level_add = common_prefix_len + decode_kmer_node_label(node_label, stride).k;
         out->result.matchNode.levelAdd = level_add;
-        if (kmer_in->k - in->level - level_add > 0) {
-            Kmer* remaining_kmer_in = get_last_k_nucleotides(kmer_in, kmer_in->k - in->level - level_add);
-            out->result.matchNode.restDatum = KmerPGetDatum(remaining_kmer_in);
-        } else {
-            out->result.matchNode.restDatum = KmerPGetDatum(get_last_k_nucleotides(kmer_in, 0));
-        }
+        out->result.matchNode.restDatum = KmerGetDatum(get_last_k_nucleotides(&kmer_in, kmer_in.k - in->level - level_add));
     } else if (in->allTheSame) {
         // https://github.com/postgres/postgres/blob/master/src/backend/access/spgist/spgtextproc.c#L158
         out->resultType = spgSplitTuple;
@@ -209,7 +367,7 @@ kmer_spgist_choose(PG_FUNCTION_ARGS)
 		out->result.splitTuple.postfixHasPrefix = false;
     } else {
 		out->resultType = spgAddNode;
-        out->result.addNode.nodeLabel = Int16GetDatum(first_non_common_nucleotide);
+        out->result.addNode.nodeLabel = Int16GetDatum(node_label);
         out->result.addNode.nodeN = position;
     }
 
@@ -219,7 +377,7 @@ kmer_spgist_choose(PG_FUNCTION_ARGS)
 static int compare_nodes(const void *a, const void *b) {
     const KmerNodePtr *node_a = (const KmerNodePtr *) a;
     const KmerNodePtr *node_b = (const KmerNodePtr *) b;
-    return (int32) node_a->first_non_common_nucleotide - (int32) node_b->first_non_common_nucleotide;
+    return (int32) node_a->node_label - (int32) node_b->node_label;
 }
     
 
@@ -227,28 +385,25 @@ PG_FUNCTION_INFO_V1(kmer_spgist_picksplit);
 Datum kmer_spgist_picksplit(PG_FUNCTION_ARGS) {
     spgPickSplitIn *in = (spgPickSplitIn *) PG_GETARG_POINTER(0);
     spgPickSplitOut *out = (spgPickSplitOut *) PG_GETARG_POINTER(1);
+    int stride = get_kmer_spgist_stride(fcinfo);
 
     uint8_t common_prefix_len = get_common_prefix_len_array(in->datums, in->nTuples);
+    common_prefix_len -= common_prefix_len % stride;            // the prefix holds whole strides
 
     if (common_prefix_len == 0) {
         out->hasPrefix = false;
     } else {
         out->hasPrefix = true;
-        Kmer* kmer0 = DatumGetKmerP(in->datums[0]);
-        Kmer* prefix_kmer = get_first_k_nucleotides(kmer0, common_prefix_len);
-        out->prefixDatum = KmerPGetDatum(prefix_kmer);
+        Kmer kmer0 = DatumGetKmer(in->datums[0]);
+        out->prefixDatum = KmerGetDatum(get_first_k_nucleotides(&kmer0, common_prefix_len));
     }
 
     // Extract the first non-common nucleotide for each K-mer (Node Label)
     KmerNodePtr* nodes = (KmerNodePtr *) palloc(sizeof(KmerNodePtr) * in->nTuples);
 
     for (int i = 0; i < in->nTuples; i++) {
-        Kmer* kmer = DatumGetKmerP(in->datums[i]);
-        if (common_prefix_len == kmer->k) {
-            nodes[i].first_non_common_nucleotide = -1;
-        } else {
-            nodes[i].first_non_common_nucleotide = kmer->value >> (2 * (kmer->k - common_prefix_len - 1)) & 0b11;
-        }
+        Kmer kmer = DatumGetKmer(in->datums[i]);
+        nodes[i].node_label = get_kmer_node_label(kmer, common_prefix_len, stride);
         nodes[i].kmer_datum = in->datums[i];
         nodes[i].position = i;
     }
@@ -261,20 +416,14 @@ Datum kmer_spgist_picksplit(PG_FUNCTION_ARGS) {
     out->leafTupleDatums = (Datum *) palloc(sizeof(Datum) * in->nTuples);
 
     for (int i = 0; i < in->nTuples; i++) {
-        Kmer* kmeri = DatumGetKmerP(nodes[i].kmer_datum);
-        Datum leaf_datum;
+        Kmer kmeri = DatumGetKmer(nodes[i].kmer_datum);
 
-        if (i == 0 || nodes[i].first_non_common_nucleotide != nodes[i - 1].first_non_common_nucleotide) {
-            out->nodeLabels[out->nNodes] = Int16GetDatum(nodes[i].first_non_common_nucleotide);
+        if (i == 0 || nodes[i].node_label != nodes[i - 1].node_label) {
+            out->nodeLabels[out->nNodes] = Int16GetDatum(nodes[i].node_label);
             out->nNodes++;
         }
-        if (common_prefix_len < kmeri->k) {
-            Kmer* leaf_kmer = get_last_k_nucleotides(kmeri, kmeri->k - common_prefix_len - 1);
-            leaf_datum = KmerPGetDatum(leaf_kmer);
-        } else {
-            Kmer* leaf_kmer = get_last_k_nucleotides(kmeri, 0);
-            leaf_datum = KmerPGetDatum(leaf_kmer);
-        }
+        uint8_t label_length = decode_kmer_node_label(nodes[i].node_label, stride).k;
+        Datum leaf_datum = KmerGetDatum(get_last_k_nucleotides(&kmeri, kmeri.k - common_prefix_len - label_length));
 
         out->leafTupleDatums[nodes[i].position] = leaf_datum;
         out->mapTuplesToNodes[nodes[i].position] = out->nNodes - 1;
@@ -288,32 +437,17 @@ Datum
 kmer_spgist_inner_consistent(PG_FUNCTION_ARGS) {
     spgInnerConsistentIn *in = (spgInnerConsistentIn *) PG_GETARG_POINTER(0);
 	spgInnerConsistentOut *out = (spgInnerConsistentOut *) PG_GETARG_POINTER(1);
-    Kmer* prefix_kmer = NULL;
-    Kmer* reconstructed_kmer;
+    KmerScanKey local_keys[KMER_SPGIST_LOCAL_SCAN_KEYS];
+    KmerScanKey* keys = compile_kmer_scan_keys(in->scankeys, in->nkeys, local_keys);
+    int stride = get_kmer_spgist_stride(fcinfo);
 
-    Kmer* reconstructed_value = DatumGetKmerP(in->reconstructedValue);
-    Assert(reconstructed_value == NULL ? in->level == 0 : reconstructed_value->k == in->level);
+    Kmer reconstructed_kmer = DatumGetKmer(in->reconstructedValue);       // empty at the root
+    Assert(reconstructed_kmer.k == in->level);
 
-    int max_reconstruction_length = in->level + 1;
-
-    if (in->hasPrefix) {    // If we have a prefix
-        prefix_kmer = DatumGetKmerP(in->prefixDatum);
-        max_reconstruction_length += prefix_kmer->k;
-    }
-    reconstructed_kmer = palloc0(sizeof(Kmer));
-    reconstructed_kmer->k = max_reconstruction_length - 1;
-    reconstructed_kmer->value = 0;
-    if (in->level) {        // If we are not at the root, we need to add the first nucleotides to the reconstructed K-mer
-        Kmer* first_k_nucleotides = get_first_k_nucleotides(reconstructed_value, in->level);
-        reconstructed_kmer->value = first_k_nucleotides->value;
-        pfree(first_k_nucleotides);
-    }
-    /* 
-     * Prefix_kmer could be null, if we have no prefix, so we first check that it's not
-     * Then, if we have a prefix, we need to add it to the reconstructed K-mer
-     */
-    if (prefix_kmer && prefix_kmer->k) {
-        reconstructed_kmer->value = (reconstructed_kmer->value << (2 * prefix_kmer->k)) | prefix_kmer->value;
+    if (in->hasPrefix) {    // If we have a prefix, we need to add it to the reconstructed K-mer
+        Kmer prefix_kmer = DatumGetKmer(in->prefixDatum);
+        reconstructed_kmer.value = (reconstructed_kmer.value << (2 * prefix_kmer.k)) | prefix_kmer.value;
+        reconstructed_kmer.k += prefix_kmer.k;
     }
 
     /*
@@ -325,55 +459,39 @@ kmer_spgist_inner_consistent(PG_FUNCTION_ARGS) {
     out->nodeNumbers = (int *) palloc(sizeof(int) * in->nNodes);
 	out->levelAdds = (int *) palloc(sizeof(int) * in->nNodes);
 	out->reconstructedValues = (Datum *) palloc(sizeof(Datum) * in->nNodes);
+	if (in->norderbys > 0) {
+		out->distances = (double **) palloc(sizeof(double *) * in->nNodes);
+	}
 	out->nNodes = 0;
     for (int i = 0; i < in->nNodes; i++) {
-        int16 node_label = DatumGetInt16(in->nodeLabels[i]);
-        Kmer* current_reconstructed_kmer_to_check = palloc0(sizeof(Kmer));
-        *current_reconstructed_kmer_to_check = *reconstructed_kmer;
+        Kmer label_nucleotides = decode_kmer_node_label(DatumGetInt16(in->nodeLabels[i]), stride);
+        Kmer node_kmer = reconstructed_kmer;
+        node_kmer.value = (node_kmer.value << (2 * label_nucleotides.k)) | label_nucleotides.value;
+        node_kmer.k += label_nucleotides.k;
+        uint64_t node_key = get_kmer_sort_key(node_kmer);
         bool result = true;
-        if (node_label < 0) {
-            current_reconstructed_kmer_to_check->k = max_reconstruction_length - 1;
-        } else {
-            current_reconstructed_kmer_to_check->k = max_reconstruction_length;
-            current_reconstructed_kmer_to_check->value = (current_reconstructed_kmer_to_check->value << 2) | node_label;
-        }
-        for (int j = 0; j < in->nkeys; j++) {
-            StrategyNumber strategy = in->scankeys[j].sk_strategy;
-            
-            if (strategy == QKMER_MATCHING_STRATEGY_NUMBER) {
-                Qkmer* qkmer_in = DatumGetQkmerP(in->scankeys[j].sk_argument);
-                // Compare with our function
-                result = qkmer_contains_n(qkmer_in, current_reconstructed_kmer_to_check, Min(current_reconstructed_kmer_to_check->k, qkmer_in->k));
-            } else {
-                Kmer* kmer_in = DatumGetKmerP(in->scankeys[j].sk_argument);
-                int compare_result = compare_kmers(kmer_in, current_reconstructed_kmer_to_check, Min(current_reconstructed_kmer_to_check->k, kmer_in->k));
-                switch (strategy) {
-                    case EQUAL_STRATEGY_NUMBER:
-                        if (compare_result != 0 || kmer_in->k < current_reconstructed_kmer_to_check->k) {
-                            result = false;
-                        }
-                        break;
-                    case PREFIX_STRATEGY_NUMBER:
-                        if (compare_result != 0) {
-                            result = false;
-                        }
-                        break;
-                    default:
-                        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("unrecognized strategy number: %d", strategy)));
-                        break;
-                }
-            }
-            if (!result) {
-                break;
-            }
+        for (int j = 0; j < in->nkeys && result; j++) {
+            result = kmer_scan_key_matches_prefix(&keys[j], node_kmer, node_key);
         }
         if (result) {
             out->nodeNumbers[out->nNodes] = i;
-            out->levelAdds[out->nNodes] = current_reconstructed_kmer_to_check->k - in->level;
-            out->reconstructedValues[out->nNodes] = datumCopy(KmerPGetDatum(current_reconstructed_kmer_to_check), false, sizeof(Kmer));
+            out->levelAdds[out->nNodes] = node_kmer.k - in->level;
+            out->reconstructedValues[out->nNodes] = KmerGetDatum(node_kmer);
+            if (in->norderbys > 0) {
+                // The nodes are visited by increasing lower bound of the distance of their K-mers
+                out->distances[out->nNodes] = (double *) palloc(sizeof(double) * in->norderbys);
+                for (int j = 0; j < in->norderbys; j++) {
+                    Kmer kmer_in = DatumGetKmer(in->orderbys[j].sk_argument);
+                    out->distances[out->nNodes][j] = get_kmer_distance_lower_bound(node_kmer.value, node_kmer.k,
+                                                                                   kmer_in.value, kmer_in.k);
+                }
+            }
             out->nNodes++;
         }
     }
+    if (keys != local_keys) {
+        pfree(keys);
+    }
     PG_RETURN_VOID();
 }
 
@@ -382,49 +500,33 @@ Datum
 kmer_spgist_leaf_consistent(PG_FUNCTION_ARGS) {
     spgLeafConsistentIn *in = (spgLeafConsistentIn *) PG_GETARG_POINTER(0);
 	spgLeafConsistentOut *out = (spgLeafConsistentOut *) PG_GETARG_POINTER(1);
-
-    Kmer* full_kmer;
+    KmerScanKey local_keys[KMER_SPGIST_LOCAL_SCAN_KEYS];
+    KmerScanKey* keys = compile_kmer_scan_keys(in->scankeys, in->nkeys, local_keys);
     out->recheck = false;
 
-    Kmer* leaf_kmer = DatumGetKmerP(in->leafDatum);
-    Kmer* reconstructed_value = DatumGetKmerP(in->reconstructedValue);
+    Kmer leaf_kmer = DatumGetKmer(in->leafDatum);
+    Kmer full_kmer = DatumGetKmer(in->reconstructedValue);        // empty at the root
 
-    int full_length = in->level + leaf_kmer->k;        // Full length of the K-mer
-    if (leaf_kmer->k == 0 && in->level > 0) {
-        full_kmer = reconstructed_value;
-        out->leafValue = KmerPGetDatum(reconstructed_value);
-    } else {
-        full_kmer = palloc0(sizeof(Kmer));
-        full_kmer->k = full_length;
-        full_kmer->value = (reconstructed_value->value << (2 * leaf_kmer->k)) | leaf_kmer->value; // Combine the reconstructed value with the leaf value
-        out->leafValue = KmerPGetDatum(full_kmer);
-    }
+    full_kmer.k = in->level + leaf_kmer.k;          // Full length of the K-mer
+    full_kmer.value = (full_kmer.value << (2 * leaf_kmer.k)) | leaf_kmer.value; // Combine the reconstructed value with the leaf value
+    out->leafValue = KmerGetDatum(full_kmer);
+
+    uint64_t full_key = get_kmer_sort_key(full_kmer);
     bool result = true;
-    for (int j = 0; j < in->nkeys; j++) {
-        StrategyNumber strategy = in->scankeys[j].sk_strategy;
-        
-        if (strategy == QKMER_MATCHING_STRATEGY_NUMBER) {
-            Qkmer* qkmer_in = DatumGetQkmerP(in->scankeys[j].sk_argument);
-            // We want to check if the QK-mer contains the full K-mer exactly (no truncation)
-            result = qkmer_contains_internal(qkmer_in, full_kmer);  
-        } else if (strategy == EQUAL_STRATEGY_NUMBER) {
-            Kmer* kmer_in = DatumGetKmerP(in->scankeys[j].sk_argument);
-            // Check if the K-mers are equal
-            result = KMER_EQUAL(kmer_in, full_kmer);
-        } else if (strategy == PREFIX_STRATEGY_NUMBER) {
-            Kmer* kmer_in = DatumGetKmerP(in->scankeys[j].sk_argument);
-            // Check if the K-mer starts with the prefix
-            result = internal_kmer_startswith(full_kmer, kmer_in);
-        } else {
-            ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("unrecognized strategy number: %d", strategy)));
-            result = false;
-        }
+    for (int j = 0; j < in->nkeys && result; j++) {
+        result = kmer_scan_key_matches(&keys[j], full_kmer, full_key);
+    }
+    if (keys != local_keys) {
+        pfree(keys);
+    }
 
-        if (!result) {
-            break;
+    if (result && in->norderbys > 0) {
+        out->recheckDistances = false;
+        out->distances = (double *) palloc(sizeof(double) * in->norderbys);
+        for (int j = 0; j < in->norderbys; j++) {
+            Kmer kmer_in = DatumGetKmer(in->orderbys[j].sk_argument);
+            out->distances[j] = get_kmer_distance(full_kmer.value, full_kmer.k, kmer_in.value, kmer_in.k);
         }
-
     }
-    
     PG_RETURN_BOOL(result);
 }
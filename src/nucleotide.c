@@ -0,0 +1,428 @@
+#include "nucleotide.h"
+#include "port/pg_bswap.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define USE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#define VALID_NUCLEOTIDE 0b100
+
+/**
+ * @brief LUT to convert an ASCII character to a 2-bit representation (case-insensitive).
+ *
+ * Nucleotides have the VALID_NUCLEOTIDE bit set on top of their 2-bit representation,
+ * every other character is mapped to 0.
+ */
+static const uint8_t ASCII_TO_NUCLEOTIDE[256] = {
+    ['A'] = VALID_NUCLEOTIDE | 0b00, ['a'] = VALID_NUCLEOTIDE | 0b00,
+    ['C'] = VALID_NUCLEOTIDE | 0b01, ['c'] = VALID_NUCLEOTIDE | 0b01,
+    ['G'] = VALID_NUCLEOTIDE | 0b10, ['g'] = VALID_NUCLEOTIDE | 0b10,
+    ['T'] = VALID_NUCLEOTIDE | 0b11, ['t'] = VALID_NUCLEOTIDE | 0b11
+};
+
+/**
+ * @brief LUT to fold an IUPAC ambiguity code (N, R, Y, ...) to upper case, every other character is mapped to 0.
+ */
+static const char ASCII_TO_AMBIGUITY_CODE[256] = {
+    ['N'] = 'N', ['n'] = 'N', ['R'] = 'R', ['r'] = 'R', ['Y'] = 'Y', ['y'] = 'Y',
+    ['S'] = 'S', ['s'] = 'S', ['W'] = 'W', ['w'] = 'W', ['K'] = 'K', ['k'] = 'K',
+    ['M'] = 'M', ['m'] = 'M', ['B'] = 'B', ['b'] = 'B', ['D'] = 'D', ['d'] = 'D',
+    ['H'] = 'H', ['h'] = 'H', ['V'] = 'V', ['v'] = 'V'
+};
+
+/* Helpers to build BYTE_TO_NUCLEOTIDES at compile time */
+#define NUCLEOTIDE_CHAR(bits) ((bits) == 0b00 ? 'A' : (bits) == 0b01 ? 'C' : (bits) == 0b10 ? 'G' : 'T')
+#define BYTE_NUCLEOTIDES(b) { NUCLEOTIDE_CHAR(((b) >> 6) & 0b11), NUCLEOTIDE_CHAR(((b) >> 4) & 0b11), \
+                              NUCLEOTIDE_CHAR(((b) >> 2) & 0b11), NUCLEOTIDE_CHAR((b) & 0b11) }
+#define BYTES_4(b)   BYTE_NUCLEOTIDES(b), BYTE_NUCLEOTIDES((b) + 1), BYTE_NUCLEOTIDES((b) + 2), BYTE_NUCLEOTIDES((b) + 3)
+#define BYTES_16(b)  BYTES_4(b), BYTES_4((b) + 4), BYTES_4((b) + 8), BYTES_4((b) + 12)
+#define BYTES_64(b)  BYTES_16(b), BYTES_16((b) + 16), BYTES_16((b) + 32), BYTES_16((b) + 48)
+
+/**
+ * @brief LUT to convert a packed byte to its 4 nucleotides.
+ */
+static const char BYTE_TO_NUCLEOTIDES[256][4] = {
+    BYTES_64(0), BYTES_64(64), BYTES_64(128), BYTES_64(192)
+};
+
+/**
+ * @brief Function packing as many full blocks of nucleotides as possible.
+ * It stops before the first block holding a character that is not a nucleotide.
+ *
+ * @param str The string representing the DNA sequence.
+ * @param length The length of the DNA sequence.
+ * @param out The output buffer, receiving 4 nucleotides per byte.
+ * @return The number of nucleotides packed (always a multiple of 4).
+ */
+typedef uint32_t (*pack_blocks_function)(const char* str, uint32_t length, uint8_t* out);
+
+static uint32_t pack_blocks_choose(const char* str, uint32_t length, uint8_t* out);
+
+/* Block packer used by pack_nucleotides(), resolved on first use to the best one supported by the CPU */
+static pack_blocks_function pack_blocks = pack_blocks_choose;
+
+/**
+ * @brief Function unpacking as many full blocks of nucleotides as possible.
+ *
+ * @param packed The packed nucleotides (4 per byte).
+ * @param length The number of nucleotides to unpack.
+ * @param out The output buffer, receiving one character per nucleotide.
+ * @return The number of nucleotides unpacked (always a multiple of 4).
+ */
+typedef uint32_t (*unpack_blocks_function)(const uint8_t* packed, uint32_t length, char* out);
+
+static uint32_t unpack_blocks_choose(const uint8_t* packed, uint32_t length, char* out);
+
+/* Block unpacker used by unpack_nucleotides(), resolved on first use like pack_blocks */
+static unpack_blocks_function unpack_blocks = unpack_blocks_choose;
+
+/**
+ * @brief Packs nucleotides one at a time, stopping at the first character that is not a nucleotide.
+ * The nucleotides are OR-ed into the output buffer, which must be zeroed.
+ *
+ * @param str The string of nucleotides.
+ * @param length The length of the string.
+ * @param out The output buffer.
+ * @param position The position in out receiving the first nucleotide of str.
+ * @return The number of nucleotides packed.
+ */
+static uint32_t pack_nucleotides_scalar(const char* str, uint32_t length, uint8_t* out, uint32_t position) {
+    for (uint32_t i = 0; i < length; i++, position++) {
+        uint8_t nucleotide = ASCII_TO_NUCLEOTIDE[(uint8_t) str[i]];
+        if (!(nucleotide & VALID_NUCLEOTIDE)) {
+            return i;
+        }
+        out[position / 4] |= (nucleotide & 0b11) << (6 - (position % 4) * 2);
+    }
+    return length;
+}
+
+/**
+ * @brief Unpacks nucleotides with BYTE_TO_NUCLEOTIDES, starting at a position that is a multiple of 4.
+ *
+ * @param packed The packed nucleotides.
+ * @param start The position of the first nucleotide to unpack.
+ * @param length The number of nucleotides.
+ * @param out The output buffer.
+ */
+static void unpack_nucleotides_scalar(const uint8_t* packed, uint32_t start, uint32_t length, char* out) {
+    uint32_t i = start;
+    for (; i + 4 <= length; i += 4) {
+        memcpy(out + i, BYTE_TO_NUCLEOTIDES[packed[i / 4]], 4);
+    }
+    if (i < length) {
+        memcpy(out + i, BYTE_TO_NUCLEOTIDES[packed[i / 4]], length - i);    // the last byte might not hold 4 nucleotides
+    }
+}
+
+#ifdef USE_X86_SIMD
+
+/*
+ * Once folded to upper case, A = 0x41, C = 0x43, G = 0x47 and T = 0x54, so ((c >> 1) ^ (c >> 2)) & 0b11
+ * gives 0, 1, 2 and 3 respectively. Bit 5 (the case bit) is never used, so this also works on lower case.
+ * The 16-bit shifts leak bits across byte boundaries, but only into bits that are masked out.
+ *
+ * Each 32-bit lane then holds 4 codes c0 | c1 << 8 | c2 << 16 | c3 << 24 (little endian) that are
+ * combined into the byte c0 << 6 | c1 << 4 | c2 << 2 | c3, and the lanes are narrowed to bytes.
+ */
+
+/**
+ * @brief Packs blocks of 16 nucleotides with SSE2.
+ */
+static uint32_t pack_blocks_sse2(const char* str, uint32_t length, uint8_t* out) {
+    const __m128i case_mask = _mm_set1_epi8((char) 0xDF);
+    const __m128i a = _mm_set1_epi8('A');
+    const __m128i c = _mm_set1_epi8('C');
+    const __m128i g = _mm_set1_epi8('G');
+    const __m128i t = _mm_set1_epi8('T');
+    const __m128i code_mask = _mm_set1_epi8(0b11);
+    uint32_t i = 0;
+
+    for (; i + 16 <= length; i += 16) {
+        __m128i chars = _mm_loadu_si128((const __m128i *) (str + i));
+        __m128i upper = _mm_and_si128(chars, case_mask);
+        __m128i valid = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(upper, a), _mm_cmpeq_epi8(upper, c)),
+                                     _mm_or_si128(_mm_cmpeq_epi8(upper, g), _mm_cmpeq_epi8(upper, t)));
+        uint32_t valid_mask = (uint32_t) _mm_movemask_epi8(valid);
+        if (valid_mask != 0xFFFF) {
+            break;                                      // the scalar loop will locate the invalid character
+        }
+
+        __m128i codes = _mm_and_si128(_mm_xor_si128(_mm_srli_epi16(chars, 1), _mm_srli_epi16(chars, 2)), code_mask);
+        __m128i packed = _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(_mm_slli_epi32(codes, 6), _mm_set1_epi32(0xC0)),
+                         _mm_and_si128(_mm_srli_epi32(codes, 4), _mm_set1_epi32(0x30))),
+            _mm_or_si128(_mm_and_si128(_mm_srli_epi32(codes, 14), _mm_set1_epi32(0x0C)),
+                         _mm_srli_epi32(codes, 24)));
+        packed = _mm_packs_epi32(packed, packed);
+        packed = _mm_packus_epi16(packed, packed);
+
+        uint32_t bytes = (uint32_t) _mm_cvtsi128_si32(packed);
+        memcpy(out + i / 4, &bytes, sizeof(bytes));
+    }
+    return i;
+}
+
+/**
+ * @brief Packs blocks of 32 nucleotides with AVX2.
+ * The pack instructions work within 128-bit lanes, so each half gives 4 output bytes.
+ */
+__attribute__((target("avx2")))
+static uint32_t pack_blocks_avx2(const char* str, uint32_t length, uint8_t* out) {
+    const __m256i case_mask = _mm256_set1_epi8((char) 0xDF);
+    const __m256i a = _mm256_set1_epi8('A');
+    const __m256i c = _mm256_set1_epi8('C');
+    const __m256i g = _mm256_set1_epi8('G');
+    const __m256i t = _mm256_set1_epi8('T');
+    const __m256i code_mask = _mm256_set1_epi8(0b11);
+    uint32_t i = 0;
+
+    for (; i + 32 <= length; i += 32) {
+        __m256i chars = _mm256_loadu_si256((const __m256i *) (str + i));
+        __m256i upper = _mm256_and_si256(chars, case_mask);
+        __m256i valid = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(upper, a), _mm256_cmpeq_epi8(upper, c)),
+                                        _mm256_or_si256(_mm256_cmpeq_epi8(upper, g), _mm256_cmpeq_epi8(upper, t)));
+        uint32_t valid_mask = (uint32_t) _mm256_movemask_epi8(valid);
+        if (valid_mask != 0xFFFFFFFF) {
+            break;                                      // the scalar loop will locate the invalid character
+        }
+
+        __m256i codes = _mm256_and_si256(_mm256_xor_si256(_mm256_srli_epi16(chars, 1), _mm256_srli_epi16(chars, 2)), code_mask);
+        __m256i packed = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(codes, 6), _mm256_set1_epi32(0xC0)),
+                            _mm256_and_si256(_mm256_srli_epi32(codes, 4), _mm256_set1_epi32(0x30))),
+            _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(codes, 14), _mm256_set1_epi32(0x0C)),
+                            _mm256_srli_epi32(codes, 24)));
+        packed = _mm256_packs_epi32(packed, packed);
+        packed = _mm256_packus_epi16(packed, packed);
+
+        uint32_t low_bytes = (uint32_t) _mm_cvtsi128_si32(_mm256_castsi256_si128(packed));
+        uint32_t high_bytes = (uint32_t) _mm_cvtsi128_si32(_mm256_extracti128_si256(packed, 1));
+        memcpy(out + i / 4, &low_bytes, sizeof(low_bytes));
+        memcpy(out + i / 4 + 4, &high_bytes, sizeof(high_bytes));
+    }
+    return i;
+}
+
+/*
+ * Unpacking: every packed byte is first spread over 4 output bytes with a shuffle, and each output byte
+ * keeps only its own 2-bit field (masks 0xC0, 0x30, 0x0C, 0x03). OR-ing the field with itself shifted
+ * right by 4 gives an index in {0, 1, 2, 3} or {0, 4, 8, 12}, which a second shuffle maps to a character.
+ */
+#define FIELD_MASKS 0x030C30C0
+#define FIELD_TO_NUCLEOTIDE 'A', 'C', 'G', 'T', 'C', 0, 0, 0, 'G', 0, 0, 0, 'T', 0, 0, 0
+
+/**
+ * @brief Converts spread packed bytes to characters with SSSE3.
+ */
+__attribute__((target("ssse3")))
+static inline __m128i expand_nucleotides_ssse3(__m128i bytes, __m128i spread) {
+    const __m128i table = _mm_setr_epi8(FIELD_TO_NUCLEOTIDE);
+    __m128i fields = _mm_and_si128(_mm_shuffle_epi8(bytes, spread), _mm_set1_epi32(FIELD_MASKS));
+    __m128i index = _mm_and_si128(_mm_or_si128(fields, _mm_srli_epi16(fields, 4)), _mm_set1_epi8(0x0F));
+    return _mm_shuffle_epi8(table, index);
+}
+
+/**
+ * @brief Unpacks blocks of 32 nucleotides (8 bytes) with SSSE3.
+ */
+__attribute__((target("ssse3")))
+static uint32_t unpack_blocks_ssse3(const uint8_t* packed, uint32_t length, char* out) {
+    const __m128i spread_low = _mm_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3);
+    const __m128i spread_high = _mm_setr_epi8(4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7);
+    uint32_t i = 0;
+
+    for (; i + 32 <= length; i += 32) {
+        __m128i bytes = _mm_loadl_epi64((const __m128i *) (packed + i / 4));
+        _mm_storeu_si128((__m128i *) (out + i), expand_nucleotides_ssse3(bytes, spread_low));
+        _mm_storeu_si128((__m128i *) (out + i + 16), expand_nucleotides_ssse3(bytes, spread_high));
+    }
+    return i;
+}
+
+/**
+ * @brief Converts spread packed bytes to characters with AVX2.
+ */
+__attribute__((target("avx2")))
+static inline __m256i expand_nucleotides_avx2(__m256i bytes, __m256i spread) {
+    const __m256i table = _mm256_setr_epi8(FIELD_TO_NUCLEOTIDE, FIELD_TO_NUCLEOTIDE);
+    __m256i fields = _mm256_and_si256(_mm256_shuffle_epi8(bytes, spread), _mm256_set1_epi32(FIELD_MASKS));
+    __m256i index = _mm256_and_si256(_mm256_or_si256(fields, _mm256_srli_epi16(fields, 4)), _mm256_set1_epi8(0x0F));
+    return _mm256_shuffle_epi8(table, index);
+}
+
+/**
+ * @brief Unpacks blocks of 64 nucleotides (16 bytes) with AVX2.
+ * The 16 bytes are copied to both 128-bit lanes since shuffles cannot cross lanes.
+ */
+__attribute__((target("avx2")))
+static uint32_t unpack_blocks_avx2(const uint8_t* packed, uint32_t length, char* out) {
+    const __m256i spread_low = _mm256_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                                4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7);
+    const __m256i spread_high = _mm256_setr_epi8(8, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 11, 11, 11, 11,
+                                                 12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15);
+    uint32_t i = 0;
+
+    for (; i + 64 <= length; i += 64) {
+        __m256i bytes = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) (packed + i / 4)));
+        _mm256_storeu_si256((__m256i *) (out + i), expand_nucleotides_avx2(bytes, spread_low));
+        _mm256_storeu_si256((__m256i *) (out + i + 32), expand_nucleotides_avx2(bytes, spread_high));
+    }
+    return i;
+}
+
+#endif
+
+/**
+ * @brief Fallback when no vector instructions are available: everything is handled by the scalar loops.
+ */
+pg_attribute_unused()
+static uint32_t pack_blocks_none(const char* str, uint32_t length, uint8_t* out) {
+    return 0;
+}
+
+pg_attribute_unused()
+static uint32_t unpack_blocks_none(const uint8_t* packed, uint32_t length, char* out) {
+    return 0;
+}
+
+/**
+ * @brief Selects the block packer for the current CPU on first use.
+ */
+static uint32_t pack_blocks_choose(const char* str, uint32_t length, uint8_t* out) {
+#ifdef USE_X86_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        pack_blocks = pack_blocks_avx2;
+    } else {
+        pack_blocks = pack_blocks_sse2;
+    }
+#else
+    pack_blocks = pack_blocks_none;
+#endif
+    return pack_blocks(str, length, out);
+}
+
+/**
+ * @brief Selects the block unpacker for the current CPU on first use.
+ */
+static uint32_t unpack_blocks_choose(const uint8_t* packed, uint32_t length, char* out) {
+#ifdef USE_X86_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        unpack_blocks = unpack_blocks_avx2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        unpack_blocks = unpack_blocks_ssse3;
+    } else {
+        unpack_blocks = unpack_blocks_none;
+    }
+#else
+    unpack_blocks = unpack_blocks_none;
+#endif
+    return unpack_blocks(packed, length, out);
+}
+
+/* ************************************************************************** */
+
+/**
+ * @brief Packs a string of nucleotides into a 2-bit representation (4 nucleotides per byte, first
+ * nucleotide in the most significant bits). The string is validated and case-folded on the fly,
+ * and packing stops at the first character that is not a nucleotide.
+ *
+ * @param str The string of nucleotides.
+ * @param length The length of the string.
+ * @param out The output buffer, which must hold (position + length + 3) / 4 bytes, zeroed after position.
+ * @param position The position in out receiving the first nucleotide of str.
+ * @return The number of nucleotides packed, less than length if str holds an invalid character.
+ */
+uint32_t pack_nucleotides(const char* str, uint32_t length, uint8_t* out, uint32_t position) {
+    uint32_t head = Min(length, (4 - position % 4) % 4);            // the vector loops need a byte boundary
+    uint32_t packed = pack_nucleotides_scalar(str, head, out, position);
+    if (packed < head) {
+        return packed;
+    }
+    packed += pack_blocks(str + packed, length - packed, out + (position + packed) / 4);
+    return packed + pack_nucleotides_scalar(str + packed, length - packed, out, position + packed);
+}
+
+/**
+ * @brief Folds an IUPAC ambiguity code to upper case.
+ *
+ * @param c The character.
+ * @return The upper case ambiguity code, or 0 if c is not an ambiguity code.
+ */
+char fold_ambiguity_code(char c) {
+    return ASCII_TO_AMBIGUITY_CODE[(uint8_t) c];
+}
+
+/**
+ * @brief Unpacks a 2-bit representation of nucleotides into characters.
+ * No terminating null character is written.
+ *
+ * @param packed The packed nucleotides (4 per byte, first nucleotide in the most significant bits).
+ * @param length The number of nucleotides to unpack.
+ * @param out The output buffer, which must hold length characters.
+ */
+void unpack_nucleotides(const uint8_t* packed, uint32_t length, char* out) {
+    uint32_t unpacked = unpack_blocks(packed, length, out);
+    unpack_nucleotides_scalar(packed, unpacked, length, out);
+}
+
+/**
+ * @brief Unpacks the value of a K-mer (right-aligned, 2 bits per nucleotide) into characters.
+ * No terminating null character is written.
+ *
+ * @param value The value of the K-mer.
+ * @param k The length of the K-mer.
+ * @param out The output buffer, which must hold k characters.
+ */
+void unpack_kmer_value(uint64_t value, uint8_t k, char* out) {
+    if (k == 0) {
+        return;
+    }
+    uint64_t left_aligned = pg_hton64(value << (64 - 2 * k));     // first nucleotide in the first byte
+    unpack_nucleotides_scalar((const uint8_t*) &left_aligned, 0, k, out);
+}
+
+/**
+ * @brief Computes the reverse complement of the value of a K-mer without any loop or branch.
+ * The complement of a nucleotide is its bitwise NOT (A = 00 <-> T = 11, C = 01 <-> G = 10), and the
+ * 2-bit fields are reversed by swapping pairs, then nibbles, then bytes.
+ *
+ * @param value The value of the K-mer (right-aligned, 2 bits per nucleotide).
+ * @param k The length of the K-mer (1-32).
+ * @return The value of the reverse complement.
+ */
+uint64_t reverse_complement_kmer_value(uint64_t value, uint8_t k) {
+    uint64_t reversed = ~value;
+    reversed = ((reversed >> 2) & UINT64CONST(0x3333333333333333)) | ((reversed & UINT64CONST(0x3333333333333333)) << 2);
+    reversed = ((reversed >> 4) & UINT64CONST(0x0F0F0F0F0F0F0F0F)) | ((reversed & UINT64CONST(0x0F0F0F0F0F0F0F0F)) << 4);
+    reversed = pg_bswap64(reversed);
+    return reversed >> (64 - 2 * k);                    // drops the complemented bits that were above the K-mer
+}
+
+/**
+ * @brief Copies packed nucleotides to a new buffer, realigning them so that the first copied nucleotide
+ * is in the most significant bits of the first byte. The unused bits of the last byte are cleared.
+ *
+ * @param src The packed source, whose first byte holds the first nucleotide to copy.
+ * @param offset The position of the first nucleotide to copy in the first byte of src (0-3).
+ * @param length The number of nucleotides to copy.
+ * @param dst The packed destination, which must hold (length + 3) / 4 bytes.
+ */
+void copy_nucleotides(const uint8_t* src, uint8_t offset, uint32_t length, uint8_t* dst) {
+    uint32_t nb_bytes = (length + 3) / 4;
+    uint8_t shift = offset * 2;
+
+    if (shift == 0) {
+        memcpy(dst, src, nb_bytes);
+    } else {
+        uint32_t src_bytes = (offset + length + 3) / 4;
+        for (uint32_t i = 0; i < nb_bytes; i++) {
+            uint8_t next_byte = i + 1 < src_bytes ? src[i + 1] : 0;
+            dst[i] = (uint8_t) (src[i] << shift) | (next_byte >> (8 - shift));
+        }
+    }
+    if (length % 4 != 0) {
+        dst[nb_bytes - 1] &= (uint8_t) (0xFF << (8 - 2 * (length % 4)));
+    }
+}
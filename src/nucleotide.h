@@ -0,0 +1,15 @@
+#ifndef NUCLEOTIDE_H
+#define NUCLEOTIDE_H
+
+#include "kmea.h"
+#include <stdint.h>
+#include <string.h>
+
+uint32_t pack_nucleotides(const char* str, uint32_t length, uint8_t* out, uint32_t position);
+char fold_ambiguity_code(char c);
+void unpack_nucleotides(const uint8_t* packed, uint32_t length, char* out);
+void unpack_kmer_value(uint64_t value, uint8_t k, char* out);
+uint64_t reverse_complement_kmer_value(uint64_t value, uint8_t k);
+void copy_nucleotides(const uint8_t* src, uint8_t offset, uint32_t length, uint8_t* dst);
+
+#endif
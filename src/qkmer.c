@@ -88,69 +88,35 @@ static Qkmer* make_qkmer_from_str(const char* str, uint8_t length) {
 }
 
 /**
- * @brief Converts a Q-kmer to a string.
+ * @brief Writes the IUPAC codes of a Q-kmer into a buffer.
+ * No terminating null character is written.
  * 
  * @param qkmer The Q-kmer to convert.
- * @return The string representation of the Q-kmer.
+ * @param out The output buffer, which must hold qkmer->k characters.
  */
-static char* qkmer_value_to_string(Qkmer* qkmer) {
-    char str[32];
+static void qkmer_write_codes(Qkmer* qkmer, char* out) {
     for (uint8_t i = 0; i < qkmer -> k; i++) {
         uint8_t shift = (qkmer -> k - i - 1) * 2;
-        uint8_t ac_nucleotide = (qkmer -> ac >> shift) & 0b11;
-        uint8_t gt_nucleotide = (qkmer -> gt >> shift) & 0b11;
-
-        uint8_t nucleotide = (ac_nucleotide << 2) | gt_nucleotide;
-        char c = BINARY_TO_IUPAC_CODE[nucleotide];
-        if (c == '$') {                                             // This is maybe not the best way to handle this
-            ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION), // This should also never happen
-                            errmsg("invalid nucleotide")));
-        }
-        str[i] = c;
+        uint8_t nucleotide = (((qkmer -> ac >> shift) & 0b11) << 2) | ((qkmer -> gt >> shift) & 0b11);
+        out[i] = BINARY_TO_IUPAC_CODE[nucleotide];
+    }
+    if (memchr(out, '$', qkmer -> k)) {                                 // This should never happen
+        ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+                        errmsg("invalid nucleotide")));
     }
-    str[qkmer -> k] = '\0';
-    return psprintf("%s", str);
 }
 
 /**
- * @brief Creates a Q-kmer from a K-mer.
+ * @brief Converts a Q-kmer to a string.
  * 
- * @param kmer The K-mer to create the Q-kmer from.
- * @return A pointer to the created Q-kmer.
+ * @param qkmer The Q-kmer to convert.
+ * @return The string representation of the Q-kmer.
  */
-static Qkmer* make_qkmer_from_kmer(Kmer* kmer) {
-    Qkmer* qkmer = palloc0(sizeof(Qkmer));
-    qkmer -> k = kmer -> k;
-
-    // Masks for extracting 2-bit pairs
-    const uint64_t odd_position_pair_mask = 0x3333333333333333; // Binary: 00110011... (two 1s in each pair)
-    const uint64_t even_position_pair_mask = 0xCCCCCCCCCCCCCCCC; // Binary: 11001100... (two 0s in each pair)
-    const uint64_t zero_one_mask = 0x5555555555555555; // Binary: 01010101... 
-    const uint64_t one_zero_mask = 0xAAAAAAAAAAAAAAAA; // Binary: 10101010... 
-
-    // Isolate T (11):
-    uint64_t t_odd = kmer->value & odd_position_pair_mask;
-    uint64_t t_even = kmer->value & even_position_pair_mask;
-    uint64_t t = (t_odd & (t_odd >> 1)) | (t_even & (t_even >> 1));
-
-    // Isolate A (00): 
-    uint64_t a_odd = ~kmer->value & odd_position_pair_mask; 
-    uint64_t a_even = ~kmer->value & even_position_pair_mask;   
-    uint64_t a = (a_odd & (a_odd >> 1)) | (a_even & (a_even >> 1));
-    a = a << 1;                                                     // to have 10 instead of 01
-
-    // Isolate C (01):
-    uint64_t c = kmer->value & zero_one_mask & ~t;
-
-    // Isolate G (10):
-    uint64_t g = (kmer->value & one_zero_mask) >> 1 & ~t;
-    g = g << 1;                                                     // to have 10 instead of 01
-
-    uint64_t length_mask = (1ULL << (kmer -> k * 2)) - 1;
-
-    qkmer -> ac = (a | c) & length_mask; // Mask to get rid of the bits that are not part of the k-mer (is necessary here)
-    qkmer -> gt = (g | t) & length_mask; // Mask to get rid of the bits that are not part of the k-mer (should not shange anything here)
-    return qkmer;
+static char* qkmer_value_to_string(Qkmer* qkmer) {
+    char* str = palloc(qkmer -> k + 1);
+    qkmer_write_codes(qkmer, str);
+    str[qkmer -> k] = '\0';
+    return str;
 }
 
 /**
@@ -203,11 +169,7 @@ bool qkmer_contains_internal(Qkmer* qkmer, Kmer* kmer) {
         return false;
     }
 
-    Qkmer* qkmer_from_kmer = make_qkmer_from_kmer(kmer);
-    bool result = (qkmer_from_kmer -> ac & qkmer -> ac) == qkmer_from_kmer -> ac &&
-                  (qkmer_from_kmer -> gt & qkmer -> gt) == qkmer_from_kmer -> gt;
-    pfree(qkmer_from_kmer);
-    return result;
+    return qkmer_matches_kmer_value(qkmer, kmer -> value);
 }
 
 
@@ -240,11 +202,19 @@ Datum qkmer_out(PG_FUNCTION_ARGS) {
     PG_RETURN_CSTRING(str);
 }
 
+/*
+ * Binary format of Q-kmer (used by qkmer_send and qkmer_recv):
+ *   int64   A/C part, 2 bits per position (A = 10, C = 01), last position in the least significant bits
+ *   int64   G/T part, 2 bits per position (G = 10, T = 01)
+ *   int8    length k (1-32); both parts must be 0 above their 2 * k lowest bits, and every position
+ *           must allow at least one nucleotide
+ */
+
 /**
- * @brief Postgres receive function for Q-kmer.
+ * @brief Postgres send function for Q-kmer.
  * 
- * @param buf The bytea representation of the Q-kmer.
- * @return The Q-kmer object created from the bytea.
+ * @param qkmer The Q-kmer object.
+ * @return The binary representation of the Q-kmer.
  */
 PG_FUNCTION_INFO_V1(qkmer_send);
 Datum qkmer_send(PG_FUNCTION_ARGS) {
@@ -261,8 +231,8 @@ Datum qkmer_send(PG_FUNCTION_ARGS) {
 /**
  * @brief Postgres receive function for Q-kmer.
  * 
- * @param buf The bytea representation of the Q-kmer.
- * @return The Q-kmer object created from the bytea.
+ * @param buf The binary representation of the Q-kmer.
+ * @return The Q-kmer object created from the binary representation.
  */
 PG_FUNCTION_INFO_V1(qkmer_recv);
 Datum qkmer_recv(PG_FUNCTION_ARGS) {
@@ -270,7 +240,18 @@ Datum qkmer_recv(PG_FUNCTION_ARGS) {
     Qkmer* qkmer = palloc0(sizeof(Qkmer));
     qkmer -> ac = pq_getmsgint64(buf);
     qkmer -> gt = pq_getmsgint64(buf);
-    qkmer -> k = pq_getmsgint(buf, 8);
+    qkmer -> k = pq_getmsgbyte(buf);
+    if (qkmer -> k == 0 || qkmer -> k > 32) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+                        errmsg("invalid qkmer length in external value: %d", qkmer -> k)));
+    }
+    uint64_t length_mask = qkmer -> k == 32 ? UINT64_MAX : (1ULL << (2 * qkmer -> k)) - 1;
+    uint64_t allowed = qkmer -> ac | qkmer -> gt;
+    if ((allowed & ~length_mask) != 0 ||
+        ((allowed | (allowed >> 1)) & 0x5555555555555555 & length_mask) != (0x5555555555555555 & length_mask)) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+                        errmsg("invalid qkmer value in external value")));
+    }
     PG_RETURN_QKMER_P(qkmer);
 }
 
@@ -298,7 +279,9 @@ Datum qkmer_cast_from_text(PG_FUNCTION_ARGS) {
 PG_FUNCTION_INFO_V1(qkmer_cast_to_text);
 Datum qkmer_cast_to_text(PG_FUNCTION_ARGS) {
     Qkmer* qkmer = PG_GETARG_QKMER_P(0);
-    text* out = (text *)DirectFunctionCall1(textin, PointerGetDatum(qkmer_value_to_string(qkmer)));
+    text* out = (text *) palloc(VARHDRSZ + qkmer -> k);
+    SET_VARSIZE(out, VARHDRSZ + qkmer -> k);
+    qkmer_write_codes(qkmer, VARDATA(out));
     PG_FREE_IF_COPY(qkmer, 0);
     PG_RETURN_TEXT_P(out);
 }
@@ -313,12 +296,11 @@ Datum qkmer_cast_to_text(PG_FUNCTION_ARGS) {
 PG_FUNCTION_INFO_V1(qkmer_contains);
 Datum qkmer_contains(PG_FUNCTION_ARGS) {
     Qkmer* qkmer = PG_GETARG_QKMER_P(0);
-    Kmer* kmer = PG_GETARG_KMER_P(1);
+    Kmer kmer = PG_GETARG_KMER(1);
     
-    bool result = qkmer_contains_internal(qkmer, kmer);
+    bool result = qkmer_contains_internal(qkmer, &kmer);
 
     PG_FREE_IF_COPY(qkmer, 0);
-    PG_FREE_IF_COPY(kmer, 1);
     PG_RETURN_BOOL(result);
 }
 
@@ -334,4 +316,63 @@ Datum qkmer_length(PG_FUNCTION_ARGS) {
     uint8_t length = qkmer -> k;
     PG_FREE_IF_COPY(qkmer, 0);
     PG_RETURN_CHAR(length);
+}
+
+/**
+ * @brief Hashes a Q-kmer with a seed. Its length need not be hashed: every position of a Q-kmer allows
+ * a nucleotide, and the bits after the last one are zero.
+ * With seed 0, the low 32 bits are the standard hash of the Q-kmer, as PostgreSQL requires.
+ * 
+ * @param qkmer The Q-kmer.
+ * @param seed The seed.
+ * @return The hash of the Q-kmer.
+ */
+static uint64 get_qkmer_hash(const Qkmer* qkmer, uint64 seed) {
+    return murmurhash64(hash_combine64(murmurhash64(qkmer -> ac ^ murmurhash64(seed)), qkmer -> gt));
+}
+
+/**
+ * @brief Checks if two Q-kmers are equal, i.e. allow the same nucleotides at each position.
+ * 
+ * @param a The first Q-kmer.
+ * @param b The second Q-kmer.
+ * @return True if the Q-kmers are equal, false otherwise.
+ */
+PG_FUNCTION_INFO_V1(qkmer_eq);
+Datum qkmer_eq(PG_FUNCTION_ARGS) {
+    Qkmer* a = PG_GETARG_QKMER_P(0);
+    Qkmer* b = PG_GETARG_QKMER_P(1);
+    bool result = a -> k == b -> k && a -> ac == b -> ac && a -> gt == b -> gt;
+    PG_FREE_IF_COPY(a, 0);
+    PG_FREE_IF_COPY(b, 1);
+    PG_RETURN_BOOL(result);
+}
+
+/**
+ * @brief Returns the hash value of a Q-kmer (hash support function 1).
+ * 
+ * @param qkmer The Q-kmer to get the hash value of.
+ * @return The hash value of the Q-kmer.
+ */
+PG_FUNCTION_INFO_V1(qkmer_hash);
+Datum qkmer_hash(PG_FUNCTION_ARGS) {
+    Qkmer* qkmer = PG_GETARG_QKMER_P(0);
+    int32 hash = (int32) get_qkmer_hash(qkmer, 0);
+    PG_FREE_IF_COPY(qkmer, 0);
+    PG_RETURN_INT32(hash);
+}
+
+/**
+ * @brief Returns the seeded 64-bit hash value of a Q-kmer (hash support function 2).
+ * 
+ * @param qkmer The Q-kmer to get the hash value of.
+ * @param seed The seed.
+ * @return The hash value of the Q-kmer.
+ */
+PG_FUNCTION_INFO_V1(qkmer_hash_extended);
+Datum qkmer_hash_extended(PG_FUNCTION_ARGS) {
+    Qkmer* qkmer = PG_GETARG_QKMER_P(0);
+    int64 hash = (int64) get_qkmer_hash(qkmer, (uint64) PG_GETARG_INT64(1));
+    PG_FREE_IF_COPY(qkmer, 0);
+    PG_RETURN_INT64(hash);
 }
\ No newline at end of file
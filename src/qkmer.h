@@ -2,9 +2,55 @@
 #define QKMER_H
 
 #include "kmea.h"
+#include "common/hashfn.h"
 
 Qkmer* get_first_k_nucleotides_qkmer(Qkmer* qkmer, uint8_t k);
 
 bool qkmer_contains_internal(Qkmer* qkmer, Kmer* kmer);
 
+/**
+ * @brief Gets the nucleotides allowed by a Q-kmer at a position.
+ * 
+ * @param qkmer The Q-kmer.
+ * @param position The (0-based) position.
+ * @return A mask whose bit n is set when the nucleotide of 2-bit value n is allowed (A = 0, C = 1, G = 2, T = 3).
+ */
+static inline uint8_t get_qkmer_nucleotides(const Qkmer* qkmer, uint8_t position) {
+    uint8_t shift = 2 * (qkmer->k - 1 - position);
+    uint8_t ac = (qkmer->ac >> shift) & 0b11;
+    uint8_t gt = (qkmer->gt >> shift) & 0b11;
+    return (ac >> 1) | ((ac & 1) << 1) | ((gt >> 1) << 2) | ((gt & 1) << 3);
+}
+
+/**
+ * @brief Match the A/C and G/T masks of a QK-mer with the value of a K-mer on the nucleotides of a mask,
+ * the masks and the value being aligned the same way.
+ * 
+ * @param ac_mask The A/C mask of the QK-mer.
+ * @param gt_mask The G/T mask of the QK-mer.
+ * @param value The value of the K-mer.
+ * @param mask The bits of the nucleotides to match.
+ * @return true if the QK-mer matches the K-mer on the mask, false otherwise.
+ */
+static inline bool qkmer_masks_match_value(uint64_t ac_mask, uint64_t gt_mask, uint64_t value, uint64_t mask) {
+    const uint64_t zero_one_mask = 0x5555555555555555;              // Binary: 01010101...
+    uint64_t high = (value >> 1) & zero_one_mask;                   // G or T
+    uint64_t low = value & zero_one_mask;                           // C or T
+    uint64_t ac = ((~high & ~low & zero_one_mask) << 1) | (~high & low);   // A: 10, C: 01
+    uint64_t gt = ((high & ~low) << 1) | (high & low);              // G: 10, T: 01
+    return (((ac & ~ac_mask) | (gt & ~gt_mask)) & mask) == 0;
+}
+
+/**
+ * @brief Match a QK-mer with the value of a K-mer of the same length, without allocating.
+ * 
+ * @param qkmer The QK-mer.
+ * @param value The value of the K-mer.
+ * @return true if the QK-mer matches the K-mer, false otherwise.
+ */
+static inline bool qkmer_matches_kmer_value(const Qkmer* qkmer, uint64_t value) {
+    uint64_t length_mask = qkmer->k == 32 ? UINT64_MAX : (1ULL << (2 * qkmer->k)) - 1;
+    return qkmer_masks_match_value(qkmer->ac, qkmer->gt, value, length_mask);
+}
+
 #endif
\ No newline at end of file
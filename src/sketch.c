@@ -0,0 +1,537 @@
+#include "sketch.h"
+
+/**
+ * @brief Sorts hashes, removes the duplicates, and keeps at most the given number of the smallest ones.
+ *
+ * @param hashes The hashes, modified in place.
+ * @param count The number of hashes.
+ * @param size The maximal number of hashes kept.
+ * @return The number of hashes kept.
+ */
+static uint32_t keep_smallest_hashes(uint64_t* hashes, uint32_t count, uint32_t size) {
+    uint32_t kept = 0;
+    sort_uint64_values(hashes, count);
+    for (uint32_t i = 0; i < count && kept < size; i++) {
+        if (kept == 0 || hashes[i] != hashes[kept - 1]) {
+            hashes[kept++] = hashes[i];
+        }
+    }
+    return kept;
+}
+
+/**
+ * @brief Compacts the buffer of a sketch builder, keeping only its s smallest distinct hashes.
+ *
+ * @param builder The sketch builder.
+ */
+static void compact_sketch_builder(SketchBuilder* builder) {
+    builder->count = keep_smallest_hashes(builder->hashes, builder->count, builder->size);
+    if (builder->count == builder->size) {
+        builder->full = true;
+        builder->threshold = builder->hashes[builder->count - 1];
+    }
+}
+
+/**
+ * @brief Checks the maximal number of hashes of a sketch.
+ *
+ * @param size The maximal number of hashes.
+ * @return The maximal number of hashes, if valid.
+ */
+uint32_t check_sketch_size(int32 size) {
+    if (size < 1 || size > SKETCH_MAX_SIZE) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("sketch size must be between 1 and %d", SKETCH_MAX_SIZE)));
+    }
+    return (uint32_t) size;
+}
+
+/**
+ * @brief Initializes a sketch builder, in the current memory context.
+ *
+ * @param builder The sketch builder to initialize.
+ * @param k The length of the sketched K-mers.
+ * @param flags SKETCH_CANONICAL when the canonical K-mers are sketched.
+ * @param size The maximal number s of hashes kept.
+ */
+void init_sketch_builder(SketchBuilder* builder, uint8_t k, uint8_t flags, uint32_t size) {
+    builder->k = k;
+    builder->flags = flags;
+    builder->size = size;
+    builder->count = 0;
+    builder->capacity = 2 * size;
+    builder->full = false;
+    builder->threshold = 0;
+    builder->hashes = palloc(builder->capacity * sizeof(uint64_t));
+}
+
+/**
+ * @brief Adds a hash to a sketch builder.
+ *
+ * @param builder The sketch builder.
+ * @param hash The hash.
+ */
+void add_hash_to_sketch_builder(SketchBuilder* builder, uint64_t hash) {
+    if (builder->full && hash >= builder->threshold) {
+        return;
+    }
+    builder->hashes[builder->count++] = hash;
+    if (builder->count == builder->capacity) {
+        compact_sketch_builder(builder);
+    }
+}
+
+/**
+ * @brief Adds the K-mers of a DNA sequence to a sketch builder.
+ * The K-mers overlapping an IUPAC ambiguity code are skipped.
+ *
+ * @param builder The sketch builder.
+ * @param dna The DNA object.
+ */
+void add_dna_to_sketch_builder(SketchBuilder* builder, DNA* dna) {
+    KmerGeneratorState generator;
+    uint64_t value;
+    init_kmer_generator_state(&generator, dna, builder->k, builder->flags & SKETCH_CANONICAL);
+    while (next_kmer_value(&generator, &value)) {
+        add_hash_to_sketch_builder(builder, murmurhash64(value));
+    }
+}
+
+/**
+ * @brief Builds the sketch of the hashes added to a sketch builder, leaving the builder unchanged.
+ *
+ * @param builder The sketch builder.
+ * @return The K-mer sketch.
+ */
+KmerSketch* build_sketch(const SketchBuilder* builder) {
+    KmerSketch* sketch = palloc0(SKETCH_HEADER_SIZE + (Size) builder->count * sizeof(uint64_t));
+    memcpy(sketch->hashes, builder->hashes, builder->count * sizeof(uint64_t));
+    sketch->k = builder->k;
+    sketch->flags = builder->flags;
+    sketch->size = builder->size;
+    sketch->count = keep_smallest_hashes(sketch->hashes, builder->count, builder->size);
+    SET_VARSIZE(sketch, SKETCH_HEADER_SIZE + sketch->count * sizeof(uint64_t));
+    return sketch;
+}
+
+/**
+ * @brief Converts a Jaccard index into the Mash distance, an estimate of the mutation rate.
+ *
+ * @param jaccard The Jaccard index.
+ * @param k The length of the K-mers.
+ * @return The Mash distance, between 0 and 1.
+ */
+double get_sketch_mash_distance(double jaccard, uint8_t k) {
+    if (jaccard <= 0) {
+        return 1.0;
+    }
+    double distance = -log(2 * jaccard / (1 + jaccard)) / k;
+    return Min(Max(distance, 0.0), 1.0);
+}
+
+/**
+ * @brief Checks that two K-mer sketches can be compared.
+ *
+ * @param sketch1 The first K-mer sketch.
+ * @param sketch2 The second K-mer sketch.
+ */
+static void check_sketches_compatible(const KmerSketch* sketch1, const KmerSketch* sketch2) {
+    if (sketch1->k != sketch2->k || sketch1->flags != sketch2->flags) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("cannot compare kmer sketches of different kmer lengths or canonical settings")));
+    }
+}
+
+/**
+ * @brief Estimates the Jaccard index of the K-mers of two sketches, as the fraction of the s smallest
+ * hashes of their union which are in both sketches (s being the smaller of the two sketch sizes).
+ *
+ * @param sketch1 The first K-mer sketch.
+ * @param sketch2 The second K-mer sketch.
+ * @return The estimated Jaccard index (1 for two empty sketches).
+ */
+static double estimate_sketch_jaccard(const KmerSketch* sketch1, const KmerSketch* sketch2) {
+    uint32_t size = Min(sketch1->size, sketch2->size);
+    uint32_t i = 0, j = 0, taken = 0, common = 0;
+    check_sketches_compatible(sketch1, sketch2);
+    while (taken < size && (i < sketch1->count || j < sketch2->count)) {
+        if (i < sketch1->count && j < sketch2->count && sketch1->hashes[i] == sketch2->hashes[j]) {
+            common++;
+            i++;
+            j++;
+        } else if (j == sketch2->count || (i < sketch1->count && sketch1->hashes[i] < sketch2->hashes[j])) {
+            i++;
+        } else {
+            j++;
+        }
+        taken++;
+    }
+    return taken == 0 ? 1.0 : (double) common / taken;
+}
+
+/**
+ * @brief Checks the K-mer sketch read by the input and receive functions.
+ *
+ * @param sketch The K-mer sketch.
+ * @param sqlerrcode The error code to report.
+ */
+static void check_sketch(const KmerSketch* sketch, int sqlerrcode) {
+    if (sketch->k < 1 || sketch->k > KMER_MAX_LENGTH || (sketch->flags & ~SKETCH_CANONICAL) != 0
+        || sketch->size < 1 || sketch->size > SKETCH_MAX_SIZE || sketch->count > sketch->size) {
+        ereport(ERROR, (errcode(sqlerrcode),
+            errmsg("invalid kmer sketch parameters")));
+    }
+    for (uint32_t i = 1; i < sketch->count; i++) {
+        if (sketch->hashes[i] <= sketch->hashes[i - 1]) {
+            ereport(ERROR, (errcode(sqlerrcode),
+                errmsg("hashes of a kmer sketch must be in strictly increasing order")));
+        }
+    }
+}
+
+/**
+ * @brief Parses a K-mer sketch from a string such as 'k=21 s=1000 canonical [12,345]'.
+ *
+ * @param str The string representing the K-mer sketch.
+ * @return The K-mer sketch.
+ */
+static KmerSketch* sketch_parse(const char* str) {
+    const char* c = str;
+    char* end;
+    unsigned long k, size;
+    uint8_t flags = 0;
+    uint32_t count = 0;
+    KmerSketch* sketch;
+
+    while (isspace((unsigned char) *c)) c++;
+    if (strncmp(c, "k=", 2) != 0) goto invalid;
+    k = strtoul(c + 2, &end, 10);
+    if (end == c + 2) goto invalid;
+    c = end;
+    while (isspace((unsigned char) *c)) c++;
+    if (strncmp(c, "s=", 2) != 0) goto invalid;
+    size = strtoul(c + 2, &end, 10);
+    if (end == c + 2) goto invalid;
+    c = end;
+    while (isspace((unsigned char) *c)) c++;
+    if (strncmp(c, "canonical", 9) == 0) {
+        flags |= SKETCH_CANONICAL;
+        c += 9;
+        while (isspace((unsigned char) *c)) c++;
+    }
+    if (k < 1 || k > KMER_MAX_LENGTH || size < 1 || size > SKETCH_MAX_SIZE) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+            errmsg("invalid kmer sketch parameters")));
+    }
+    if (*c++ != '[') goto invalid;
+
+    sketch = palloc0(SKETCH_HEADER_SIZE + size * sizeof(uint64_t));
+    while (isspace((unsigned char) *c)) c++;
+    if (*c != ']') {
+        for (;;) {
+            if (!isdigit((unsigned char) *c)) goto invalid;
+            errno = 0;
+            uint64_t hash = strtoull(c, &end, 10);
+            if (errno == ERANGE) goto invalid;
+            if (count == size) {
+                ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+                    errmsg("kmer sketch holds more than %lu hashes", size)));
+            }
+            sketch->hashes[count++] = hash;
+            c = end;
+            while (isspace((unsigned char) *c)) c++;
+            if (*c == ']') break;
+            if (*c++ != ',') goto invalid;
+            while (isspace((unsigned char) *c)) c++;
+        }
+    }
+    c++;
+    while (isspace((unsigned char) *c)) c++;
+    if (*c != '\0') goto invalid;
+
+    sketch->k = k;
+    sketch->flags = flags;
+    sketch->size = size;
+    sketch->count = count;
+    SET_VARSIZE(sketch, SKETCH_HEADER_SIZE + count * sizeof(uint64_t));
+    check_sketch(sketch, ERRCODE_INVALID_TEXT_REPRESENTATION);
+    return sketch;
+
+invalid:
+    ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+        errmsg("invalid input syntax for type kmer_sketch: \"%s\"", str)));
+}
+
+/**
+ * @brief Checks that a sketch builder can receive hashes with the given parameters.
+ *
+ * @param builder The sketch builder.
+ * @param k The length of the sketched K-mers.
+ * @param flags SKETCH_CANONICAL when the canonical K-mers are sketched.
+ * @param size The maximal number s of hashes kept.
+ */
+static void check_sketch_builder_parameters(const SketchBuilder* builder, uint8_t k, uint8_t flags, uint32_t size) {
+    if (builder->k != k || builder->flags != flags || builder->size != size) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("cannot aggregate kmer sketches with different parameters")));
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Postgres input function for K-mer sketch.
+ *
+ * @param str The input string, e.g. 'k=21 s=1000 canonical [12,345]'.
+ * @return The K-mer sketch created from the input string.
+ */
+PG_FUNCTION_INFO_V1(sketch_in);
+Datum sketch_in(PG_FUNCTION_ARGS) {
+    char* str = PG_GETARG_CSTRING(0);
+    PG_RETURN_POINTER(sketch_parse(str));
+}
+
+/**
+ * @brief Postgres output function for K-mer sketch.
+ *
+ * @param sketch The K-mer sketch.
+ * @return The string representation of the K-mer sketch.
+ */
+PG_FUNCTION_INFO_V1(sketch_out);
+Datum sketch_out(PG_FUNCTION_ARGS) {
+    KmerSketch* sketch = PG_GETARG_KMER_SKETCH_P(0);
+    StringInfoData str;
+    initStringInfo(&str);
+    appendStringInfo(&str, "k=%u s=%u %s[", sketch->k, sketch->size,
+        (sketch->flags & SKETCH_CANONICAL) ? "canonical " : "");
+    for (uint32_t i = 0; i < sketch->count; i++) {
+        appendStringInfo(&str, i == 0 ? UINT64_FORMAT : "," UINT64_FORMAT, sketch->hashes[i]);
+    }
+    appendStringInfoChar(&str, ']');
+    PG_FREE_IF_COPY(sketch, 0);
+    PG_RETURN_CSTRING(str.data);
+}
+
+/*
+ * Binary format of K-mer sketch (used by sketch_send and sketch_recv):
+ *   int8    length k of the K-mers (1-31)
+ *   int8    flags (SKETCH_CANONICAL)
+ *   int32   maximal number of hashes s
+ *   int32   number of hashes n (at most s)
+ *   n times int64 hash, in strictly increasing order
+ */
+
+/**
+ * @brief Postgres receive function for K-mer sketch.
+ *
+ * @param buf The binary representation of the K-mer sketch.
+ * @return The K-mer sketch created from the binary representation.
+ */
+PG_FUNCTION_INFO_V1(sketch_recv);
+Datum sketch_recv(PG_FUNCTION_ARGS) {
+    StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
+    uint8_t k = pq_getmsgbyte(buf);
+    uint8_t flags = pq_getmsgbyte(buf);
+    uint32_t size = pq_getmsgint(buf, 4);
+    uint32_t count = pq_getmsgint(buf, 4);
+    if (size < 1 || size > SKETCH_MAX_SIZE || count > size) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+            errmsg("invalid kmer sketch parameters")));
+    }
+
+    KmerSketch* sketch = palloc0(SKETCH_HEADER_SIZE + count * sizeof(uint64_t));
+    SET_VARSIZE(sketch, SKETCH_HEADER_SIZE + count * sizeof(uint64_t));
+    sketch->k = k;
+    sketch->flags = flags;
+    sketch->size = size;
+    sketch->count = count;
+    for (uint32_t i = 0; i < count; i++) {
+        sketch->hashes[i] = pq_getmsgint64(buf);
+    }
+    check_sketch(sketch, ERRCODE_INVALID_BINARY_REPRESENTATION);
+    PG_RETURN_POINTER(sketch);
+}
+
+/**
+ * @brief Postgres send function for K-mer sketch.
+ *
+ * @param sketch The K-mer sketch.
+ * @return The binary representation of the K-mer sketch.
+ */
+PG_FUNCTION_INFO_V1(sketch_send);
+Datum sketch_send(PG_FUNCTION_ARGS) {
+    KmerSketch* sketch = PG_GETARG_KMER_SKETCH_P(0);
+    StringInfoData buf;
+    pq_begintypsend(&buf);
+    pq_sendint8(&buf, sketch->k);
+    pq_sendint8(&buf, sketch->flags);
+    pq_sendint32(&buf, sketch->size);
+    pq_sendint32(&buf, sketch->count);
+    for (uint32_t i = 0; i < sketch->count; i++) {
+        pq_sendint64(&buf, sketch->hashes[i]);
+    }
+    PG_FREE_IF_COPY(sketch, 0);
+    PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+/**
+ * @brief Builds the sketch of the K-mers of a DNA sequence.
+ *
+ * @param dna The DNA object.
+ * @param kmer_length The length of the K-mers.
+ * @param size The maximal number s of hashes kept.
+ * @param canonical Whether the canonical K-mers are sketched.
+ * @return The K-mer sketch.
+ */
+PG_FUNCTION_INFO_V1(dna_sketch);
+Datum dna_sketch(PG_FUNCTION_ARGS) {
+    DNA* dna = PG_GETARG_BYTEA_P(0);
+    uint8_t kmer_length = check_kmer_length(PG_GETARG_INT32(1));
+    uint32_t size = check_sketch_size(PG_GETARG_INT32(2));
+    uint8_t flags = PG_GETARG_BOOL(3) ? SKETCH_CANONICAL : 0;
+    SketchBuilder builder;
+
+    init_sketch_builder(&builder, kmer_length, flags, size);
+    add_dna_to_sketch_builder(&builder, dna);
+    KmerSketch* sketch = build_sketch(&builder);
+    pfree(builder.hashes);
+    PG_FREE_IF_COPY(dna, 0);
+    PG_RETURN_POINTER(sketch);
+}
+
+/**
+ * @brief Estimates the Jaccard index of the K-mers of two sketches.
+ *
+ * @param sketch1 The first K-mer sketch.
+ * @param sketch2 The second K-mer sketch.
+ * @return The estimated Jaccard index.
+ */
+PG_FUNCTION_INFO_V1(sketch_jaccard);
+Datum sketch_jaccard(PG_FUNCTION_ARGS) {
+    KmerSketch* sketch1 = PG_GETARG_KMER_SKETCH_P(0);
+    KmerSketch* sketch2 = PG_GETARG_KMER_SKETCH_P(1);
+    double jaccard = estimate_sketch_jaccard(sketch1, sketch2);
+    PG_FREE_IF_COPY(sketch1, 0);
+    PG_FREE_IF_COPY(sketch2, 1);
+    PG_RETURN_FLOAT8(jaccard);
+}
+
+/**
+ * @brief Computes the Mash distance between two K-mer sketches.
+ *
+ * @param sketch1 The first K-mer sketch.
+ * @param sketch2 The second K-mer sketch.
+ * @return The Mash distance, between 0 (identical) and 1 (no K-mer in common).
+ */
+PG_FUNCTION_INFO_V1(sketch_distance);
+Datum sketch_distance(PG_FUNCTION_ARGS) {
+    KmerSketch* sketch1 = PG_GETARG_KMER_SKETCH_P(0);
+    KmerSketch* sketch2 = PG_GETARG_KMER_SKETCH_P(1);
+    double distance = get_sketch_mash_distance(estimate_sketch_jaccard(sketch1, sketch2), sketch1->k);
+    PG_FREE_IF_COPY(sketch1, 0);
+    PG_FREE_IF_COPY(sketch2, 1);
+    PG_RETURN_FLOAT8(distance);
+}
+
+/**
+ * @brief Transition function of the sketch_agg aggregate: adds the K-mers of a DNA sequence to the sketch.
+ *
+ * @param state The sketch builder (NULL for the first row).
+ * @param dna The DNA object.
+ * @param kmer_length The length of the K-mers.
+ * @param size The maximal number s of hashes kept.
+ * @param canonical Whether the canonical K-mers are sketched (optional, true by default).
+ * @return The sketch builder.
+ */
+PG_FUNCTION_INFO_V1(sketch_agg_transfn);
+Datum sketch_agg_transfn(PG_FUNCTION_ARGS) {
+    MemoryContext context = get_aggregate_context(fcinfo, "sketch_agg");
+    SketchBuilder* builder = PG_ARGISNULL(0) ? NULL : (SketchBuilder*) PG_GETARG_POINTER(0);
+
+    if (PG_ARGISNULL(1) || PG_ARGISNULL(2) || PG_ARGISNULL(3) || (PG_NARGS() > 4 && PG_ARGISNULL(4))) {
+        if (builder == NULL) {
+            PG_RETURN_NULL();
+        }
+        PG_RETURN_POINTER(builder);
+    }
+
+    uint8_t kmer_length = check_kmer_length(PG_GETARG_INT32(2));
+    uint32_t size = check_sketch_size(PG_GETARG_INT32(3));
+    uint8_t flags = (PG_NARGS() <= 4 || PG_GETARG_BOOL(4)) ? SKETCH_CANONICAL : 0;
+    if (builder == NULL) {
+        MemoryContext old_context = MemoryContextSwitchTo(context);
+        builder = palloc(sizeof(SketchBuilder));
+        init_sketch_builder(builder, kmer_length, flags, size);
+        MemoryContextSwitchTo(old_context);
+    }
+    check_sketch_builder_parameters(builder, kmer_length, flags, size);
+
+    DNA* dna = PG_GETARG_BYTEA_P(1);
+    add_dna_to_sketch_builder(builder, dna);
+    PG_FREE_IF_COPY(dna, 1);
+    PG_RETURN_POINTER(builder);
+}
+
+/**
+ * @brief Combine function of the sketch_agg aggregate: merges two sketch builders.
+ *
+ * @param state1 The first sketch builder (possibly NULL), which receives the hashes.
+ * @param state2 The second sketch builder (possibly NULL).
+ * @return The merged sketch builder.
+ */
+PG_FUNCTION_INFO_V1(sketch_agg_combinefn);
+Datum sketch_agg_combinefn(PG_FUNCTION_ARGS) {
+    MemoryContext context = get_aggregate_context(fcinfo, "sketch_agg");
+    SketchBuilder* builder1 = PG_ARGISNULL(0) ? NULL : (SketchBuilder*) PG_GETARG_POINTER(0);
+    SketchBuilder* builder2 = PG_ARGISNULL(1) ? NULL : (SketchBuilder*) PG_GETARG_POINTER(1);
+
+    if (builder2 == NULL) {
+        if (builder1 == NULL) {
+            PG_RETURN_NULL();
+        }
+        PG_RETURN_POINTER(builder1);
+    }
+    if (builder1 == NULL) {                                         // copy builder2 into the aggregate context
+        MemoryContext old_context = MemoryContextSwitchTo(context);
+        builder1 = palloc(sizeof(SketchBuilder));
+        init_sketch_builder(builder1, builder2->k, builder2->flags, builder2->size);
+        MemoryContextSwitchTo(old_context);
+    }
+    check_sketch_builder_parameters(builder1, builder2->k, builder2->flags, builder2->size);
+    for (uint32_t i = 0; i < builder2->count; i++) {
+        add_hash_to_sketch_builder(builder1, builder2->hashes[i]);
+    }
+    PG_RETURN_POINTER(builder1);
+}
+
+/**
+ * @brief Serialization function of the sketch_agg aggregate, also used as its final function.
+ *
+ * @param state The sketch builder.
+ * @return The K-mer sketch.
+ */
+PG_FUNCTION_INFO_V1(sketch_agg_serialfn);
+Datum sketch_agg_serialfn(PG_FUNCTION_ARGS) {
+    SketchBuilder* builder = (SketchBuilder*) PG_GETARG_POINTER(0);
+    PG_RETURN_POINTER(build_sketch(builder));
+}
+
+/**
+ * @brief Deserialization function of the sketch_agg aggregate.
+ *
+ * @param serialized The K-mer sketch.
+ * @return The sketch builder.
+ */
+PG_FUNCTION_INFO_V1(sketch_agg_deserialfn);
+Datum sketch_agg_deserialfn(PG_FUNCTION_ARGS) {
+    MemoryContext context = get_aggregate_context(fcinfo, "sketch_agg");
+    KmerSketch* sketch = PG_GETARG_KMER_SKETCH_P(0);
+    MemoryContext old_context = MemoryContextSwitchTo(context);
+    SketchBuilder* builder = palloc(sizeof(SketchBuilder));
+    init_sketch_builder(builder, sketch->k, sketch->flags, sketch->size);
+    MemoryContextSwitchTo(old_context);
+    for (uint32_t i = 0; i < sketch->count; i++) {
+        add_hash_to_sketch_builder(builder, sketch->hashes[i]);
+    }
+    PG_RETURN_POINTER(builder);
+}
@@ -0,0 +1,61 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include "dna.h"
+#include "util.h"
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "lib/stringinfo.h"
+#include "utils/memutils.h"
+
+#define SKETCH_CANONICAL 0b00000001
+#define SKETCH_MAX_SIZE 65536
+
+/**
+ * @typedef KmerSketch
+ * @brief Bottom-s MinHash sketch of the K-mers of one or more DNA sequences.
+ *
+ * The sketch holds the (at most) s smallest distinct hashes of the K-mers, in increasing order.
+ * With fewer than s distinct K-mers, it holds the hashes of all of them.
+ */
+typedef struct KmerSketch {
+    int32 vl_len_;          /**< Varlena header (do not touch directly) */
+    uint8_t k;              /**< Length of the sketched K-mers */
+    uint8_t flags;          /**< SKETCH_CANONICAL when the canonical K-mers are sketched */
+    uint16_t padding;       /**< Unused, zero */
+    uint32_t size;          /**< Maximal number s of hashes kept */
+    uint32_t count;         /**< Number of hashes kept */
+    uint64_t hashes[FLEXIBLE_ARRAY_MEMBER];  /**< Hashes kept, in increasing order */
+} KmerSketch;
+
+#define SKETCH_HEADER_SIZE offsetof(KmerSketch, hashes)
+#define DatumGetKmerSketchP(X) ((KmerSketch*) PG_DETOAST_DATUM(X))
+#define PG_GETARG_KMER_SKETCH_P(n) DatumGetKmerSketchP(PG_GETARG_DATUM(n))
+
+/**
+ * @brief Builder of a K-mer sketch, also the state of the sketch_agg aggregate.
+ *
+ * Candidate hashes are buffered and the buffer is compacted (sorted, deduplicated and truncated to the
+ * s smallest hashes) when it fills up. Once s hashes are kept, the hashes not lower than the largest
+ * one kept are discarded without being buffered.
+ */
+typedef struct SketchBuilder {
+    uint8_t k;              /**< Length of the sketched K-mers */
+    uint8_t flags;          /**< SKETCH_CANONICAL when the canonical K-mers are sketched */
+    uint32_t size;          /**< Maximal number s of hashes kept */
+    uint32_t count;         /**< Number of hashes buffered */
+    uint32_t capacity;      /**< Number of hashes the buffer can hold (2 * s) */
+    bool full;              /**< Whether s hashes were kept by the last compaction */
+    uint64_t threshold;     /**< Largest hash kept by the last compaction, when full */
+    uint64_t* hashes;       /**< Buffer of hashes */
+} SketchBuilder;
+
+void init_sketch_builder(SketchBuilder* builder, uint8_t k, uint8_t flags, uint32_t size);
+void add_hash_to_sketch_builder(SketchBuilder* builder, uint64_t hash);
+void add_dna_to_sketch_builder(SketchBuilder* builder, DNA* dna);
+KmerSketch* build_sketch(const SketchBuilder* builder);
+uint32_t check_sketch_size(int32 size);
+double get_sketch_mash_distance(double jaccard, uint8_t k);
+
+#endif
@@ -0,0 +1,382 @@
+#include "sketch.h"
+#include "access/gist.h"
+#include "access/stratnum.h"
+#include "port/pg_bitutils.h"
+
+/*
+ * GiST keys of K-mer sketches are signatures: a bitmap with the bit (hash mod its number of bits) set
+ * for every hash of the sketch, or of any sketch of the subtree for inner keys. Since the sketches keep
+ * the smallest hashes, the low bits of the hashes are used.
+ *
+ * The number of hashes of a query sketch whose bit is set in a signature bounds the number of hashes
+ * that the query can share with any sketch below it, hence a lower bound of the Mash distance: the
+ * index returns the sketches in (approximately) increasing order, and the exact distances are rechecked.
+ * The bound is only useful while few bits are set, so the signature of a sketch has about
+ * SKETCH_SIGNATURE_BITS_PER_HASH bits per hash kept (a power of two). Signatures of different sizes
+ * are folded onto the smaller one, whose bit of a hash is the bit of the larger one modulo its size.
+ */
+#define SKETCH_SIGNATURE_BITS_PER_HASH 8
+#define SKETCH_SIGNATURE_MIN_BITS 1024
+#define SKETCH_SIGNATURE_MAX_BITS 16384              // 2 kB, so that a page holds a few keys
+#define SKETCH_DISTANCE_STRATEGY_NUMBER 15
+
+/**
+ * @brief GiST key of K-mer sketches.
+ */
+typedef struct SketchSignature {
+    int32 vl_len_;          /**< Varlena header (do not touch directly) */
+    uint32_t min_size;      /**< Smallest maximal number of hashes s of the sketches below */
+    uint32_t nb_bits;       /**< Number of bits of the bitmap, a power of two */
+    uint8_t bits[FLEXIBLE_ARRAY_MEMBER];    /**< Bitmap of the hashes of the sketches below */
+} SketchSignature;
+
+#define DatumGetSketchSignatureP(X) ((SketchSignature*) DatumGetPointer(X))
+#define SKETCH_SIGNATURE_SIZE(nb_bits) (offsetof(SketchSignature, bits) + (nb_bits) / 8)
+
+
+/**
+ * @brief Gets the number of bits of the signature of a sketch.
+ *
+ * @param size The maximal number s of hashes of the sketch.
+ * @return The number of bits.
+ */
+static uint32_t get_sketch_signature_bits(uint32_t size) {
+    uint32_t nb_bits = SKETCH_SIGNATURE_MIN_BITS;
+    while (nb_bits < SKETCH_SIGNATURE_MAX_BITS && nb_bits < (uint64_t) size * SKETCH_SIGNATURE_BITS_PER_HASH) {
+        nb_bits <<= 1;
+    }
+    return nb_bits;
+}
+
+/**
+ * @brief Creates an empty sketch signature.
+ *
+ * @param nb_bits The number of bits of the signature.
+ * @return The sketch signature.
+ */
+static SketchSignature* make_sketch_signature(uint32_t nb_bits) {
+    SketchSignature* signature = palloc0(SKETCH_SIGNATURE_SIZE(nb_bits));
+    SET_VARSIZE(signature, SKETCH_SIGNATURE_SIZE(nb_bits));
+    signature->min_size = UINT32_MAX;
+    signature->nb_bits = nb_bits;
+    return signature;
+}
+
+/**
+ * @brief Sets the bit of a hash in a sketch signature.
+ *
+ * @param signature The sketch signature.
+ * @param hash The hash.
+ */
+static inline void set_signature_bit(SketchSignature* signature, uint64_t hash) {
+    uint32_t bit = hash & (signature->nb_bits - 1);
+    signature->bits[bit / 8] |= 1 << (bit % 8);
+}
+
+/**
+ * @brief Checks the bit of a hash in a sketch signature.
+ *
+ * @param signature The sketch signature.
+ * @param hash The hash.
+ * @return Whether the bit is set.
+ */
+static inline bool get_signature_bit(const SketchSignature* signature, uint64_t hash) {
+    uint32_t bit = hash & (signature->nb_bits - 1);
+    return (signature->bits[bit / 8] >> (bit % 8)) & 1;
+}
+
+/**
+ * @brief Adds a sketch signature to another one, folding it if it is larger.
+ *
+ * @param signature The sketch signature receiving the bits, not larger than the other one.
+ * @param other The sketch signature added.
+ */
+static void merge_sketch_signature(SketchSignature* signature, const SketchSignature* other) {
+    uint32_t nb_bytes = signature->nb_bits / 8;
+    Assert(signature->nb_bits <= other->nb_bits);
+    for (uint32_t i = 0; i < other->nb_bits / 8; i++) {
+        signature->bits[i & (nb_bytes - 1)] |= other->bits[i];
+    }
+    signature->min_size = Min(signature->min_size, other->min_size);
+}
+
+/**
+ * @brief Folds a sketch signature onto a number of bits.
+ *
+ * @param signature The sketch signature.
+ * @param nb_bits The number of bits, not larger than that of the signature.
+ * @param bits The folded bitmap.
+ */
+static void fold_sketch_signature(const SketchSignature* signature, uint32_t nb_bits, uint8_t* bits) {
+    memset(bits, 0, nb_bits / 8);
+    for (uint32_t i = 0; i < signature->nb_bits / 8; i++) {
+        bits[i & (nb_bits / 8 - 1)] |= signature->bits[i];
+    }
+}
+
+/**
+ * @brief Counts the bits set in a sketch signature but not in another one, both folded onto the
+ * smaller size.
+ *
+ * @param signature The sketch signature.
+ * @param other The other sketch signature.
+ * @return The number of bits.
+ */
+static int count_new_signature_bits(const SketchSignature* signature, const SketchSignature* other) {
+    uint32_t nb_bits = Min(signature->nb_bits, other->nb_bits);
+    uint8_t bits[SKETCH_SIGNATURE_MAX_BITS / 8];
+    uint8_t other_bits[SKETCH_SIGNATURE_MAX_BITS / 8];
+    fold_sketch_signature(signature, nb_bits, bits);
+    fold_sketch_signature(other, nb_bits, other_bits);
+    for (uint32_t i = 0; i < nb_bits / 8; i++) {
+        bits[i] &= ~other_bits[i];
+    }
+    return pg_popcount((const char*) bits, nb_bits / 8);
+}
+
+/**
+ * @brief Counts the bits differing between two sketch signatures.
+ *
+ * @param signature1 The first sketch signature.
+ * @param signature2 The second sketch signature.
+ * @return The Hamming distance between the signatures.
+ */
+static int get_signature_hamming_distance(const SketchSignature* signature1, const SketchSignature* signature2) {
+    return count_new_signature_bits(signature1, signature2) + count_new_signature_bits(signature2, signature1);
+}
+
+/**
+ * @brief Gets the smallest number of bits of the signatures of GiST entries.
+ *
+ * @param entryvec The GiST entries.
+ * @param first The index of the first entry.
+ * @return The number of bits.
+ */
+static uint32_t get_min_signature_bits(GistEntryVector* entryvec, int first) {
+    uint32_t nb_bits = SKETCH_SIGNATURE_MAX_BITS;
+    for (int i = first; i < entryvec->n; i++) {
+        nb_bits = Min(nb_bits, DatumGetSketchSignatureP(entryvec->vector[i].key)->nb_bits);
+    }
+    return nb_bits;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief GiST consistent function for K-mer sketches. The opclass only supports ordering by <->, so
+ * every key is consistent.
+ */
+PG_FUNCTION_INFO_V1(sketch_gist_consistent);
+Datum sketch_gist_consistent(PG_FUNCTION_ARGS) {
+    bool* recheck = (bool*) PG_GETARG_POINTER(4);
+    *recheck = false;
+    PG_RETURN_BOOL(true);
+}
+
+/**
+ * @brief GiST union function for K-mer sketches: ORs the signatures.
+ *
+ * @param entryvec The GiST entries.
+ * @param size The size of the union.
+ * @return The union of the signatures.
+ */
+PG_FUNCTION_INFO_V1(sketch_gist_union);
+Datum sketch_gist_union(PG_FUNCTION_ARGS) {
+    GistEntryVector* entryvec = (GistEntryVector*) PG_GETARG_POINTER(0);
+    int* size = (int*) PG_GETARG_POINTER(1);
+    SketchSignature* result = make_sketch_signature(get_min_signature_bits(entryvec, 0));
+    for (int i = 0; i < entryvec->n; i++) {
+        merge_sketch_signature(result, DatumGetSketchSignatureP(entryvec->vector[i].key));
+    }
+    *size = VARSIZE(result);
+    PG_RETURN_POINTER(result);
+}
+
+/**
+ * @brief GiST compress function for K-mer sketches: converts the leaf sketches into signatures.
+ *
+ * @param entry The GiST entry.
+ * @return The compressed GiST entry.
+ */
+PG_FUNCTION_INFO_V1(sketch_gist_compress);
+Datum sketch_gist_compress(PG_FUNCTION_ARGS) {
+    GISTENTRY* entry = (GISTENTRY*) PG_GETARG_POINTER(0);
+    if (entry->leafkey) {
+        KmerSketch* sketch = DatumGetKmerSketchP(entry->key);
+        SketchSignature* signature = make_sketch_signature(get_sketch_signature_bits(sketch->size));
+        GISTENTRY* result = palloc(sizeof(GISTENTRY));
+        for (uint32_t i = 0; i < sketch->count; i++) {
+            set_signature_bit(signature, sketch->hashes[i]);
+        }
+        signature->min_size = sketch->size;
+        gistentryinit(*result, PointerGetDatum(signature), entry->rel, entry->page, entry->offset, false);
+        PG_RETURN_POINTER(result);
+    }
+    PG_RETURN_POINTER(entry);
+}
+
+/**
+ * @brief GiST penalty function for K-mer sketches: the number of bits the new entry adds to the signature.
+ *
+ * @param origentry The GiST entry of the subtree.
+ * @param newentry The GiST entry to insert.
+ * @param penalty The penalty.
+ */
+PG_FUNCTION_INFO_V1(sketch_gist_penalty);
+Datum sketch_gist_penalty(PG_FUNCTION_ARGS) {
+    GISTENTRY* origentry = (GISTENTRY*) PG_GETARG_POINTER(0);
+    GISTENTRY* newentry = (GISTENTRY*) PG_GETARG_POINTER(1);
+    float* penalty = (float*) PG_GETARG_POINTER(2);
+    *penalty = count_new_signature_bits(DatumGetSketchSignatureP(newentry->key),
+        DatumGetSketchSignatureP(origentry->key));
+    PG_RETURN_POINTER(penalty);
+}
+
+/**
+ * @brief Entry of a page being split, with the difference of the costs of adding it to either side.
+ */
+typedef struct SketchSplitCost {
+    OffsetNumber offset;    /**< Offset of the entry */
+    int cost;               /**< Difference of the bits it adds to the two seeds */
+} SketchSplitCost;
+
+/**
+ * @brief Compares the split costs of two entries, the most one-sided first.
+ */
+static int compare_sketch_split_costs(const void* a, const void* b) {
+    int cost_a = ((const SketchSplitCost*) a)->cost;
+    int cost_b = ((const SketchSplitCost*) b)->cost;
+    return cost_a > cost_b ? -1 : cost_a < cost_b;
+}
+
+/**
+ * @brief GiST picksplit function for K-mer sketches: seeds the two pages with the most distant
+ * signatures, then adds every other entry to the page whose signature it extends the least, the
+ * entries with the clearest choice first. A bias towards the smaller page, of an eighth of the signature
+ * per cubed entry of difference between the pages (as for tsvector), keeps the splits balanced: without
+ * it, unrelated sketches are split off one at a time and the tree grows as deep as it is wide.
+ *
+ * @param entryvec The GiST entries.
+ * @param splitvec The split.
+ * @return The split.
+ */
+PG_FUNCTION_INFO_V1(sketch_gist_picksplit);
+Datum sketch_gist_picksplit(PG_FUNCTION_ARGS) {
+    GistEntryVector* entryvec = (GistEntryVector*) PG_GETARG_POINTER(0);
+    GIST_SPLITVEC* splitvec = (GIST_SPLITVEC*) PG_GETARG_POINTER(1);
+    OffsetNumber maxoff = entryvec->n - 1;
+    OffsetNumber seed_left = FirstOffsetNumber, seed_right = FirstOffsetNumber + 1;
+    int max_distance = -1;
+
+    for (OffsetNumber i = FirstOffsetNumber; i < maxoff; i++) {
+        SketchSignature* signature_i = DatumGetSketchSignatureP(entryvec->vector[i].key);
+        for (OffsetNumber j = i + 1; j <= maxoff; j++) {
+            int distance = get_signature_hamming_distance(signature_i,
+                DatumGetSketchSignatureP(entryvec->vector[j].key));
+            if (distance > max_distance) {
+                max_distance = distance;
+                seed_left = i;
+                seed_right = j;
+            }
+        }
+    }
+
+    uint32_t nb_bits = get_min_signature_bits(entryvec, FirstOffsetNumber);
+    SketchSignature* union_left = make_sketch_signature(nb_bits);
+    SketchSignature* union_right = make_sketch_signature(nb_bits);
+    SketchSignature* signature_left = DatumGetSketchSignatureP(entryvec->vector[seed_left].key);
+    SketchSignature* signature_right = DatumGetSketchSignatureP(entryvec->vector[seed_right].key);
+    SketchSplitCost* costs = palloc(entryvec->n * sizeof(SketchSplitCost));
+    int nb_costs = 0;
+
+    splitvec->spl_left = palloc(entryvec->n * sizeof(OffsetNumber));
+    splitvec->spl_right = palloc(entryvec->n * sizeof(OffsetNumber));
+    merge_sketch_signature(union_left, signature_left);
+    merge_sketch_signature(union_right, signature_right);
+    splitvec->spl_left[0] = seed_left;
+    splitvec->spl_right[0] = seed_right;
+    splitvec->spl_nleft = 1;
+    splitvec->spl_nright = 1;
+
+    for (OffsetNumber i = FirstOffsetNumber; i <= maxoff; i++) {
+        if (i != seed_left && i != seed_right) {
+            SketchSignature* signature = DatumGetSketchSignatureP(entryvec->vector[i].key);
+            costs[nb_costs].offset = i;
+            costs[nb_costs].cost = abs(count_new_signature_bits(signature, signature_left)
+                - count_new_signature_bits(signature, signature_right));
+            nb_costs++;
+        }
+    }
+    qsort(costs, nb_costs, sizeof(SketchSplitCost), compare_sketch_split_costs);
+
+    for (int i = 0; i < nb_costs; i++) {
+        SketchSignature* signature = DatumGetSketchSignatureP(entryvec->vector[costs[i].offset].key);
+        double imbalance = splitvec->spl_nleft - splitvec->spl_nright;
+        double cost_left = count_new_signature_bits(signature, union_left);
+        double cost_right = count_new_signature_bits(signature, union_right);
+        if (cost_left < cost_right - imbalance * imbalance * imbalance * nb_bits / 8) {
+            merge_sketch_signature(union_left, signature);
+            splitvec->spl_left[splitvec->spl_nleft++] = costs[i].offset;
+        } else {
+            merge_sketch_signature(union_right, signature);
+            splitvec->spl_right[splitvec->spl_nright++] = costs[i].offset;
+        }
+    }
+    splitvec->spl_ldatum = PointerGetDatum(union_left);
+    splitvec->spl_rdatum = PointerGetDatum(union_right);
+    PG_RETURN_POINTER(splitvec);
+}
+
+/**
+ * @brief GiST same function for K-mer sketches.
+ *
+ * @param signature1 The first signature.
+ * @param signature2 The second signature.
+ * @param result Whether the signatures are equal.
+ */
+PG_FUNCTION_INFO_V1(sketch_gist_same);
+Datum sketch_gist_same(PG_FUNCTION_ARGS) {
+    SketchSignature* signature1 = DatumGetSketchSignatureP(PG_GETARG_DATUM(0));
+    SketchSignature* signature2 = DatumGetSketchSignatureP(PG_GETARG_DATUM(1));
+    bool* result = (bool*) PG_GETARG_POINTER(2);
+    *result = signature1->min_size == signature2->min_size && signature1->nb_bits == signature2->nb_bits
+        && memcmp(signature1->bits, signature2->bits, signature1->nb_bits / 8) == 0;
+    PG_RETURN_POINTER(result);
+}
+
+/**
+ * @brief GiST distance function for K-mer sketches: a lower bound of the Mash distance between the
+ * query and the sketches below the key.
+ *
+ * @param entry The GiST entry.
+ * @param query The query sketch.
+ * @param strategy The strategy number.
+ * @param subtype The subtype of the query.
+ * @param recheck Set to true, the distance being a lower bound.
+ * @return The lower bound of the Mash distance.
+ */
+PG_FUNCTION_INFO_V1(sketch_gist_distance);
+Datum sketch_gist_distance(PG_FUNCTION_ARGS) {
+    GISTENTRY* entry = (GISTENTRY*) PG_GETARG_POINTER(0);
+    KmerSketch* query = PG_GETARG_KMER_SKETCH_P(1);
+    StrategyNumber strategy = (StrategyNumber) PG_GETARG_UINT16(2);
+    bool* recheck = (bool*) PG_GETARG_POINTER(4);
+    SketchSignature* signature = DatumGetSketchSignatureP(entry->key);
+    uint32_t matches = 0;
+
+    if (strategy != SKETCH_DISTANCE_STRATEGY_NUMBER) {
+        elog(ERROR, "unrecognized strategy number: %d", strategy);
+    }
+    *recheck = true;
+
+    /*
+     * The Jaccard estimate is the number of shared hashes among the bottom hashes of the union, which
+     * number at least min(s of the query, s of the sketch, number of hashes of the query).
+     */
+    uint32_t denominator = Min(Min(query->size, signature->min_size), query->count);
+    for (uint32_t i = 0; i < query->count; i++) {
+        matches += get_signature_bit(signature, query->hashes[i]);
+    }
+    double jaccard = denominator == 0 ? 1.0 : Min((double) matches / denominator, 1.0);
+    PG_RETURN_FLOAT8(get_sketch_mash_distance(jaccard, query->k));
+}
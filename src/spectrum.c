@@ -0,0 +1,593 @@
+#include "spectrum.h"
+
+/**
+ * @brief Writer encoding K-mers, appended in increasing order, into a spectrum.
+ */
+typedef struct SpectrumWriter {
+    StringInfoData buf;     /**< The spectrum being written, varlena header included */
+    uint32_t count;         /**< Number of K-mers written */
+    uint64_t last;          /**< Value of the last K-mer written */
+} SpectrumWriter;
+
+
+/**
+ * @brief Initializes a spectrum writer.
+ *
+ * @param writer The writer to initialize.
+ * @param k The length of the K-mers (0 if unknown).
+ */
+static void init_spectrum_writer(SpectrumWriter* writer, uint8_t k) {
+    initStringInfo(&writer->buf);
+    appendStringInfoSpaces(&writer->buf, VARHDRSZ + SPECTRUM_HEADER_SIZE);
+    writer->buf.data[VARHDRSZ] = (char) k;
+    writer->count = 0;
+    writer->last = 0;
+}
+
+/**
+ * @brief Appends a K-mer to a spectrum writer, ignoring it if it equals the last one.
+ *
+ * @param writer The writer.
+ * @param value The value of the K-mer, not lower than the last one.
+ */
+static inline void append_to_spectrum_writer(SpectrumWriter* writer, uint64_t value) {
+    uint64_t delta = value - writer->last;
+    uint8_t* out;
+    if (delta == 0 && writer->count > 0) {
+        return;
+    }
+    enlargeStringInfo(&writer->buf, SPECTRUM_MAX_VARINT_SIZE);
+    out = (uint8_t*) writer->buf.data + writer->buf.len;
+    while (delta >= 0x80) {
+        *out++ = (uint8_t) (delta | 0x80);
+        delta >>= 7;
+    }
+    *out++ = (uint8_t) delta;
+    writer->buf.len = (char*) out - writer->buf.data;
+    writer->count++;
+    writer->last = value;
+}
+
+/**
+ * @brief Finishes a spectrum writer.
+ *
+ * @param writer The writer.
+ * @return The K-mer spectrum written.
+ */
+static KmerSpectrum* finish_spectrum_writer(SpectrumWriter* writer) {
+    KmerSpectrum* spectrum = (KmerSpectrum*) writer->buf.data;
+    memcpy(writer->buf.data + VARHDRSZ + 1, &writer->count, sizeof(writer->count));
+    SET_VARSIZE(spectrum, writer->buf.len);
+    return spectrum;
+}
+
+/**
+ * @brief Creates a K-mer spectrum from unsorted K-mers, possibly repeated.
+ *
+ * @param k The length of the K-mers (0 if unknown).
+ * @param values The values of the K-mers, sorted in place.
+ * @param nb_values The number of K-mers.
+ * @return The K-mer spectrum.
+ */
+static KmerSpectrum* make_spectrum(uint8_t k, uint64_t* values, Size nb_values) {
+    SpectrumWriter writer;
+    sort_uint64_values(values, nb_values);
+    init_spectrum_writer(&writer, k);
+    for (Size i = 0; i < nb_values; i++) {
+        append_to_spectrum_writer(&writer, values[i]);
+    }
+    return finish_spectrum_writer(&writer);
+}
+
+/**
+ * @brief Parses a K-mer spectrum from a string such as '{ACGT,CGTA}'.
+ *
+ * @param str The string representing the K-mer spectrum.
+ * @return The K-mer spectrum.
+ */
+static KmerSpectrum* spectrum_parse(const char* str) {
+    const char* c = str;
+    uint8_t k = 0;
+    Size nb_values = 0;
+    Size max_values = 16;
+    uint64_t* values = palloc(max_values * sizeof(uint64_t));
+
+    while (isspace((unsigned char) *c)) c++;
+    if (*c++ != '{') {
+        goto invalid;
+    }
+    while (isspace((unsigned char) *c)) c++;
+    if (*c == '}') {
+        c++;
+    } else {
+        for (;;) {
+            uint64_t value = 0;
+            uint8_t length = 0;
+            while (isalpha((unsigned char) *c)) {
+                if (++length > KMER_MAX_LENGTH) {
+                    ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+                        errmsg("kmer should not exceed %d nucleotides", KMER_MAX_LENGTH)));
+                }
+                add_nucleotide_to_uint(value, *c);
+                c++;
+            }
+            if (length == 0) {
+                goto invalid;
+            }
+            if (k != 0 && length != k) {
+                ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+                    errmsg("all the kmers of a kmer_spectrum must have the same length")));
+            }
+            k = length;
+            if (nb_values == max_values) {
+                max_values *= 2;
+                values = repalloc_huge(values, max_values * sizeof(uint64_t));
+            }
+            values[nb_values++] = value;
+
+            while (isspace((unsigned char) *c)) c++;
+            if (*c == '}') {
+                c++;
+                break;
+            }
+            if (*c++ != ',') {
+                goto invalid;
+            }
+            while (isspace((unsigned char) *c)) c++;
+        }
+    }
+    while (isspace((unsigned char) *c)) c++;
+    if (*c != '\0') {
+        goto invalid;
+    }
+    return make_spectrum(k, values, nb_values);
+
+invalid:
+    ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+        errmsg("invalid input syntax for type kmer_spectrum: \"%s\"", str)));
+}
+
+/**
+ * @brief Checks that two K-mer spectra can be combined, i.e. that their K-mers have the same length.
+ *
+ * @param spectrum1 The first K-mer spectrum.
+ * @param spectrum2 The second K-mer spectrum.
+ * @return The length of the K-mers of the spectra.
+ */
+static uint8_t check_spectrum_kmer_lengths(const KmerSpectrum* spectrum1, const KmerSpectrum* spectrum2) {
+    uint8_t k1 = get_spectrum_kmer_length(spectrum1);
+    uint8_t k2 = get_spectrum_kmer_length(spectrum2);
+    bool empty1 = get_spectrum_cardinality(spectrum1) == 0;
+    bool empty2 = get_spectrum_cardinality(spectrum2) == 0;
+    if (!empty1 && !empty2 && k1 != k2) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("cannot combine kmer spectra of different kmer lengths (%u and %u)", k1, k2)));
+    }
+    if (!empty1 || k2 == 0) {
+        return k1;
+    }
+    return k2;
+}
+
+/**
+ * @brief Counts the K-mers common to two spectra, by merging them.
+ *
+ * @param spectrum1 The first K-mer spectrum.
+ * @param spectrum2 The second K-mer spectrum.
+ * @return The number of K-mers of the intersection.
+ */
+static uint32_t count_common_kmers(const KmerSpectrum* spectrum1, const KmerSpectrum* spectrum2) {
+    SpectrumReader reader1, reader2;
+    uint64_t value1, value2;
+    uint32_t count = 0;
+    init_spectrum_reader(&reader1, spectrum1);
+    init_spectrum_reader(&reader2, spectrum2);
+    bool has1 = next_spectrum_value(&reader1, &value1);
+    bool has2 = next_spectrum_value(&reader2, &value2);
+    while (has1 && has2) {
+        if (value1 < value2) {
+            has1 = next_spectrum_value(&reader1, &value1);
+        } else if (value1 > value2) {
+            has2 = next_spectrum_value(&reader2, &value2);
+        } else {
+            count++;
+            has1 = next_spectrum_value(&reader1, &value1);
+            has2 = next_spectrum_value(&reader2, &value2);
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Merges two K-mer spectra.
+ *
+ * @param spectrum1 The first K-mer spectrum.
+ * @param spectrum2 The second K-mer spectrum.
+ * @param keep_only1 Whether the K-mers only in the first spectrum are kept.
+ * @param keep_only2 Whether the K-mers only in the second spectrum are kept.
+ * @param keep_both Whether the K-mers of both spectra are kept.
+ * @return The merged K-mer spectrum.
+ */
+static KmerSpectrum* merge_spectra(const KmerSpectrum* spectrum1, const KmerSpectrum* spectrum2,
+                                   bool keep_only1, bool keep_only2, bool keep_both) {
+    SpectrumReader reader1, reader2;
+    SpectrumWriter writer;
+    uint64_t value1, value2;
+    init_spectrum_writer(&writer, check_spectrum_kmer_lengths(spectrum1, spectrum2));
+    init_spectrum_reader(&reader1, spectrum1);
+    init_spectrum_reader(&reader2, spectrum2);
+    bool has1 = next_spectrum_value(&reader1, &value1);
+    bool has2 = next_spectrum_value(&reader2, &value2);
+    while (has1 && has2) {
+        if (value1 < value2) {
+            if (keep_only1) append_to_spectrum_writer(&writer, value1);
+            has1 = next_spectrum_value(&reader1, &value1);
+        } else if (value1 > value2) {
+            if (keep_only2) append_to_spectrum_writer(&writer, value2);
+            has2 = next_spectrum_value(&reader2, &value2);
+        } else {
+            if (keep_both) append_to_spectrum_writer(&writer, value1);
+            has1 = next_spectrum_value(&reader1, &value1);
+            has2 = next_spectrum_value(&reader2, &value2);
+        }
+    }
+    for (; has1 && keep_only1; has1 = next_spectrum_value(&reader1, &value1)) {
+        append_to_spectrum_writer(&writer, value1);
+    }
+    for (; has2 && keep_only2; has2 = next_spectrum_value(&reader2, &value2)) {
+        append_to_spectrum_writer(&writer, value2);
+    }
+    return finish_spectrum_writer(&writer);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Postgres input function for K-mer spectrum.
+ *
+ * @param str The input string, e.g. '{ACGT,CGTA}'.
+ * @return The K-mer spectrum created from the input string.
+ */
+PG_FUNCTION_INFO_V1(spectrum_in);
+Datum spectrum_in(PG_FUNCTION_ARGS) {
+    char* str = PG_GETARG_CSTRING(0);
+    PG_RETURN_BYTEA_P(spectrum_parse(str));
+}
+
+/**
+ * @brief Postgres output function for K-mer spectrum.
+ *
+ * @param spectrum The K-mer spectrum.
+ * @return The string representation of the K-mer spectrum, the K-mers in increasing order.
+ */
+PG_FUNCTION_INFO_V1(spectrum_out);
+Datum spectrum_out(PG_FUNCTION_ARGS) {
+    KmerSpectrum* spectrum = PG_GETARG_BYTEA_P(0);
+    uint8_t k = get_spectrum_kmer_length(spectrum);
+    SpectrumReader reader;
+    StringInfoData str;
+    uint64_t value;
+    char kmer[32];
+
+    initStringInfo(&str);
+    appendStringInfoChar(&str, '{');
+    init_spectrum_reader(&reader, spectrum);
+    while (next_spectrum_value(&reader, &value)) {
+        if (str.len > 1) {
+            appendStringInfoChar(&str, ',');
+        }
+        unpack_kmer_value(value, k, kmer);
+        appendBinaryStringInfo(&str, kmer, k);
+    }
+    appendStringInfoChar(&str, '}');
+    PG_FREE_IF_COPY(spectrum, 0);
+    PG_RETURN_CSTRING(str.data);
+}
+
+/*
+ * Binary format of K-mer spectrum (used by spectrum_send and spectrum_recv):
+ *   int8    length k of the K-mers (1-31, or 0 for an empty spectrum whose k is unknown)
+ *   int32   number of K-mers n
+ *   n times int64 value of a K-mer, in strictly increasing order
+ */
+
+/**
+ * @brief Postgres receive function for K-mer spectrum.
+ *
+ * @param buf The binary representation of the K-mer spectrum.
+ * @return The K-mer spectrum created from the binary representation.
+ */
+PG_FUNCTION_INFO_V1(spectrum_recv);
+Datum spectrum_recv(PG_FUNCTION_ARGS) {
+    StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
+    uint8_t k = pq_getmsgbyte(buf);
+    uint32_t count = pq_getmsgint(buf, 4);
+    SpectrumWriter writer;
+
+    if (k > KMER_MAX_LENGTH || (k == 0 && count != 0)) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+            errmsg("invalid kmer length in external value: %d", k)));
+    }
+    if (count > (uint32_t) (buf->len - buf->cursor) / sizeof(int64)) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+            errmsg("insufficient data left in message")));
+    }
+    init_spectrum_writer(&writer, k);
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t value = pq_getmsgint64(buf);
+        if ((value >> (2 * k)) != 0) {
+            ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+                errmsg("kmer value does not fit in %d nucleotides", k)));
+        }
+        if (i > 0 && value <= writer.last) {
+            ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+                errmsg("kmers of a kmer_spectrum must be in strictly increasing order")));
+        }
+        append_to_spectrum_writer(&writer, value);
+    }
+    PG_RETURN_BYTEA_P(finish_spectrum_writer(&writer));
+}
+
+/**
+ * @brief Postgres send function for K-mer spectrum.
+ *
+ * @param spectrum The K-mer spectrum.
+ * @return The binary representation of the K-mer spectrum.
+ */
+PG_FUNCTION_INFO_V1(spectrum_send);
+Datum spectrum_send(PG_FUNCTION_ARGS) {
+    KmerSpectrum* spectrum = PG_GETARG_BYTEA_P(0);
+    SpectrumReader reader;
+    StringInfoData buf;
+    uint64_t value;
+
+    pq_begintypsend(&buf);
+    pq_sendint8(&buf, get_spectrum_kmer_length(spectrum));
+    pq_sendint32(&buf, get_spectrum_cardinality(spectrum));
+    init_spectrum_reader(&reader, spectrum);
+    while (next_spectrum_value(&reader, &value)) {
+        pq_sendint64(&buf, value);
+    }
+    PG_FREE_IF_COPY(spectrum, 0);
+    PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+/**
+ * @brief Builds the spectrum of the K-mers of a DNA sequence.
+ * The K-mers overlapping an IUPAC ambiguity code are skipped.
+ *
+ * @param dna The DNA object.
+ * @param kmer_length The length of the K-mers.
+ * @param canonical Whether the canonical K-mers are collected (optional, false by default).
+ * @return The K-mer spectrum.
+ */
+PG_FUNCTION_INFO_V1(dna_spectrum);
+Datum dna_spectrum(PG_FUNCTION_ARGS) {
+    DNA* dna = PG_GETARG_BYTEA_P(0);
+    uint8_t kmer_length = check_kmer_length(PG_GETARG_INT32(1));
+    bool canonical = PG_NARGS() > 2 && PG_GETARG_BOOL(2);
+    KmerGeneratorState generator;
+    Size nb_values = 0;
+    uint64_t value;
+
+    init_kmer_generator_state(&generator, dna, kmer_length, canonical);
+    Size max_values = generator.length >= kmer_length ? generator.length - kmer_length + 1 : 1;
+    uint64_t* values = palloc_extended(max_values * sizeof(uint64_t), MCXT_ALLOC_HUGE);
+    while (next_kmer_value(&generator, &value)) {
+        values[nb_values++] = value;
+    }
+    KmerSpectrum* spectrum = make_spectrum(kmer_length, values, nb_values);
+    pfree(values);
+    PG_FREE_IF_COPY(dna, 0);
+    PG_RETURN_BYTEA_P(spectrum);
+}
+
+/**
+ * @brief Gets the number of K-mers of a K-mer spectrum.
+ *
+ * @param spectrum The K-mer spectrum.
+ * @return The number of K-mers.
+ */
+PG_FUNCTION_INFO_V1(spectrum_cardinality);
+Datum spectrum_cardinality(PG_FUNCTION_ARGS) {
+    KmerSpectrum* spectrum = PG_GETARG_BYTEA_P(0);
+    int64 count = get_spectrum_cardinality(spectrum);
+    PG_FREE_IF_COPY(spectrum, 0);
+    PG_RETURN_INT64(count);
+}
+
+/**
+ * @brief Returns the K-mers of a K-mer spectrum, in increasing order.
+ *
+ * @param spectrum The K-mer spectrum.
+ * @return A set of K-mers.
+ */
+PG_FUNCTION_INFO_V1(spectrum_kmers);
+Datum spectrum_kmers(PG_FUNCTION_ARGS) {
+    ReturnSetInfo* rsinfo = (ReturnSetInfo*) fcinfo->resultinfo;
+    KmerSpectrum* spectrum = PG_GETARG_BYTEA_P(0);
+    SpectrumReader reader;
+    Kmer kmer;
+    Datum values[1];
+    bool nulls[1] = { false };
+
+    InitMaterializedSRF(fcinfo, MAT_SRF_USE_EXPECTED_DESC);
+    kmer.k = get_spectrum_kmer_length(spectrum);
+    init_spectrum_reader(&reader, spectrum);
+    while (next_spectrum_value(&reader, &kmer.value)) {
+        values[0] = KmerGetDatum(kmer);
+        tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+    }
+    return (Datum) 0;
+}
+
+/**
+ * @brief Computes the union of two K-mer spectra.
+ *
+ * @param spectrum1 The first K-mer spectrum.
+ * @param spectrum2 The second K-mer spectrum.
+ * @return The K-mers of either spectrum.
+ */
+PG_FUNCTION_INFO_V1(spectrum_union);
+Datum spectrum_union(PG_FUNCTION_ARGS) {
+    KmerSpectrum* spectrum1 = PG_GETARG_BYTEA_P(0);
+    KmerSpectrum* spectrum2 = PG_GETARG_BYTEA_P(1);
+    KmerSpectrum* result = merge_spectra(spectrum1, spectrum2, true, true, true);
+    PG_FREE_IF_COPY(spectrum1, 0);
+    PG_FREE_IF_COPY(spectrum2, 1);
+    PG_RETURN_BYTEA_P(result);
+}
+
+/**
+ * @brief Computes the intersection of two K-mer spectra.
+ *
+ * @param spectrum1 The first K-mer spectrum.
+ * @param spectrum2 The second K-mer spectrum.
+ * @return The K-mers of both spectra.
+ */
+PG_FUNCTION_INFO_V1(spectrum_intersection);
+Datum spectrum_intersection(PG_FUNCTION_ARGS) {
+    KmerSpectrum* spectrum1 = PG_GETARG_BYTEA_P(0);
+    KmerSpectrum* spectrum2 = PG_GETARG_BYTEA_P(1);
+    KmerSpectrum* result = merge_spectra(spectrum1, spectrum2, false, false, true);
+    PG_FREE_IF_COPY(spectrum1, 0);
+    PG_FREE_IF_COPY(spectrum2, 1);
+    PG_RETURN_BYTEA_P(result);
+}
+
+/**
+ * @brief Computes the difference of two K-mer spectra.
+ *
+ * @param spectrum1 The first K-mer spectrum.
+ * @param spectrum2 The second K-mer spectrum.
+ * @return The K-mers of the first spectrum which are not in the second one.
+ */
+PG_FUNCTION_INFO_V1(spectrum_difference);
+Datum spectrum_difference(PG_FUNCTION_ARGS) {
+    KmerSpectrum* spectrum1 = PG_GETARG_BYTEA_P(0);
+    KmerSpectrum* spectrum2 = PG_GETARG_BYTEA_P(1);
+    KmerSpectrum* result = merge_spectra(spectrum1, spectrum2, true, false, false);
+    PG_FREE_IF_COPY(spectrum1, 0);
+    PG_FREE_IF_COPY(spectrum2, 1);
+    PG_RETURN_BYTEA_P(result);
+}
+
+/**
+ * @brief Checks if two K-mer spectra are equal.
+ *
+ * @param spectrum1 The first K-mer spectrum.
+ * @param spectrum2 The second K-mer spectrum.
+ * @return True if the spectra hold the same K-mers, false otherwise.
+ */
+PG_FUNCTION_INFO_V1(spectrum_eq);
+Datum spectrum_eq(PG_FUNCTION_ARGS) {
+    KmerSpectrum* spectrum1 = PG_GETARG_BYTEA_P(0);
+    KmerSpectrum* spectrum2 = PG_GETARG_BYTEA_P(1);
+    bool result;
+    if (get_spectrum_cardinality(spectrum1) == 0 || get_spectrum_cardinality(spectrum2) == 0) {
+        result = get_spectrum_cardinality(spectrum1) == get_spectrum_cardinality(spectrum2);
+    } else {
+        result = VARSIZE(spectrum1) == VARSIZE(spectrum2)
+            && memcmp(VARDATA(spectrum1), VARDATA(spectrum2), VARSIZE(spectrum1) - VARHDRSZ) == 0;
+    }
+    PG_FREE_IF_COPY(spectrum1, 0);
+    PG_FREE_IF_COPY(spectrum2, 1);
+    PG_RETURN_BOOL(result);
+}
+
+/**
+ * @brief Checks if a K-mer spectrum contains another one.
+ *
+ * @param spectrum1 The first K-mer spectrum.
+ * @param spectrum2 The second K-mer spectrum.
+ * @return True if all the K-mers of the second spectrum are in the first one, false otherwise.
+ */
+PG_FUNCTION_INFO_V1(spectrum_contains);
+Datum spectrum_contains(PG_FUNCTION_ARGS) {
+    KmerSpectrum* spectrum1 = PG_GETARG_BYTEA_P(0);
+    KmerSpectrum* spectrum2 = PG_GETARG_BYTEA_P(1);
+    uint32_t count2 = get_spectrum_cardinality(spectrum2);
+    check_spectrum_kmer_lengths(spectrum1, spectrum2);
+    bool result = count2 <= get_spectrum_cardinality(spectrum1)
+        && count_common_kmers(spectrum1, spectrum2) == count2;
+    PG_FREE_IF_COPY(spectrum1, 0);
+    PG_FREE_IF_COPY(spectrum2, 1);
+    PG_RETURN_BOOL(result);
+}
+
+/**
+ * @brief Checks if a K-mer spectrum is contained in another one.
+ *
+ * @param spectrum1 The first K-mer spectrum.
+ * @param spectrum2 The second K-mer spectrum.
+ * @return True if all the K-mers of the first spectrum are in the second one, false otherwise.
+ */
+PG_FUNCTION_INFO_V1(spectrum_contained);
+Datum spectrum_contained(PG_FUNCTION_ARGS) {
+    return DirectFunctionCall2(spectrum_contains, PG_GETARG_DATUM(1), PG_GETARG_DATUM(0));
+}
+
+/**
+ * @brief Checks if a K-mer spectrum contains a K-mer.
+ *
+ * @param spectrum The K-mer spectrum.
+ * @param kmer The K-mer.
+ * @return True if the K-mer is in the spectrum, false otherwise.
+ */
+PG_FUNCTION_INFO_V1(spectrum_contains_kmer);
+Datum spectrum_contains_kmer(PG_FUNCTION_ARGS) {
+    KmerSpectrum* spectrum = PG_GETARG_BYTEA_P(0);
+    Kmer kmer = PG_GETARG_KMER(1);
+    SpectrumReader reader;
+    uint64_t value;
+    bool result = false;
+    if (get_spectrum_kmer_length(spectrum) == kmer.k) {
+        init_spectrum_reader(&reader, spectrum);
+        while (next_spectrum_value(&reader, &value) && value <= kmer.value) {
+            if (value == kmer.value) {
+                result = true;
+                break;
+            }
+        }
+    }
+    PG_FREE_IF_COPY(spectrum, 0);
+    PG_RETURN_BOOL(result);
+}
+
+/**
+ * @brief Computes the Jaccard index of two K-mer spectra.
+ *
+ * @param spectrum1 The first K-mer spectrum.
+ * @param spectrum2 The second K-mer spectrum.
+ * @return The size of their intersection divided by the size of their union (1 for two empty spectra).
+ */
+PG_FUNCTION_INFO_V1(spectrum_jaccard);
+Datum spectrum_jaccard(PG_FUNCTION_ARGS) {
+    KmerSpectrum* spectrum1 = PG_GETARG_BYTEA_P(0);
+    KmerSpectrum* spectrum2 = PG_GETARG_BYTEA_P(1);
+    check_spectrum_kmer_lengths(spectrum1, spectrum2);
+    double common = count_common_kmers(spectrum1, spectrum2);
+    double total = (double) get_spectrum_cardinality(spectrum1) + get_spectrum_cardinality(spectrum2) - common;
+    PG_FREE_IF_COPY(spectrum1, 0);
+    PG_FREE_IF_COPY(spectrum2, 1);
+    PG_RETURN_FLOAT8(total == 0 ? 1.0 : common / total);
+}
+
+/**
+ * @brief Computes the containment score of a K-mer spectrum in another one.
+ *
+ * @param spectrum1 The first K-mer spectrum.
+ * @param spectrum2 The second K-mer spectrum.
+ * @return The fraction of the K-mers of the first spectrum which are in the second one (1 if the first is empty).
+ */
+PG_FUNCTION_INFO_V1(spectrum_containment);
+Datum spectrum_containment(PG_FUNCTION_ARGS) {
+    KmerSpectrum* spectrum1 = PG_GETARG_BYTEA_P(0);
+    KmerSpectrum* spectrum2 = PG_GETARG_BYTEA_P(1);
+    check_spectrum_kmer_lengths(spectrum1, spectrum2);
+    double common = count_common_kmers(spectrum1, spectrum2);
+    double total = get_spectrum_cardinality(spectrum1);
+    PG_FREE_IF_COPY(spectrum1, 0);
+    PG_FREE_IF_COPY(spectrum2, 1);
+    PG_RETURN_FLOAT8(total == 0 ? 1.0 : common / total);
+}
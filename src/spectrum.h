@@ -0,0 +1,97 @@
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include "dna.h"
+#include "util.h"
+#include <stdint.h>
+#include <string.h>
+#include "lib/stringinfo.h"
+#include "utils/memutils.h"
+
+/**
+ * @typedef KmerSpectrum
+ * @brief Type used to store a set of K-mers of the same length.
+ */
+typedef bytea KmerSpectrum;
+
+/*
+ * Layout of a K-mer spectrum (after the varlena header):
+ *   uint8   length k of the K-mers (0 for an empty spectrum whose k is unknown, e.g. '{}')
+ *   uint32  number of K-mers
+ *   bytes   the values of the K-mers in strictly increasing order, the first one as is and the
+ *           following ones as the difference with their predecessor, each as an unsigned varint
+ *           (7 bits per byte, least significant group first, high bit set on all but the last byte)
+ * The encoding of a set is unique, so two spectra are equal if and only if their bytes are.
+ */
+#define SPECTRUM_HEADER_SIZE (1 + sizeof(uint32_t))
+#define SPECTRUM_MAX_VARINT_SIZE 10
+
+/**
+ * @brief Reader decoding the K-mers of a spectrum in increasing order.
+ */
+typedef struct SpectrumReader {
+    const uint8_t* data;    /**< Next byte to decode */
+    uint32_t remaining;     /**< Number of K-mers left to decode */
+    uint64_t value;         /**< Value of the last K-mer decoded */
+} SpectrumReader;
+
+/**
+ * @brief Gets the length of the K-mers of a spectrum.
+ *
+ * @param spectrum The K-mer spectrum.
+ * @return The length of the K-mers, 0 if unknown.
+ */
+static inline uint8_t get_spectrum_kmer_length(const KmerSpectrum* spectrum) {
+    return *(const uint8_t*) VARDATA(spectrum);
+}
+
+/**
+ * @brief Gets the number of K-mers of a spectrum.
+ *
+ * @param spectrum The K-mer spectrum.
+ * @return The number of K-mers.
+ */
+static inline uint32_t get_spectrum_cardinality(const KmerSpectrum* spectrum) {
+    uint32_t count;
+    memcpy(&count, (const uint8_t*) VARDATA(spectrum) + 1, sizeof(count));
+    return count;
+}
+
+/**
+ * @brief Initializes a reader on the K-mers of a spectrum.
+ *
+ * @param reader The reader to initialize.
+ * @param spectrum The K-mer spectrum.
+ */
+static inline void init_spectrum_reader(SpectrumReader* reader, const KmerSpectrum* spectrum) {
+    reader->data = (const uint8_t*) VARDATA(spectrum) + SPECTRUM_HEADER_SIZE;
+    reader->remaining = get_spectrum_cardinality(spectrum);
+    reader->value = 0;
+}
+
+/**
+ * @brief Decodes the next K-mer of a spectrum.
+ *
+ * @param reader The reader.
+ * @param value The value of the next K-mer.
+ * @return Whether a K-mer was decoded, false once all of them were.
+ */
+static inline bool next_spectrum_value(SpectrumReader* reader, uint64_t* value) {
+    uint64_t delta = 0;
+    uint8_t byte;
+    int shift = 0;
+    if (reader->remaining == 0) {
+        return false;
+    }
+    do {
+        byte = *reader->data++;
+        delta |= (uint64_t) (byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    reader->remaining--;
+    reader->value += delta;
+    *value = reader->value;
+    return true;
+}
+
+#endif
@@ -0,0 +1,24 @@
+#include "util.h"
+
+#define ST_SORT sort_uint64_values
+#define ST_ELEMENT_TYPE uint64_t
+#define ST_COMPARE(a, b) (*(a) < *(b) ? -1 : *(a) > *(b))
+#define ST_SCOPE extern
+#define ST_DEFINE
+#include "lib/sort_template.h"
+
+/**
+ * @brief Gets the aggregate memory context, failing if the function is not called as an aggregate.
+ *
+ * @param fcinfo The function call information.
+ * @param name The name of the aggregate, for the error message.
+ * @return The aggregate memory context.
+ */
+MemoryContext get_aggregate_context(FunctionCallInfo fcinfo, const char* name) {
+    MemoryContext context;
+    if (!AggCheckCallContext(fcinfo, &context)) {
+        ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+            errmsg("%s function called in non-aggregate context", name)));
+    }
+    return context;
+}
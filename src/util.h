@@ -0,0 +1,15 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include "kmea.h"
+#include <stdint.h>
+
+#define ST_SORT sort_uint64_values
+#define ST_ELEMENT_TYPE uint64_t
+#define ST_SCOPE extern
+#define ST_DECLARE
+#include "lib/sort_template.h"
+
+MemoryContext get_aggregate_context(FunctionCallInfo fcinfo, const char* name);
+
+#endif
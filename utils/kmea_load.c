@@ -0,0 +1,381 @@
+/*
+ * kmea_load: streams FASTA files into a DNA column with COPY ... (FORMAT binary).
+ *
+ * Sequences are packed to 2 bits per nucleotide on the client, using the binary format of the DNA type
+ * (see dna_send/dna_recv in src/dna.c), so the server does no text parsing and receives 4x fewer bytes.
+ * IUPAC ambiguity codes (N, R, Y, ...) are sent as exception runs.
+ *
+ * Usage: kmea_load [-d conninfo] [-t table] [-c column] [-H header_column] [-s] file.fasta...
+ *   -d  libpq connection string (default: the PG* environment variables)
+ *   -t  target table, possibly qualified as schema.table (default: dnas); it is split at its first dot,
+ *       and each part is quoted as is, so it keeps its case and cannot hold a dot itself
+ *   -c  target DNA column (default: dna)
+ *   -H  optional text column receiving the FASTA header (without the leading '>')
+ *   -s  skip sequences holding characters other than nucleotides and IUPAC codes instead of failing
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "libpq-fe.h"
+
+#define COPY_BUFFER_SIZE (1 << 20)
+#define DNA_MAX_LENGTH 0x3FFFFFFE       // MaxAllocSize - 1, see src/dna.h
+
+/**
+ * @brief Growable byte buffer.
+ */
+typedef struct Buffer {
+    uint8_t* data;      /**< The bytes of the buffer */
+    size_t len;         /**< The number of bytes used */
+    size_t maxlen;      /**< The number of bytes allocated */
+} Buffer;
+
+/**
+ * @brief State of the sequence being read from a FASTA file.
+ */
+typedef struct Record {
+    Buffer header;          /**< The header of the sequence (without the leading '>') */
+    Buffer packed;          /**< The nucleotides of the sequence, 4 per byte */
+    Buffer exceptions;      /**< The exception runs of the sequence, in their binary format */
+    uint64_t nb_exceptions; /**< The number of exception runs */
+    uint64_t run_end;       /**< The position after the last exception run */
+    char run_code;          /**< The IUPAC code of the last exception run */
+    uint64_t length;        /**< The number of nucleotides of the sequence */
+    int valid;              /**< Whether the sequence only holds nucleotides and IUPAC codes */
+} Record;
+
+/**
+ * @brief Options of the loader.
+ */
+typedef struct Options {
+    const char* conninfo;
+    const char* table;
+    const char* column;
+    const char* header_column;
+    int skip_invalid;
+} Options;
+
+static PGconn* conn;
+static Buffer copy_buffer;
+static uint64_t nb_loaded = 0;
+static uint64_t nb_skipped = 0;
+
+/**
+ * @brief LUT to convert an ASCII character to a 2-bit representation, 0xFF for invalid characters.
+ */
+static uint8_t ascii_to_nucleotide[256];
+
+/**
+ * @brief LUT to fold an IUPAC ambiguity code to upper case, 0 for other characters.
+ */
+static char ascii_to_ambiguity_code[256];
+
+static void fail(const char* message) {
+    fprintf(stderr, "kmea_load: %s\n", message);
+    if (conn) {
+        PQfinish(conn);
+    }
+    exit(1);
+}
+
+static void buffer_reserve(Buffer* buf, size_t needed) {
+    if (buf->len + needed <= buf->maxlen) {
+        return;
+    }
+    size_t maxlen = buf->maxlen ? buf->maxlen : 1024;
+    while (buf->len + needed > maxlen) {
+        maxlen *= 2;
+    }
+    buf->data = realloc(buf->data, maxlen);
+    if (!buf->data) {
+        fail("out of memory");
+    }
+    buf->maxlen = maxlen;
+}
+
+static void buffer_append(Buffer* buf, const void* data, size_t len) {
+    buffer_reserve(buf, len);
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void buffer_append_int16(Buffer* buf, int16_t value) {
+    uint16_t network = htons((uint16_t) value);
+    buffer_append(buf, &network, sizeof(network));
+}
+
+static void buffer_append_int32(Buffer* buf, int32_t value) {
+    uint32_t network = htonl((uint32_t) value);
+    buffer_append(buf, &network, sizeof(network));
+}
+
+/**
+ * @brief Sends the COPY buffer to the server.
+ */
+static void flush_copy_buffer(void) {
+    if (copy_buffer.len > 0 && PQputCopyData(conn, (const char*) copy_buffer.data, (int) copy_buffer.len) != 1) {
+        fail(PQerrorMessage(conn));
+    }
+    copy_buffer.len = 0;
+}
+
+/**
+ * @brief Adds the current sequence to the COPY stream as one tuple.
+ *
+ * @param record The sequence.
+ * @param options The options of the loader.
+ */
+static void emit_record(Record* record, const Options* options) {
+    if (record->length == 0) {
+        return;
+    }
+    if (!record->valid) {
+        if (!options->skip_invalid) {
+            fprintf(stderr, "kmea_load: sequence \"%.*s\" holds characters other than nucleotides and IUPAC codes\n",
+                    (int) record->header.len, (const char*) record->header.data);
+            fail("aborting (use -s to skip such sequences)");
+        }
+        nb_skipped++;
+        return;
+    }
+    size_t exceptions_len = record->nb_exceptions > 0 ? 4 + record->exceptions.len : 0;
+    if (record->length > DNA_MAX_LENGTH || record->packed.len + exceptions_len > INT32_MAX - 4) {
+        fail("sequence too long for the DNA type");
+    }
+
+    buffer_append_int16(&copy_buffer, options->header_column ? 2 : 1);     // number of fields
+    buffer_append_int32(&copy_buffer, (int32_t) (4 + record->packed.len + exceptions_len));   // DNA: int32 length + packed bytes [+ runs]
+    buffer_append_int32(&copy_buffer, (int32_t) record->length);
+    buffer_append(&copy_buffer, record->packed.data, record->packed.len);
+    if (record->nb_exceptions > 0) {
+        buffer_append_int32(&copy_buffer, (int32_t) record->nb_exceptions);
+        buffer_append(&copy_buffer, record->exceptions.data, record->exceptions.len);
+    }
+    if (options->header_column) {
+        buffer_append_int32(&copy_buffer, (int32_t) record->header.len);   // text: raw bytes
+        buffer_append(&copy_buffer, record->header.data, record->header.len);
+    }
+    nb_loaded++;
+    if (copy_buffer.len >= COPY_BUFFER_SIZE) {
+        flush_copy_buffer();
+    }
+}
+
+/**
+ * @brief Adds an IUPAC ambiguity code at the end of the current sequence, extending the last
+ * exception run when it ends right before with the same code.
+ *
+ * @param record The sequence.
+ * @param code The upper case IUPAC code.
+ */
+static void append_ambiguity_code(Record* record, char code) {
+    if (record->nb_exceptions > 0 && record->run_end == record->length && record->run_code == code) {
+        uint8_t* run_length = record->exceptions.data + record->exceptions.len - 5;
+        uint32_t length;
+        memcpy(&length, run_length, sizeof(length));
+        length = htonl(ntohl(length) + 1);
+        memcpy(run_length, &length, sizeof(length));
+    } else {
+        buffer_append_int32(&record->exceptions, (int32_t) record->length);    // start
+        buffer_append_int32(&record->exceptions, 1);                           // length
+        buffer_append(&record->exceptions, &code, 1);
+        record->nb_exceptions++;
+        record->run_code = code;
+    }
+    record->run_end = record->length + 1;
+}
+
+/**
+ * @brief Packs a line of nucleotides at the end of the current sequence.
+ * IUPAC ambiguity codes are packed as A and recorded as exception runs.
+ *
+ * @param record The sequence.
+ * @param line The line of nucleotides.
+ * @param len The length of the line.
+ */
+static void append_nucleotides(Record* record, const char* line, size_t len) {
+    buffer_reserve(&record->packed, len / 4 + 1);
+    for (size_t i = 0; i < len && record->valid; i++) {
+        uint8_t nucleotide = ascii_to_nucleotide[(uint8_t) line[i]];
+        if (nucleotide == 0xFF) {
+            char code = ascii_to_ambiguity_code[(uint8_t) line[i]];
+            if (code == 0) {
+                record->valid = 0;
+                break;
+            }
+            append_ambiguity_code(record, code);
+            nucleotide = 0b00;
+        }
+        uint8_t position = record->length % 4;
+        if (position == 0) {
+            record->packed.data[record->packed.len++] = 0;
+        }
+        record->packed.data[record->packed.len - 1] |= nucleotide << (6 - 2 * position);
+        record->length++;
+    }
+}
+
+static void reset_record(Record* record) {
+    record->header.len = 0;
+    record->packed.len = 0;
+    record->exceptions.len = 0;
+    record->nb_exceptions = 0;
+    record->run_end = 0;
+    record->length = 0;
+    record->valid = 1;
+}
+
+/**
+ * @brief Reads a FASTA file and streams its sequences.
+ *
+ * @param path The path of the FASTA file, "-" for the standard input.
+ * @param options The options of the loader.
+ */
+static void load_fasta(const char* path, const Options* options) {
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!file) {
+        perror(path);
+        fail("cannot open input file");
+    }
+
+    Record record = {0};
+    reset_record(&record);
+    char* line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    while ((len = getline(&line, &line_size, file)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            len--;
+        }
+        if (len > 0 && line[0] == '>') {
+            emit_record(&record, options);
+            reset_record(&record);
+            buffer_append(&record.header, line + 1, len - 1);
+        } else if (len > 0 && line[0] != ';') {
+            append_nucleotides(&record, line, len);
+        }
+    }
+    emit_record(&record, options);
+
+    free(line);
+    free(record.header.data);
+    free(record.packed.data);
+    free(record.exceptions.data);
+    if (file != stdin) {
+        fclose(file);
+    }
+}
+
+/**
+ * @brief Quotes a table name, possibly qualified by a schema, for the COPY command.
+ *
+ * @param name The table name, as given on the command line.
+ * @return The quoted name (malloc'd), e.g. "public"."reads" for public.reads.
+ */
+static char* escape_table_name(const char* name) {
+    const char* dot = strchr(name, '.');
+    char* table = PQescapeIdentifier(conn, dot ? dot + 1 : name, strlen(dot ? dot + 1 : name));
+    char* schema = dot ? PQescapeIdentifier(conn, name, dot - name) : NULL;
+    if (!table || (dot && !schema)) {
+        fail(PQerrorMessage(conn));
+    }
+    size_t size = strlen(table) + (schema ? strlen(schema) + 1 : 0) + 1;
+    char* escaped = malloc(size);
+    snprintf(escaped, size, "%s%s%s", schema ? schema : "", schema ? "." : "", table);
+    PQfreemem(table);
+    if (schema) {
+        PQfreemem(schema);
+    }
+    return escaped;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: kmea_load [-d conninfo] [-t table] [-c column] [-H header_column] [-s] file.fasta...\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    Options options = { "", "dnas", "dna", NULL, 0 };
+    int opt;
+    while ((opt = getopt(argc, argv, "d:t:c:H:s")) != -1) {
+        switch (opt) {
+            case 'd': options.conninfo = optarg; break;
+            case 't': options.table = optarg; break;
+            case 'c': options.column = optarg; break;
+            case 'H': options.header_column = optarg; break;
+            case 's': options.skip_invalid = 1; break;
+            default: usage();
+        }
+    }
+    if (optind >= argc) {
+        usage();
+    }
+
+    memset(ascii_to_nucleotide, 0xFF, sizeof(ascii_to_nucleotide));
+    ascii_to_nucleotide['A'] = ascii_to_nucleotide['a'] = 0b00;
+    ascii_to_nucleotide['C'] = ascii_to_nucleotide['c'] = 0b01;
+    ascii_to_nucleotide['G'] = ascii_to_nucleotide['g'] = 0b10;
+    ascii_to_nucleotide['T'] = ascii_to_nucleotide['t'] = 0b11;
+    for (const char* code = "NRYSWKMBDHV"; *code; code++) {
+        ascii_to_ambiguity_code[(uint8_t) *code] = *code;
+        ascii_to_ambiguity_code[(uint8_t) (*code - 'A' + 'a')] = *code;
+    }
+
+    conn = PQconnectdb(options.conninfo);
+    if (PQstatus(conn) != CONNECTION_OK) {
+        fail(PQerrorMessage(conn));
+    }
+
+    char* table = escape_table_name(options.table);
+    char* column = PQescapeIdentifier(conn, options.column, strlen(options.column));
+    char* header_column = options.header_column ? PQescapeIdentifier(conn, options.header_column, strlen(options.header_column)) : NULL;
+    if (!column || (options.header_column && !header_column)) {
+        fail(PQerrorMessage(conn));
+    }
+    size_t query_size = strlen(table) + strlen(column) + (header_column ? strlen(header_column) : 0) + 64;
+    char* query = malloc(query_size);
+    snprintf(query, query_size, "COPY %s (%s%s%s) FROM STDIN (FORMAT binary)",
+             table, column, header_column ? ", " : "", header_column ? header_column : "");
+
+    PGresult* result = PQexec(conn, query);
+    if (PQresultStatus(result) != PGRES_COPY_IN) {
+        fail(PQerrorMessage(conn));
+    }
+    PQclear(result);
+
+    // COPY binary header: signature, flags, header extension length
+    buffer_append(&copy_buffer, "PGCOPY\n\377\r\n\0", 11);
+    buffer_append_int32(&copy_buffer, 0);
+    buffer_append_int32(&copy_buffer, 0);
+
+    for (int i = optind; i < argc; i++) {
+        load_fasta(argv[i], &options);
+    }
+
+    buffer_append_int16(&copy_buffer, -1);      // COPY binary trailer
+    flush_copy_buffer();
+    if (PQputCopyEnd(conn, NULL) != 1) {
+        fail(PQerrorMessage(conn));
+    }
+    result = PQgetResult(conn);
+    if (PQresultStatus(result) != PGRES_COMMAND_OK) {
+        fail(PQerrorMessage(conn));
+    }
+    PQclear(result);
+
+    fprintf(stderr, "kmea_load: %llu sequences loaded, %llu skipped\n",
+            (unsigned long long) nb_loaded, (unsigned long long) nb_skipped);
+
+    free(table);
+    PQfreemem(column);
+    if (header_column) {
+        PQfreemem(header_column);
+    }
+    free(query);
+    free(copy_buffer.data);
+    PQfinish(conn);
+    return 0;
+}